@@ -0,0 +1,26 @@
+#include "accelfusion.h"
+#include <math.h>
+
+AccelFusion::AccelFusion() : learning(false), highOffset{0, 0, 0} {
+}
+
+void AccelFusion::setLearning(bool newLearning) {
+    learning = newLearning;
+}
+
+void AccelFusion::fuse(const float low[3], const float high[3], float out[3]) {
+    for (auto axis = 0; axis < 3; axis++) {
+        if (learning) {
+            highOffset[axis] += offsetAlpha * ((high[axis] - low[axis]) - highOffset[axis]);
+        }
+
+        const auto magnitude = fabsf(low[axis]);
+        float weight = (magnitude - blendStart) / (blendEnd - blendStart);
+        weight = weight < 0 ? 0 : (weight > 1 ? 1 : weight);
+        out[axis] = (1 - weight) * low[axis] + weight * (high[axis] - highOffset[axis]);
+    }
+}
+
+float AccelFusion::offset(int axis) const {
+    return highOffset[axis];
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Merges the BMI088 and high-g accelerometers into one acceleration
+ *
+ * Below blendStart on an axis the BMI088 is used as is, above blendEnd the high-g part is used, and in between they
+ * are blended linearly so there is no step as the BMI088 nears saturation. While learning (on the pad) the high-g
+ * offset relative to the BMI088 is tracked per axis, so the two agree at the handover.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class AccelFusion {
+    public:
+        AccelFusion();
+
+        /**
+         * @brief learn the high-g offset from the samples fed to fuse(), do this only while still
+         *
+         */
+        void setLearning(bool learning);
+
+        /**
+         * @brief fuse one pair of samples
+         *
+         * @param low BMI088 specific force in m/s^2
+         * @param high high-g specific force in m/s^2, same axes
+         * @param out fused specific force in m/s^2
+         */
+        void fuse(const float low[3], const float high[3], float out[3]);
+
+        /**
+         * @brief learned high-g minus BMI088 offset
+         *
+         * @param axis 0-2
+         * @return float m/s^2
+         */
+        float offset(int axis) const;
+
+    private:
+        static constexpr float G = 9.8f;
+        static constexpr float blendStart = 18 * G; // BMI088 saturates at 24G
+        static constexpr float blendEnd = 22 * G;
+        static constexpr float offsetAlpha = 0.001f; // ~0.6s at 1600Hz
+
+        bool learning;
+        float highOffset[3];
+};
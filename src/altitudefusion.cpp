@@ -0,0 +1,73 @@
+#include "altitudefusion.h"
+#include <stddef.h>
+
+// baro one sigma altitude error by altitude above sea level. A fixed pressure error turns into a larger altitude error
+// as the air thins, and above the tropopause the standard atmosphere is a poor fit for the day's weather.
+static const struct {
+    float altitude;
+    float sigma;
+} baroBands[] = {
+    {0,         1.0f},
+    {9000,      3.0f},
+    {15000,     15.0f},
+    {20000,     60.0f},
+    {25000,     250.0f},
+    {30000,     1000.0f},
+};
+static constexpr auto numBaroBands = sizeof(baroBands) / sizeof(baroBands[0]);
+
+AltitudeFusion::AltitudeFusion() : haveGPS(false), gpsTime(0), gpsAGL(0), gpsSigma(0), weight(1) {
+}
+
+void AltitudeFusion::setGPS(uint32_t time, float agl, float vAcc) {
+    haveGPS = true;
+    gpsTime = time;
+    gpsAGL = agl;
+    gpsSigma = vAcc;
+}
+
+void AltitudeFusion::clearGPS() {
+    haveGPS = false;
+}
+
+float AltitudeFusion::baroSigma(float altitude) {
+    if (altitude <= baroBands[0].altitude) {
+        return baroBands[0].sigma;
+    }
+    for (size_t i = 1; i < numBaroBands; i++) {
+        if (altitude < baroBands[i].altitude) {
+            const auto &lo = baroBands[i - 1];
+            const auto &hi = baroBands[i];
+            const auto t = (altitude - lo.altitude) / (hi.altitude - lo.altitude);
+            return lo.sigma + t * (hi.sigma - lo.sigma);
+        }
+    }
+    return baroBands[numBaroBands - 1].sigma;
+}
+
+float AltitudeFusion::update(uint32_t time, float baroAGL, float baroAltitude, float vertVel) {
+    // a fix stamped just after the baro sample is fresh, not 49 days old
+    auto age = static_cast<int32_t>(time - gpsTime);
+    if (age < 0) {
+        age = 0;
+    }
+    if (!haveGPS || age > static_cast<int32_t>(maxGPSAgeMS)) {
+        weight = 1;
+        return baroAGL;
+    }
+
+    // carry the fix forward to now
+    const auto ageS = age / 1000.0f;
+    const auto gps = gpsAGL + vertVel * ageS;
+    const auto gSigma = gpsSigma + gpsAgeGrowth * ageS;
+    const auto bSigma = baroSigma(baroAltitude);
+
+    const auto gVar = gSigma * gSigma;
+    const auto bVar = bSigma * bSigma;
+    weight = gVar / (gVar + bVar);
+    return weight * baroAGL + (1 - weight) * gps;
+}
+
+float AltitudeFusion::baroWeight() const {
+    return weight;
+}
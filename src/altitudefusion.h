@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Blends baro and GPS altitude above ground by how much each can be trusted
+ *
+ * The baro is excellent low down but its error grows quickly with altitude as pressure gets small, it is close to
+ * useless above about 50k ft. GPS error is what the receiver reports as vertical accuracy, grown with the age of the
+ * fix. Both are weighted by inverse variance.
+ *
+ * Plain C++, a handful of flops per update.
+ *
+ */
+class AltitudeFusion {
+    public:
+        AltitudeFusion();
+
+        /**
+         * @brief feed a GPS fix
+         *
+         * @param time ms timestamp of the fix
+         * @param agl GPS altitude above ground in m
+         * @param vAcc reported vertical accuracy in m
+         */
+        void setGPS(uint32_t time, float agl, float vAcc);
+
+        /**
+         * @brief forget the GPS, e.g. when it loses its fix
+         *
+         */
+        void clearGPS();
+
+        /**
+         * @brief compute the fused altitude
+         *
+         * @param time ms timestamp
+         * @param baroAGL baro altitude above ground in m
+         * @param baroAltitude baro altitude above sea level in m, selects the baro error band
+         * @param vertVel current vertical velocity in m/s, to carry the GPS fix forward
+         * @return float fused altitude above ground in m
+         */
+        float update(uint32_t time, float baroAGL, float baroAltitude, float vertVel);
+
+        /**
+         * @brief weight given to the baro in the last update
+         *
+         * @return float 0-1
+         */
+        float baroWeight() const;
+
+    private:
+        static constexpr uint32_t maxGPSAgeMS = 2000; // older fixes are ignored
+        static constexpr float gpsAgeGrowth = 5.0f; // m of sigma added per second of fix age
+
+        static float baroSigma(float altitude);
+
+        bool haveGPS;
+        uint32_t gpsTime;
+        float gpsAGL;
+        float gpsSigma;
+        float weight;
+};
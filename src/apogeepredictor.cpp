@@ -0,0 +1,60 @@
+#include "apogeepredictor.h"
+#include <math.h>
+
+ApogeePredictor::ApogeePredictor() {
+    reset();
+}
+
+void ApogeePredictor::reset() {
+    predicted = 0;
+    variance = 0;
+    updates = 0;
+    last = Prediction{false, 0, 0};
+}
+
+ApogeePredictor::Prediction ApogeePredictor::update(uint32_t time, float vertVel, float vertAcc) {
+    const auto decel = -vertAcc;
+    if (vertVel <= 0 || decel < minDecel) {
+        // not coasting upward, nothing to project
+        reset();
+        return last;
+    }
+
+    // Coasting up, dv/dt = -(g + k*v^2). Solve the drag coefficient k from the measured deceleration, then the time
+    // for v to reach zero is atan(v*sqrt(k/g))/sqrt(g*k). That reduces to v/g without drag. Projecting with constant
+    // deceleration instead would be seconds early on fast flights, since drag falls off as the rocket slows.
+    const auto k = (decel - G) / (vertVel * vertVel);
+    float remainingS = vertVel / G;
+    if (k > 0) {
+        remainingS = atanf(vertVel * sqrtf(k / G)) / sqrtf(G * k);
+    }
+    const uint32_t projected = time + static_cast<uint32_t>(1000.0f * remainingS);
+    if (updates == 0) {
+        predicted = projected;
+        variance = 0;
+    } else {
+        // exponentially weighted mean and variance, in ms relative to the running prediction
+        const float diff = static_cast<int32_t>(projected - predicted);
+        predicted += static_cast<int32_t>(alpha * diff);
+        variance = (1 - alpha) * (variance + alpha * diff * diff);
+    }
+    if (updates < minUpdates) {
+        updates++;
+    }
+
+    const float remaining = static_cast<int32_t>(predicted - time);
+    float confidence = 0;
+    if (remaining > 0) {
+        confidence = 100.0f * (1.0f - 2.0f * sqrtf(variance) / remaining);
+    }
+    confidence = confidence < 0 ? 0 : (confidence > 100 ? 100 : confidence);
+
+    last.valid = updates >= minUpdates;
+    last.apogeeTime = predicted;
+    last.confidence = last.valid ? static_cast<uint8_t>(confidence) : 0;
+    return last;
+}
+
+ApogeePredictor::Prediction ApogeePredictor::prediction() const {
+    return last;
+}
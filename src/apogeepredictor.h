@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Projects the time of apogee from vertical velocity and deceleration
+ *
+ * Each update gives a raw projection of apogee time from a gravity plus quadratic drag model. The projections are smoothed and their spread is tracked, and
+ * confidence is how small that spread is relative to the time remaining until the predicted apogee.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class ApogeePredictor {
+    public:
+        struct Prediction {
+            bool valid;             ///< false until enough consistent updates have been seen
+            uint32_t apogeeTime;    ///< predicted ms timestamp of apogee
+            uint8_t confidence;     ///< 0-100 percent
+        };
+
+        ApogeePredictor();
+
+        /**
+         * @brief forget all history, call on liftoff and airstart
+         *
+         */
+        void reset();
+
+        /**
+         * @brief feed a new estimate
+         *
+         * @param time ms timestamp of the estimate
+         * @param vertVel vertical velocity in m/s, positive up
+         * @param vertAcc vertical acceleration in m/s^2, positive up
+         * @return Prediction the current prediction
+         */
+        Prediction update(uint32_t time, float vertVel, float vertAcc);
+
+        /**
+         * @brief get the latest prediction without updating
+         *
+         * @return Prediction
+         */
+        Prediction prediction() const;
+
+    private:
+        static constexpr float G = 9.8f;
+        static constexpr float minDecel = G / 2; // coasting up decelerates at least gravity, allow for noise
+        static constexpr float alpha = 0.2f; // smoothing of the projections
+        static constexpr uint8_t minUpdates = 10; // updates before a prediction is valid
+
+        uint32_t predicted;
+        float variance; // ms^2
+        uint8_t updates;
+        Prediction last;
+};
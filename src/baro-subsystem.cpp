@@ -2,12 +2,17 @@
 #include "log.h"
 #include "statusmanager.h"
 #include "pins.h"
+#include "configmanager.h"
+#include "pressurealtitude.h"
 
 BaroSubsystemClass BaroSubystem;
 
-BaroSubsystemClass::BaroSubsystemClass() :DataProvider<BarometerData>(rwLock), ms5611(0x76) {
+// 10Hz at the slowest tick, even the lowest noise OSR moves the reading nearly every sample
+static constexpr SensorHealth::Limits LIMITS = {500000, 100, 1200, 0}; // hPa, top of the MS5611 range
+
+BaroSubsystemClass::BaroSubsystemClass() :DataProvider<BarometerData>(rwLock), health(LIMITS), qnhhPa(PressureAltitude::standardhPa) {
     name = "baro";
-    static BaseSubsystem* deps[] = {&StatusManager, &LogWriter, NULL};
+    static BaseSubsystem* deps[] = {&StatusManager, &ConfigManager, &LogWriter, NULL};
     static SubsystemManagerClass::Spec spec(this, deps);
     SubsystemManager.addSubsystem(&spec);
 }
@@ -17,49 +22,95 @@ BaroSubsystemClass::~BaroSubsystemClass() {
 
 BaseSubsystem::Status BaroSubsystemClass::setup() {
     setStatus(BaseSubsystem::FAULT);
-    Wire.begin(I2C_SDA, I2C_SCL);
-    if (ms5611.begin()) {
-        /*
-        There are 5 oversampling settings, each corresponding to a different amount of milliseconds
-        The higher the oversampling, the more accurate the reading will be, however the longer it will take.
-        OSR_ULTRA_HIGH -> 8.22 millis
-        OSR_HIGH       -> 4.11 millis
-        OSR_STANDARD   -> 2.1 millis
-        OSR_LOW        -> 1.1 millis
-        OSR_ULTRA_LOW  -> 0.5 millis   Default = backwards compatible
-        */
-        ms5611.setOversampling(OSR_STANDARD); // should make 2.1 ms conversion
-        ms5611.setCompensation(true);
+    I2CBus.begin(I2C_SDA, I2C_SCL);
+    if (ms5611.begin(I2CBus.addDevice("MS5611", 0x76, 400000, I2CBusClass::HIGH_PRIORITY))) {
+        ms5611.setOversampling(groundOSR);
+        ms5611.setTemperatureInterval(temperatureInterval);
         setStatus(BaseSubsystem::READY);
+    } else {
+        Log.errorln("MS5611 not found or bad PROM");
+    }
+
+    EventManager.subscribe([](const Event &event, void *p) {
+        static_cast<BaroSubsystemClass*>(p)->onEvent(event);
+    }, Event::ARM_EVENT | Event::DISARM_EVENT | Event::LIFTOFF_EVENT | Event::APOGEE_EVENT, this);
+
+    ConfigManager.readData([](const ConfigData &config, void *p) {
+        static_cast<BaroSubsystemClass*>(p)->qnhhPa = config.qnhhPa;
+    }, this);
+    ConfigManager.registerCallback([](const ConfigData &config, void *p) {
+        auto self = static_cast<BaroSubsystemClass*>(p);
+        self->rwLock.Lock();
+        self->qnhhPa = config.qnhhPa;
+        self->rwLock.UnLock();
+    }, this);
+
+#ifdef BARO_BENCHMARK
+    {
+        static constexpr int runs = 1000;
+        volatile float sink = 0;
+        auto start = ESP.getCycleCount();
+        for (auto i = 0; i < runs; i++) {
+            sink = PressureAltitude::altitude(300.0f + i * 0.7f, qnhhPa);
+        }
+        const auto table = (ESP.getCycleCount() - start) / runs;
+        start = ESP.getCycleCount();
+        for (auto i = 0; i < runs; i++) {
+            sink = 44330.0f * (1.0f - powf((300.0f + i * 0.7f) / qnhhPa, 0.1902949f));
+        }
+        const auto pow = (ESP.getCycleCount() - start) / runs;
+        Log.noticeln("baro altitude cycles: table %d powf %d", table, pow);
     }
+#endif
 out:
     return getStatus();
 }
 
+void BaroSubsystemClass::onEvent(const Event &event) {
+    auto osr = groundOSR;
+    switch (event.eventType) {
+        case Event::LIFTOFF_EVENT:
+            osr = ascentOSR;
+            break;
+        case Event::APOGEE_EVENT:
+            osr = descentOSR;
+            break;
+        default:
+            break;
+    }
+    rwLock.Lock();
+    ms5611.setOversampling(osr);
+    rwLock.UnLock();
+}
+
 BaseSubsystem::Status BaroSubsystemClass::tick() {
-    static constexpr float seaLevelhPa = 101325;
-    float p; // in mBar/hPa
+    MS5611Driver::Result result;
 
     rwLock.Lock();
-    if (ms5611.read() != MS5611_READ_OK) {
+    result = ms5611.poll(timestampUS());
+    if (result == MS5611Driver::ERROR) {
         setStatus(BaseSubsystem::FAULT);
-        goto out;
+    } else if (result == MS5611Driver::NEW_PRESSURE) {
+        const auto pressure = ms5611.pressure();
+        data.temperature = ms5611.temperature();
+        data.altitude = PressureAltitude::altitude(pressure, qnhhPa);
+        data.time = ms5611.pressureTime();
+        health.update(data.time, &pressure, 1);
     }
-    // FIXME: fixit
-    // WTF gps: 75.478
-    // baro: 25893
-    // ooff by a factor of 343
-    // see https://www.amsys-sensor.com/downloads/notes/ms5611-precise-altitude-measurement-with-a-pressure-sensor-module-amsys-509e.pdf
-    p = ms5611.getPressure();
-    data.temperature = ms5611.getTemperature();
-    // formula courtesy of https://github.com/adafruit/Adafruit_DPS310/blob/master/Adafruit_DPS310.cpp#L271
-    //data.altitude = 44330 * (1.0 - pow((p / 100) / seaLevelhPa, 0.1903));
-    // from https://github.com/jarzebski/Arduino-MS5611/blob/dev/src/MS5611.cpp#L200
-    data.altitude = (44330.0f * (1.0f - powf(p / seaLevelhPa, 0.1902949f)));
-
-out:
+    health.check(timestampUS());
+    data.faults = health.faults();
+    const auto healthChanged = health.healthChanged();
+    const auto healthy = health.healthy();
     rwLock.UnLock();
-    callCallbacks();
+
+    if (healthChanged) {
+        StatusManager.setBoolStatusFlag(healthy, Packet::BAROMETER_STATUS);
+    }
+
+    // only publish fresh readings
+    if (result == MS5611Driver::NEW_PRESSURE) {
+        callCallbacks();
+    }
     return getStatus();
 }
 
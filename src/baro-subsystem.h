@@ -1,8 +1,11 @@
 #pragma once
 
 #include <subsystem.h>
-#include "MS5611.h"
+#include "ms5611driver.h"
+#include "eventmanager.h"
 #include "packet.h"
+#include "timebase.h"
+#include "sensorhealth.h"
 
 struct BarometerData {
     operator BarometerStatus() const {
@@ -13,9 +16,18 @@ struct BarometerData {
     }
     float altitude;
     uint8_t temperature;
+    uint64_t time; // timestampUS() the pressure was sampled
+    uint8_t faults; // SensorHealth::Fault of the stream, 0 if healthy
 };
 
 
+/**
+ * @brief MS5611 barometer
+ *
+ * Ticks fast and only publishes when a pressure conversion has completed. Oversampling follows the flight phase:
+ * quiet readings on the ground and under canopy, fast ones on the way up.
+ *
+ */
 class BaroSubsystemClass : public TickableSubsystem, public DataProvider<BarometerData> {
 public:
     BaroSubsystemClass();
@@ -27,7 +39,16 @@ public:
     BarometerData getBarometerData() const;
 
 private:
-    MS5611 ms5611;
+    static constexpr auto groundOSR = MS5611Driver::OSR_4096; // 9ms, lowest noise for ground reference
+    static constexpr auto ascentOSR = MS5611Driver::OSR_1024; // 2.3ms, rate and latency during boost and coast
+    static constexpr auto descentOSR = MS5611Driver::OSR_2048; // 4.5ms
+    static constexpr uint8_t temperatureInterval = 10; // pressure readings per temperature reading
+
+    void onEvent(const Event &event);
+
+    MS5611Driver ms5611;
+    SensorHealth health;
+    float qnhhPa; // sea level pressure, from config
 };
 
 extern BaroSubsystemClass BaroSubystem;
\ No newline at end of file
@@ -1,66 +1,381 @@
 #include "bmi088-subsystem.h"
 #include "pins.h"
 #include "log.h"
-#include <SPI.h>
+#include "eventmanager.h"
+#include "statusmanager.h"
 
 BMI088SubsystemClass BMI088Subsystem;
 
+// accelerometer registers
+static constexpr uint8_t ACC_CHIP_ID =          0x00;
+static constexpr uint8_t ACC_TEMP_MSB =         0x22;
+static constexpr uint8_t ACC_FIFO_LENGTH_0 =    0x24;
+static constexpr uint8_t ACC_FIFO_DATA =        0x26;
+static constexpr uint8_t ACC_CONF =             0x40;
+static constexpr uint8_t ACC_RANGE =            0x41;
+static constexpr uint8_t ACC_FIFO_CONFIG_0 =    0x48;
+static constexpr uint8_t ACC_FIFO_CONFIG_1 =    0x49;
+static constexpr uint8_t ACC_PWR_CONF =         0x7C;
+static constexpr uint8_t ACC_PWR_CTRL =         0x7D;
+static constexpr uint8_t ACC_SOFTRESET =        0x7E;
+
+// preferences key
+static constexpr char BiasKey[] =               "coefficients";
+
+static constexpr uint8_t ACC_CHIP_ID_VALUE =    0x1E;
+static constexpr uint8_t ACC_CONF_1600HZ =      0xAC; // normal bandwidth, 1600Hz
+static constexpr uint8_t ACC_RANGE_24G =        0x03;
+static constexpr uint8_t ACC_FIFO_STREAM =      0x02; // bit 1 must be set
+static constexpr uint8_t ACC_FIFO_ACC_EN =      0x50; // bit 4 must be set
+static constexpr uint8_t ACC_ACTIVE =           0x00;
+static constexpr uint8_t ACC_ON =               0x04;
+
+// accelerometer FIFO frame headers, low two bits are the interrupt tags
+static constexpr uint8_t ACC_FRAME_MASK =       0xFC;
+static constexpr uint8_t ACC_FRAME_DATA =       0x84;
+static constexpr uint8_t ACC_FRAME_SKIP =       0x40;
+static constexpr uint8_t ACC_FRAME_TIME =       0x44;
+static constexpr uint8_t ACC_FRAME_CONFIG =     0x48;
+static constexpr uint8_t ACC_FRAME_DROP =       0x50;
+
+// gyro registers
+static constexpr uint8_t GYRO_CHIP_ID =         0x00;
+static constexpr uint8_t GYRO_FIFO_STATUS =     0x0E;
+static constexpr uint8_t GYRO_RANGE =           0x0F;
+static constexpr uint8_t GYRO_BANDWIDTH =       0x10;
+static constexpr uint8_t GYRO_SOFTRESET =       0x14;
+static constexpr uint8_t GYRO_FIFO_CONFIG_1 =   0x3E;
+static constexpr uint8_t GYRO_FIFO_DATA =       0x3F;
+
+static constexpr uint8_t GYRO_CHIP_ID_VALUE =   0x0F;
+static constexpr uint8_t GYRO_RANGE_1000DPS =   0x01;
+static constexpr uint8_t GYRO_1000HZ =          0x02; // 1000Hz, 116Hz filter
+static constexpr uint8_t GYRO_FIFO_STREAM =     0x80; // x, y, z
+
+static constexpr uint8_t SOFTRESET =            0xB6;
+static constexpr int SPI_CLOCK =                10000000;
+static constexpr uint8_t SPI_READ =             0x80;
+static constexpr uint8_t ACC_DUMMY_BITS =       8; // the accelerometer sends a dummy byte before read data
+
+static constexpr float ACC_SCALE = 24.0f * 9.80665f / 32768.0f; // m/s^2 per LSB at 24G
+static constexpr float GYRO_SCALE = (1000.0f / 32768.0f) * (PI / 180.0f); // rad/s per LSB at 1000dps
+
+// a live sensor's noise never repeats a frame exactly for long, the rails are just inside full scale
+static constexpr SensorHealth::Limits ACC_LIMITS = {250000, 50, 32700 * ACC_SCALE, 0};
+static constexpr SensorHealth::Limits GYRO_LIMITS = {250000, 100, 32700 * GYRO_SCALE, 0};
+
+SixFloats IMUBatch::latest() const {
+    SixFloats ret = {};
+    if (count > 0) {
+        const auto &frame = frames[count - 1];
+        ret.x = frame.acc[0];
+        ret.y = frame.acc[1];
+        ret.z = frame.acc[2];
+        ret.pitch = frame.gyro[0];
+        ret.roll = frame.gyro[1];
+        ret.yaw = frame.gyro[2];
+    }
+    return ret;
+}
+
 BMI088SubsystemClass::BMI088SubsystemClass() :
-    DataProvider<SixFloats>(rwLock), bmi088(SPI, IMU_CSB1, IMU_CSB2),
-    gyro(SPI, IMU_CSB2), accel(SPI, IMU_CSB1) {
+    DataProvider<IMUBatch>(rwLock), accelDevice(NULL), gyroDevice(NULL), temp(0), accHealth(ACC_LIMITS),
+    gyroHealth(GYRO_LIMITS), learning(true), unsaved(false), lastSave(0), lastGyro{} {
     name = "BMI088 Subsystem";
+    static BaseSubsystem* deps[] = {&EventManager, &StatusManager, &LogWriter, NULL};
+    static SubsystemManagerClass::Spec spec(this, deps);
+    SubsystemManager.addSubsystem(&spec);
+    data.count = 0;
+    data.periodUS = accelPeriodUS;
 }
 
 BMI088SubsystemClass::~BMI088SubsystemClass() {
 }
 
-BaseSubsystem::Status BMI088SubsystemClass::setup() {
-    int rc;
+uint8_t BMI088SubsystemClass::readRegister(SPIBusClass::Device device, uint8_t reg) {
+    alignas(4) uint8_t value[4] = {};
+    SPIBus.readRegisters(device, reg, value, 1, device == accelDevice ? ACC_DUMMY_BITS : 0);
+    return value[0];
+}
+
+bool BMI088SubsystemClass::accelInit() {
+    // the accelerometer starts in I2C mode, a rising edge on CS switches it to SPI
+    readRegister(accelDevice, ACC_CHIP_ID);
+    SPIBus.writeRegister(accelDevice, ACC_SOFTRESET, SOFTRESET);
+    delay(1);
+    readRegister(accelDevice, ACC_CHIP_ID);
+
+    const auto id = readRegister(accelDevice, ACC_CHIP_ID);
+    if (id != ACC_CHIP_ID_VALUE) {
+        Log.errorln("bmi088 accel bad chip id: %x", id);
+        return false;
+    }
 
+    SPIBus.writeRegister(accelDevice, ACC_PWR_CONF, ACC_ACTIVE);
+    delay(1);
+    SPIBus.writeRegister(accelDevice, ACC_PWR_CTRL, ACC_ON);
+    delay(50);
+    SPIBus.writeRegister(accelDevice, ACC_CONF, ACC_CONF_1600HZ);
+    SPIBus.writeRegister(accelDevice, ACC_RANGE, ACC_RANGE_24G);
+    SPIBus.writeRegister(accelDevice, ACC_FIFO_CONFIG_0, ACC_FIFO_STREAM);
+    SPIBus.writeRegister(accelDevice, ACC_FIFO_CONFIG_1, ACC_FIFO_ACC_EN);
+    return true;
+}
+
+bool BMI088SubsystemClass::gyroInit() {
+    SPIBus.writeRegister(gyroDevice, GYRO_SOFTRESET, SOFTRESET);
+    delay(30);
+
+    const auto id = readRegister(gyroDevice, GYRO_CHIP_ID);
+    if (id != GYRO_CHIP_ID_VALUE) {
+        Log.errorln("bmi088 gyro bad chip id: %x", id);
+        return false;
+    }
+
+    SPIBus.writeRegister(gyroDevice, GYRO_RANGE, GYRO_RANGE_1000DPS);
+    SPIBus.writeRegister(gyroDevice, GYRO_BANDWIDTH, GYRO_1000HZ);
+    SPIBus.writeRegister(gyroDevice, GYRO_FIFO_CONFIG_1, GYRO_FIFO_STREAM);
+    return true;
+}
+
+BaseSubsystem::Status BMI088SubsystemClass::setup() {
     setStatus(BaseSubsystem::FAULT);
-    SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
-    rc = accel.begin();
-    if (rc < 0) {
-        Log.errorln("bmi088 accel error: %d", rc);
+
+    preferences.begin("ldrc_imubias", false);
+    {
+        IMUBiasModel::Coefficients coeffs;
+        if (preferences.getBytes(BiasKey, &coeffs, sizeof(coeffs)) == sizeof(coeffs)) {
+            biasModel.setCoefficients(coeffs);
+            Log.noticeln("imu bias loaded, reference %FC", coeffs.refTemp);
+        }
+    }
+    EventManager.subscribe([](const Event &event, void *p) {
+        auto self = static_cast<BMI088SubsystemClass*>(p);
+        self->rwLock.Lock();
+        self->learning = event.eventType == Event::DISARM_EVENT;
+        self->biasModel.setLearning(self->learning);
+        self->rwLock.UnLock();
+    }, Event::ARM_EVENT | Event::DISARM_EVENT, this);
+
+    if (!SPIBus.begin(SPI_SCK, SPI_MISO, SPI_MOSI)) {
         goto out;
     }
-    rc = gyro.begin();
-    if (rc < 0) {
-        Log.errorln("bmi088 accel error: %d", rc);
+    accelDevice = SPIBus.addDevice(IMU_CSB1, SPI_CLOCK, 0);
+    gyroDevice = SPIBus.addDevice(IMU_CSB2, SPI_CLOCK, 0);
+    if (accelDevice == NULL || gyroDevice == NULL) {
         goto out;
     }
-    bmi088.setRange(Bmi088::ACCEL_RANGE_24G, Bmi088::GYRO_RANGE_1000DPS); // ?? idk
-
-
-    // FIXME: read gets (according to docs- confirm in source) NEWEST data in buffer
-    // we need to sample at very high frequency, but hw has a buffer of 64? entries?
-    // so we need to sample theoretically 1/64 as fast. But really, a little faster
 
-    // maaaybe interrupt???
-    /* TODO: set some mode stuff */
+    if (!accelInit()) {
+        goto out;
+    }
+    if (!gyroInit()) {
+        goto out;
+    }
 
     setStatus(BaseSubsystem::READY);
 out:
     return getStatus();
 }
 
+size_t BMI088SubsystemClass::parseGyroFifo(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const auto raw = &gyroBuffer[i * 6];
+        for (auto axis = 0; axis < 3; axis++) {
+            const int16_t value = raw[axis * 2] | (raw[axis * 2 + 1] << 8);
+            gyroFrames[i][axis] = value * GYRO_SCALE;
+        }
+    }
+    return count;
+}
+
+size_t BMI088SubsystemClass::parseAccelFifo(size_t length) {
+    const uint8_t *p = accelBuffer;
+    const uint8_t *end = p + length;
+    size_t count = 0;
+    while (p < end && count < IMUBatch::MAX_FRAMES) {
+        const auto header = *p & ACC_FRAME_MASK;
+        p++;
+        if (header == ACC_FRAME_DATA) {
+            if (end - p < 6) {
+                break;
+            }
+            auto &frame = data.frames[count++];
+            for (auto axis = 0; axis < 3; axis++) {
+                const int16_t value = p[axis * 2] | (p[axis * 2 + 1] << 8);
+                frame.acc[axis] = value * ACC_SCALE;
+            }
+            p += 6;
+        } else if (header == ACC_FRAME_SKIP || header == ACC_FRAME_CONFIG || header == ACC_FRAME_DROP) {
+            p += 1;
+        } else if (header == ACC_FRAME_TIME) {
+            p += 3;
+        } else {
+            // 0x80 is an empty FIFO, anything else we can't parse past
+            break;
+        }
+    }
+    return count;
+}
+
 BaseSubsystem::Status BMI088SubsystemClass::tick() {
+    SPITransaction gyroStatusRead = {};
+    SPITransaction accelLengthRead = {};
+    SPITransaction gyroRead = {};
+    SPITransaction accelRead = {};
+    SPITransaction tempRead = {};
+    size_t gyroCount = 0;
+    size_t accelBytes = 0;
+    bool gyroQueued = false;
+    bool accelQueued = false;
+    bool tempQueued = false;
+    uint64_t now = 0;
+
     rwLock.Lock();
 
-    bmi088.readSensor();
+    // how much is in each FIFO, both queued so they run back to back
+    gyroStatusRead.address = GYRO_FIFO_STATUS | SPI_READ;
+    gyroStatusRead.rx = gyroStatus;
+    gyroStatusRead.length = 1;
+    accelLengthRead.address = ACC_FIFO_LENGTH_0 | SPI_READ;
+    accelLengthRead.dummyBits = ACC_DUMMY_BITS;
+    accelLengthRead.rx = accelLength;
+    accelLengthRead.length = sizeof(accelLength);
+    if (!SPIBus.queue(gyroDevice, gyroStatusRead) || !SPIBus.queue(accelDevice, accelLengthRead)) {
+        setStatus(BaseSubsystem::FAULT);
+        goto out;
+    }
+    SPIBus.wait(gyroDevice);
+    SPIBus.wait(accelDevice);
+    // the newest frames in the FIFOs are the ones just counted
+    now = timestampUS();
 
-    data.x = accel.getAccelX_mss();
-    data.y = accel.getAccelY_mss();
-    data.z = accel.getAccelZ_mss();
+    gyroCount = gyroStatus[0] & 0x7F;
+    if (gyroCount > GYRO_FIFO_FRAMES) {
+        gyroCount = GYRO_FIFO_FRAMES;
+    }
+    accelBytes = (accelLength[0] | (accelLength[1] << 8)) & 0x3FFF;
+    if (accelBytes > ACCEL_FIFO_SIZE) {
+        accelBytes = ACCEL_FIFO_SIZE;
+    }
+
+    // drain both FIFOs, one burst each
+    if (gyroCount > 0) {
+        gyroRead.address = GYRO_FIFO_DATA | SPI_READ;
+        gyroRead.rx = gyroBuffer;
+        gyroRead.length = gyroCount * 6;
+        gyroQueued = SPIBus.queue(gyroDevice, gyroRead);
+    }
+    if (accelBytes > 0) {
+        accelRead.address = ACC_FIFO_DATA | SPI_READ;
+        accelRead.dummyBits = ACC_DUMMY_BITS;
+        accelRead.rx = accelBuffer;
+        accelRead.length = accelBytes;
+        accelQueued = SPIBus.queue(accelDevice, accelRead);
+    }
+    tempRead.address = ACC_TEMP_MSB | SPI_READ;
+    tempRead.dummyBits = ACC_DUMMY_BITS;
+    tempRead.rx = tempBytes;
+    tempRead.length = sizeof(tempBytes);
+    tempQueued = SPIBus.queue(accelDevice, tempRead);
 
-    data.pitch = gyro.getGyroX_rads();
-    data.roll = gyro.getGyroY_rads();
-    data.yaw = gyro.getGyroZ_rads();
+    // the gyro burst goes first, decode it while the accelerometer's is on the bus
+    if (gyroQueued) {
+        SPIBus.wait(gyroDevice);
+        parseGyroFifo(gyroCount);
+    } else {
+        gyroCount = 0;
+    }
+    if (accelQueued) {
+        SPIBus.wait(accelDevice);
+    } else {
+        accelBytes = 0;
+    }
+    data.count = parseAccelFifo(accelBytes);
+    data.time = now;
+    data.periodUS = accelPeriodUS;
 
-    temp = accel.getTemperature_C();
+    // pair each accelerometer frame with the gyro frame nearest in time, both FIFOs end at now
+    for (size_t i = 0; i < data.count; i++) {
+        auto &frame = data.frames[i];
+        const auto age = (data.count - 1 - i) * accelPeriodUS;
+        const auto back = age / gyroPeriodUS;
+        if (back < gyroCount) {
+            const auto g = gyroFrames[gyroCount - 1 - back];
+            for (auto axis = 0; axis < 3; axis++) {
+                lastGyro[axis] = g[axis];
+            }
+        }
+        for (auto axis = 0; axis < 3; axis++) {
+            frame.gyro[axis] = lastGyro[axis];
+        }
+        // before bias removal, which could hide a stuck sensor
+        accHealth.update(now - age, frame.acc, 3);
+        gyroHealth.update(now - age, frame.gyro, 3);
+    }
 
+    if (tempQueued) {
+        SPIBus.wait(accelDevice);
+        int16_t rawTemp = (tempBytes[0] << 3) | (tempBytes[1] >> 5);
+        if (rawTemp > 1023) {
+            rawTemp -= 2048;
+        }
+        temp = rawTemp * 0.125f + 23;
+    }
+    removeBias();
+
+out:
+    accHealth.check(timestampUS());
+    gyroHealth.check(timestampUS());
+    data.faults = accHealth.faults() | gyroHealth.faults();
+    const auto healthChanged = accHealth.healthChanged() | gyroHealth.healthChanged();
+    const auto healthy = data.faults == 0;
+    // an NVS write stalls the flash for ms, never from the SPI ticker in flight
+    const auto save = learning && unsaved && millis() - lastSave > saveIntervalMS;
+    IMUBiasModel::Coefficients coeffs = biasModel.coefficients();
     rwLock.UnLock();
 
+    if (healthChanged) {
+        StatusManager.setBoolStatusFlag(healthy, Packet::IMU_STATUS);
+    }
+
+    if (save) {
+        lastSave = millis();
+        unsaved = false;
+        preferences.putBytes(BiasKey, &coeffs, sizeof(coeffs));
+    }
+
     callCallbacks();
     return getStatus();
 }
+
+void BMI088SubsystemClass::removeBias() {
+    if (data.count == 0) {
+        return;
+    }
+
+    // learn from the batch average
+    float acc[3] = {0, 0, 0};
+    float gyro[3] = {0, 0, 0};
+    for (size_t i = 0; i < data.count; i++) {
+        for (auto axis = 0; axis < 3; axis++) {
+            acc[axis] += data.frames[i].acc[axis];
+            gyro[axis] += data.frames[i].gyro[axis];
+        }
+    }
+    for (auto axis = 0; axis < 3; axis++) {
+        acc[axis] /= data.count;
+        gyro[axis] /= data.count;
+    }
+    if (biasModel.update(temp, acc, gyro)) {
+        unsaved = true;
+    }
+
+    biasModel.biases(temp, acc, gyro);
+    for (size_t i = 0; i < data.count; i++) {
+        for (auto axis = 0; axis < 3; axis++) {
+            data.frames[i].acc[axis] -= acc[axis];
+            data.frames[i].gyro[axis] -= gyro[axis];
+        }
+    }
+}
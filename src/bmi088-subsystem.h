@@ -2,10 +2,50 @@
 
 #include <subsystem.h>
 #include <packet.h>
-#include <BMI088.h>
+#include "spibus.h"
+#include "timebase.h"
+#include "imubiasmodel.h"
+#include "sensorhealth.h"
+#include <Preferences.h>
 
+/**
+ * @brief every IMU frame buffered since the last tick, oldest first
+ *
+ */
+struct IMUBatch {
+    static constexpr size_t MAX_FRAMES = 150; // accel FIFO holds ~146 frames, 90ms at 1600Hz
 
-class BMI088SubsystemClass : public TickableSubsystem, public DataProvider<SixFloats> {
+    struct Frame {
+        float acc[3]; // m/s^2
+        float gyro[3]; // rad/s
+    };
+
+    uint64_t time; // timestampUS() of the newest frame
+    uint32_t periodUS; // time between frames
+    size_t count;
+    uint8_t faults; // SensorHealth::Fault of the stream, 0 if healthy
+    Frame frames[MAX_FRAMES];
+
+    /**
+     * @brief newest frame, in the format of the status packet
+     *
+     */
+    SixFloats latest() const;
+};
+
+/**
+ * @brief BMI088 accelerometer and gyro, read through their hardware FIFOs
+ *
+ * The accelerometer runs at 1600Hz and the gyro at 1000Hz, both FIFOs in stream mode. Each tick drains each FIFO in
+ * a single DMA burst and publishes all accelerometer frames as a batch, each paired with the gyro frame closest in
+ * time. Both bursts are queued together, the gyro frames are decoded while the accelerometer burst is still on the bus.
+ * The accelerometer FIFO fills in ~90ms, so it must be ticked faster than that in every state.
+ *
+ * Temperature dependent biases are learned while disarmed and still, removed before publishing, and saved to flash
+ * now and then.
+ *
+ */
+class BMI088SubsystemClass : public TickableSubsystem, public DataProvider<IMUBatch> {
 public:
     BMI088SubsystemClass();
     virtual ~BMI088SubsystemClass();
@@ -14,11 +54,40 @@ public:
     BaseSubsystem::Status tick();
 
 private:
-    Bmi088 bmi088;
-    Bmi088Gyro gyro;
-    Bmi088Accel accel;
+    static constexpr uint32_t accelPeriodUS = 625; // 1600Hz
+    static constexpr uint32_t gyroPeriodUS = 1000; // 1000Hz
+    static constexpr size_t ACCEL_FIFO_SIZE = 1024;
+    static constexpr size_t GYRO_FIFO_FRAMES = 100;
+
+    bool accelInit();
+    bool gyroInit();
+    size_t parseAccelFifo(size_t length);
+    size_t parseGyroFifo(size_t count);
+
+    uint8_t readRegister(SPIBusClass::Device device, uint8_t reg);
+    void removeBias();
+
+    static constexpr uint32_t saveIntervalMS = 5 * 60 * 1000; // flash wear, temperature moves slowly
+
+    SPIBusClass::Device accelDevice;
+    SPIBusClass::Device gyroDevice;
     float temp;
+    IMUBiasModel biasModel;
+    SensorHealth accHealth;
+    SensorHealth gyroHealth;
+    Preferences preferences;
+    bool learning; // disarmed, biases are learned and may be saved
+    bool unsaved;
+    uint32_t lastSave;
 
+    // raw FIFO contents, DMA targets
+    alignas(4) uint8_t accelBuffer[ACCEL_FIFO_SIZE];
+    alignas(4) uint8_t gyroBuffer[GYRO_FIFO_FRAMES * 6];
+    alignas(4) uint8_t accelLength[2];
+    alignas(4) uint8_t gyroStatus[4];
+    alignas(4) uint8_t tempBytes[2];
+    float gyroFrames[GYRO_FIFO_FRAMES][3];
+    float lastGyro[3]; // held for accelerometer frames with no gyro frame near them
 };
 
-extern BMI088SubsystemClass BMI088Subsystem;
\ No newline at end of file
+extern BMI088SubsystemClass BMI088Subsystem;
@@ -15,6 +15,8 @@ static constexpr char ESSID_STR[] =             "ESSID";
 static constexpr char PASSWORD_STR[] =          "password";
 static constexpr char APMODE_STR[] =            "APMode";
 static constexpr char EMAIL_STR[] =             "email";
+static constexpr char QNH_STR[] =               "qnh";
+static constexpr char LOG_RESERVE_STR[] =       "logReserveKB";
 
 static constexpr char WIFI_CONFIG_STR[] =       "WIFIConfig";
 static constexpr char PYRO_CONFIG_STR[] =       "PyroConfig";
@@ -23,6 +25,8 @@ static constexpr char PYRO_CONFIG_STR[] =       "PyroConfig";
 static constexpr int defaultBeeperFrequency =   2500;
 static constexpr char defaultPassword[] =       "12345678";
 static constexpr bool defaultAPMode =           true;
+static constexpr float defaultQNH =             1013.25f; // standard atmosphere
+static constexpr uint32_t defaultLogReserveKB = 512; // about a flight at full rate
 
 // preferences key
 static constexpr char ConfigKey[] =             "config-data";
@@ -53,7 +57,8 @@ ConfigData::WIFIConfig::WIFIConfig(const ConfigData::WIFIConfig &other) {
     APMode = other.APMode;
 }
 
-ConfigData::ConfigData() : beeperFrequency(defaultBeeperFrequency) {
+ConfigData::ConfigData() : beeperFrequency(defaultBeeperFrequency), qnhhPa(defaultQNH),
+    logReserveKB(defaultLogReserveKB) {
     // find the ID
     uint8_t baseMac[6];
 	// Get MAC address for WiFi station
@@ -112,6 +117,8 @@ bool convertToJson(const ConfigData &src, JsonVariant dst) {
     dst[ID_STR] = src.ID;
     dst[BEEPER_FREQUENCY_STR] = src.beeperFrequency;
     dst[WIFI_CONFIG_STR] = src.wifiConfig;
+    dst[QNH_STR] = src.qnhhPa;
+    dst[LOG_RESERVE_STR] = src.logReserveKB;
 
     auto arr = dst[PYRO_CONFIG_STR].to<JsonArray>();
     for (auto i = 0; i < PyroChannelConfig::maxPyroChannels; i++) {
@@ -130,6 +137,12 @@ void convertFromJson(JsonVariantConst src, ConfigData &dst) {
         auto beeperFrequency = src[BEEPER_FREQUENCY_STR].as<int>();
         dst.beeperFrequency = beeperFrequency;
     }
+    if (src[QNH_STR].is<float>()) {
+        dst.qnhhPa = src[QNH_STR].as<float>();
+    }
+    if (src[LOG_RESERVE_STR].is<uint32_t>()) {
+        dst.logReserveKB = src[LOG_RESERVE_STR].as<uint32_t>();
+    }
     if (src[WIFI_CONFIG_STR].is<ConfigData::WIFIConfig>()) {
         dst.wifiConfig = src[WIFI_CONFIG_STR].as<ConfigData::WIFIConfig>();
     }
@@ -148,6 +161,8 @@ ConfigData::ConfigData(const ConfigData& other) {
     for (auto i = 0; i < PyroChannelConfig::maxPyroChannels; i++) {
         pyroConfigs[i] = other.pyroConfigs[i];
     }
+    qnhhPa = other.qnhhPa;
+    logReserveKB = other.logReserveKB;
 }
 
 ConfigManagerClass::ConfigManagerClass() : BaseSubsystem(), DataProvider<ConfigData>(rwLock) {
@@ -40,6 +40,9 @@ struct __attribute__((packed)) ConfigData {
     } ownerInformation;
 
     PyroChannelConfig pyroConfigs[PyroChannelConfig::maxPyroChannels];
+
+    float qnhhPa; // sea level pressure for baro altitude
+    uint32_t logReserveKB; // free storage to keep, older flight logs are deleted to make it
 };
 
 bool canConvertFromJson(JsonVariantConst src, const ConfigData::WIFIConfig&);
@@ -1,97 +1,300 @@
 #include "datalogger.h"
 #include "log.h"
 #include "configmanager.h"
+#include "timebase.h"
 
-#define SECOND 10000
+#define SECOND 1000
 #define MINUTE (60*SECOND)
 
+static_assert(LogPartition::SECTOR_SIZE == LogFormat::BLOCK_SIZE, "log blocks must be flash sectors");
+
+// changing these changes the log format, see tools/logdecode.cpp
+static_assert(sizeof(StatusPacket) == LogFormat::STATUS_SIZE, "status packet is not the logged size");
+static_assert(sizeof(Event) == LogFormat::EVENT_SIZE, "event is not the logged size");
+static_assert(sizeof(GPSFix) == LogFormat::GPS_SIZE, "gps fix is not the logged size");
+
 DataLoggerClass DataLogger;
 
-DataLoggerClass::DataLoggerClass() : buffLen(0) {
-    static BaseSubsystem* deps[] = {&StatusManager, &LogWriter, &ConfigManager, NULL};
+DataLoggerClass::DataLoggerClass() : session(0), sessions(0), logId(0), sessionEnding(false),
+    storage(nullptr), storageSession(0), blockSequence(0), periodMS(0), mode(IDLE_MODE),
+    ring(nullptr), ringHead(0), ringCount(0), flushWanted(false), stats{} {
+    static BaseSubsystem* deps[] = {&StatusManager, &LogWriter, &ConfigManager, &IMUFusion, &BaroSubystem,
+        &GPSSubsystem, NULL};
     static SubsystemManagerClass::Spec spec(this, deps);
     SubsystemManager.addSubsystem(&spec);
 
     name = "DataLogger";
-    queue = xQueueCreateStatic(QUEUE_DEPTH,
-        sizeof(DataLoggerClass::LogItem),
-        queueStorage,
-        &staticQueue);
+    bufferLock = xSemaphoreCreateMutexStatic(&bufferLockBuffer);
+    storageLock = xSemaphoreCreateMutexStatic(&storageLockBuffer);
 }
 
 DataLoggerClass::~DataLoggerClass() {
 }
 
 BaseSubsystem::Status DataLoggerClass::setup() {
+    bool mounted;
+    uint8_t *first;
+    uint8_t *second;
+
+    // the buffers are big, keep them out of internal RAM
+    first = static_cast<uint8_t*>(heap_caps_malloc(LogBuffers::BUFFER_SIZE, MALLOC_CAP_SPIRAM));
+    second = static_cast<uint8_t*>(heap_caps_malloc(LogBuffers::BUFFER_SIZE, MALLOC_CAP_SPIRAM));
+    if (first == nullptr || second == nullptr) {
+        Log.errorln("datalogger: no memory for buffers");
+        setStatus(BaseSubsystem::FAULT);
+        goto out;
+    }
+    buffers.begin(first, second, [](void *ctx) {
+        auto self = static_cast<DataLoggerClass*>(ctx);
+        if (self->taskHandle != nullptr) {
+            xTaskNotifyGive(self->taskHandle);
+        }
+    }, this);
+    ring = static_cast<RingEntry*>(heap_caps_malloc(RING_SIZE * sizeof(RingEntry), MALLOC_CAP_SPIRAM));
+    if (ring == nullptr) {
+        Log.errorln("datalogger: no memory for the prelaunch ring");
+        setStatus(BaseSubsystem::FAULT);
+        goto out;
+    }
+
+    // the web pages are on it too, so mount it even if logs go to the partition
+    mounted = LittleFS.begin();
+    if (!mounted) {
+        Log.errorln("datalogger: could not mount filesystem");
+    }
+
+    if (partitionStorage.begin()) {
+        storage = &partitionStorage;
+    } else if (mounted && fileStorage.begin()) {
+        storage = &fileStorage;
+    } else {
+        Log.errorln("datalogger: no storage for logs");
+        setStatus(BaseSubsystem::FAULT);
+        goto out;
+    }
+
     EventManager.subscribe([](const Event& event, void *ctx) {
         auto self = static_cast<DataLoggerClass*>(ctx);
         self->LogEvent(event);
     },  0xFFFFFFFF, this);
+    IMUFusion.registerCallback([](const IMUBatch& batch, void *ctx) {
+        static_cast<DataLoggerClass*>(ctx)->LogIMU(batch);
+    }, this);
+    BaroSubystem.registerCallback([](const BarometerData& data, void *ctx) {
+        static_cast<DataLoggerClass*>(ctx)->LogBaro(data);
+    }, this);
+    GPSSubsystem.registerCallback([](const GPSFix& fix, void *ctx) {
+        static_cast<DataLoggerClass*>(ctx)->LogGPS(fix);
+    }, this);
 
-    // TODO: file naming and cleanup by unix epoch time
-    // if you do that, you can't setup files until you get the firstfix event
-    // if you go ordinal names, you don't need to wait.
-
-    // we can have up to n flight logs - perhaps 2
-    // we should have a directory we put them
-    // such as datalogs/datalog-%d - where %d is the unix epoch time
-    // if storage is less than threshold- we clear the oldest
-    // this requires that we actually only start when we know what time it is
-    // either because the rtc is always set or the gps has a fix
-    //
-    // for now, just use the same file every time and clear it when rebooted
-
-    file = LittleFS.open("/datalogs/datalog", "w");
-    if (!file) {
-        setStatus(BaseSubsystem::FAULT);
-    } else {
-        setStatus(BaseSubsystem::READY);
-    }
+    setStatus(BaseSubsystem::READY);
 
+out:
     return getStatus();
 }
 
-BaseSubsystem::Status DataLoggerClass::start() {
-    setStatus(BaseSubsystem::RUNNING);
-    return getStatus();
+int DataLoggerClass::taskPriority() const {
+    // below every ticker, flash writes must never hold up a sensor
+    return 1;
 }
 
-void DataLoggerClass::taskFunction(void *paremeter) {
+void DataLoggerClass::taskFunction(void *parameter) {
+    uint32_t lastStatus = 0;
+    bool busy = false;
     while(1) {
-        auto xLastWakeTime = xTaskGetTickCount();
+        const auto period = getPeriod();
+        auto wait = MAX_BUFFER_AGE_MS;
+        if (period > 0 && period < wait) {
+            wait = period;
+        }
+        // storage has housekeeping to do, come straight back after letting others run
+        if (busy) {
+            wait = 1;
+        }
+        // woken early whenever a buffer fills
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
 
-        // this is a little confusing, but actually shove a status packet if our period is "on"
-        if (getPeriod() > 0) {
+        const auto now = millis();
+        if (period > 0 && now - lastStatus >= period) {
+            lastStatus = now;
             StatusManager.readData([](const StatusPacket &packet, void *ctx) {
                 auto self = static_cast<DataLoggerClass*>(ctx);
                 self->LogStatus(packet);
             }, this);
-        } else {
-            delay(SECOND);
-            continue;
         }
-        auto item = &(buffer[buffLen]);
-        if (xQueueReceive(queue, item, SECOND) == pdPASS) {
-            buffLen++;
-            // if you just grabbed an event -or- buffer is full, flush
-            if (item->itemType == LogItem::EVENT_ITEM) {
-                setPeriodFromEvent(item->item.event);
-            }
-            if (item->itemType == LogItem::EVENT_ITEM || buffLen >= BUFFER_SIZE) {
-                startFlush = millis();
-                for (auto i = 0; i < buffLen; i++) {
-                    const auto& logItem = buffer[i];
-                    const auto size = logItem.itemSize;
-
-                    file.write(logItem.itemType);
-                    file.write(size);
-                    file.write(logItem.asBytes(), size);
-                }
-                endFlush = millis();
-            }
-            buffLen = 0; // clear the buffer
+
+        xSemaphoreTake(bufferLock, portMAX_DELAY);
+        if (buffers.activeLength() > 0 && now - buffers.activeSince() >= MAX_BUFFER_AGE_MS) {
+            flushWanted = true;
         }
-        vTaskDelayUntil(&xLastWakeTime, getPeriod());
+        xSemaphoreGive(bufferLock);
+
+        ringDrain();
+        flush();
+        writeBuffers();
+        // a flush that found the other buffer still waiting goes now rather than next time round
+        flush();
+        writeBuffers();
+
+        busy = maintainStorage();
+    }
+}
+
+/**
+ * @brief close the flight once the session is over and all of it is on flash, and do storage housekeeping
+ *
+ * @return true if storage has more to do
+ */
+bool DataLoggerClass::maintainStorage() {
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    const auto done = session == 0 && buffers.empty();
+    const auto flying = mode == DRAIN_MODE || mode == FLIGHT_MODE;
+    const auto armed = session != 0;
+    xSemaphoreGive(bufferLock);
+
+    xSemaphoreTake(storageLock, portMAX_DELAY);
+    if (done && storageSession != 0) {
+        storage->close();
+        storageSession = 0;
+    }
+    const auto ret = storage->maintain(flying, armed);
+    xSemaphoreGive(storageLock);
+    return ret;
+}
+
+bool DataLoggerClass::append(LogRecordType type, const void *payload, size_t length) {
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    auto ret = appendLocked(type, payload, length);
+    xSemaphoreGive(bufferLock);
+    return ret;
+}
+
+bool DataLoggerClass::appendLocked(LogRecordType type, const void *payload, size_t length) {
+    // nothing is kept while disarmed
+    if (session == 0) {
+        return false;
+    }
+    if (!buffers.append(session, logId, millis(), type, payload, length)) {
+        stats.dropped++;
+        return false;
+    }
+    stats.records++;
+    return true;
+}
+
+/**
+ * @brief have the task write the active buffer even though it isn't full
+ *
+ */
+void DataLoggerClass::requestFlushLocked() {
+    flushWanted = true;
+    if (taskHandle != nullptr) {
+        xTaskNotifyGive(taskHandle);
+    }
+}
+
+/**
+ * @brief hand over the active buffer even though it isn't full, if that was asked for
+ *
+ */
+void DataLoggerClass::flush() {
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    if (flushWanted) {
+        // if the other buffer is still waiting, try again next time round
+        if (buffers.activeLength() == 0 || buffers.swap()) {
+            flushWanted = false;
+        }
+    }
+    xSemaphoreGive(bufferLock);
+}
+
+/**
+ * @brief seal and write full buffers oldest first, each with one write
+ *
+ */
+void DataLoggerClass::writeBuffers() {
+    while(1) {
+        xSemaphoreTake(bufferLock, portMAX_DELAY);
+        const auto b = buffers.next();
+        const auto flying = mode == DRAIN_MODE || mode == FLIGHT_MODE;
+        xSemaphoreGive(bufferLock);
+        if (b == nullptr) {
+            return;
+        }
+
+        // the buffer is ours until it is released
+        xSemaphoreTake(storageLock, portMAX_DELAY);
+        if (b->session != storageSession) {
+            const auto fix = GPSSubsystem.getFix();
+            storage->close();
+            storage->open(fix.fixType > 1 ? fix.epoch : 0);
+            // if that failed, don't try again for every buffer
+            storageSession = b->session;
+            blockSequence = 0;
+        }
+        const auto startUS = timestampUS();
+        const auto written = LogBuffers::write(*b, *storage, blockSequence, flying);
+        const auto micros = static_cast<uint32_t>(timestampUS() - startUS);
+        xSemaphoreGive(storageLock);
+        if (written != b->length) {
+            Log.errorln("datalogger: wrote %d of %d bytes", written, b->length);
+        }
+
+        xSemaphoreTake(bufferLock, portMAX_DELAY);
+        stats.writes++;
+        if (written != b->length) {
+            stats.writeErrors++;
+        }
+        stats.bytes += written;
+        stats.writeMicros += micros;
+        stats.lastWriteMicros = micros;
+        if (micros > stats.maxWriteMicros) {
+            stats.maxWriteMicros = micros;
+        }
+        buffers.release(*b);
+        xSemaphoreGive(bufferLock);
+    }
+}
+
+size_t DataLoggerClass::listFlights(LogFlight *out, size_t max) {
+    if (storage == nullptr) {
+        return 0;
+    }
+    xSemaphoreTake(storageLock, portMAX_DELAY);
+    const auto ret = storage->flights(out, max);
+    xSemaphoreGive(storageLock);
+    return ret;
+}
+
+size_t DataLoggerClass::readFlight(uint32_t ordinal, size_t offset, uint8_t *out, size_t length) {
+    if (storage == nullptr) {
+        return 0;
+    }
+    xSemaphoreTake(storageLock, portMAX_DELAY);
+    const auto ret = storage->read(ordinal, offset, out, length);
+    xSemaphoreGive(storageLock);
+    return ret;
+}
+
+DataLoggerClass::Stats DataLoggerClass::getStats() const {
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    auto ret = stats;
+    xSemaphoreGive(bufferLock);
+    return ret;
+}
+
+void DataLoggerClass::logStats() {
+    const auto s = getStats();
+    const auto kb = static_cast<unsigned long>(s.bytes / 1024);
+    const auto kbPerSecond = s.writeMicros ? static_cast<unsigned long>(s.bytes * 1000000 / 1024 / s.writeMicros) : 0;
+    const auto avgMicros = s.writes ? static_cast<unsigned long>(s.writeMicros / s.writes) : 0;
+    Log.noticeln("datalogger: %lu records %lu dropped, %lu writes %lu errors, %luKB at %luKB/s, write avg %luus "
+        "last %luus max %luus", s.records, s.dropped, s.writes, s.writeErrors, kb, kbPerSecond, avgMicros,
+        s.lastWriteMicros, s.maxWriteMicros);
+    if (storage != nullptr) {
+        xSemaphoreTake(storageLock, portMAX_DELAY);
+        storage->logStats();
+        xSemaphoreGive(storageLock);
     }
 }
 
@@ -134,18 +337,214 @@ uint32_t DataLoggerClass::getPeriod() const {
     return ret;
 }
 
+/**
+ * @brief start logging to a new file
+ *
+ */
+void DataLoggerClass::beginSessionLocked() {
+    if (session != 0) {
+        return;
+    }
+    session = ++sessions;
+    logId = esp_random();
+    appendLocked(HEADER_RECORD, &logId, sizeof(logId));
+}
+
+/**
+ * @brief stop logging, the task writes what is left and closes the file
+ *
+ */
+void DataLoggerClass::endSessionLocked() {
+    if (session == 0) {
+        return;
+    }
+    // the ring still has samples of this session to log
+    if (mode == LANDED_DRAIN_MODE) {
+        sessionEnding = true;
+        return;
+    }
+    session = 0;
+    requestFlushLocked();
+}
+
+/**
+ * @brief switch what happens to samples
+ *
+ * @note takes effect between two samples, none can be lost or go to the wrong place
+ */
+void DataLoggerClass::setModeLocked(Mode newMode) {
+    if (newMode == PRELAUNCH_MODE && mode != PRELAUNCH_MODE) {
+        ringHead = 0;
+        ringCount = 0;
+    }
+    // the flight ended before the ring was logged. Logging all of it here would hold bufferLock for thousands of
+    // records on the event thread, so the task carries on a chunk at a time and leaves the mode once it's done.
+    if ((mode == DRAIN_MODE || mode == LANDED_DRAIN_MODE) && newMode != FLIGHT_MODE && ringCount > 0) {
+        mode = LANDED_DRAIN_MODE;
+        return;
+    }
+    // get the flight onto flash now rather than in a minute
+    if ((mode == DRAIN_MODE || mode == FLIGHT_MODE || mode == LANDED_DRAIN_MODE) &&
+        newMode != DRAIN_MODE && newMode != FLIGHT_MODE) {
+        requestFlushLocked();
+    }
+    mode = newMode;
+}
+
+void DataLoggerClass::ringPushLocked(LogRecordType type, const void *sample) {
+    auto &e = ring[ringHead];
+    e.type = type;
+    if (type == IMU_RECORD) {
+        e.imu = *static_cast<const LogIMUSample*>(sample);
+    } else {
+        e.baro = *static_cast<const LogBaroSample*>(sample);
+    }
+    ringHead = (ringHead + 1) % RING_SIZE;
+    if (ringCount < RING_SIZE) {
+        ringCount++;
+    }
+}
+
+/**
+ * @brief log the oldest entries in the ring and take them out of it
+ *
+ * @param max entries to log at most
+ * @return size_t entries left
+ */
+size_t DataLoggerClass::ringDrainLocked(size_t max) {
+    auto i = (ringHead + RING_SIZE - ringCount) % RING_SIZE;
+    for (; ringCount > 0 && max > 0; ringCount--, max--) {
+        const auto &e = ring[i];
+        if (e.type == IMU_RECORD) {
+            appendLocked(IMU_RECORD, &e.imu, sizeof(e.imu));
+        } else {
+            appendLocked(BARO_RECORD, &e.baro, sizeof(e.baro));
+        }
+        i = (i + 1) % RING_SIZE;
+    }
+    return ringCount;
+}
+
+/**
+ * @brief the ring is logged, log samples directly, or if the flight ended meanwhile finish what it started
+ *
+ */
+void DataLoggerClass::drainedLocked() {
+    if (mode == DRAIN_MODE) {
+        setModeLocked(FLIGHT_MODE);
+        return;
+    }
+    setModeLocked(IDLE_MODE);
+    if (sessionEnding) {
+        sessionEnding = false;
+        endSessionLocked();
+    }
+}
+
+/**
+ * @brief log the ring after liftoff a chunk at a time, letting producers in between, then log samples directly
+ *
+ */
+void DataLoggerClass::ringDrain() {
+    while (1) {
+        xSemaphoreTake(bufferLock, portMAX_DELAY);
+        if (mode != DRAIN_MODE && mode != LANDED_DRAIN_MODE) {
+            xSemaphoreGive(bufferLock);
+            return;
+        }
+        if (ringDrainLocked(RING_DRAIN_CHUNK) == 0) {
+            drainedLocked();
+        }
+        xSemaphoreGive(bufferLock);
+        // the ring can fill more than a buffer, don't let them both fill up
+        writeBuffers();
+    }
+}
+
 void DataLoggerClass::LogEvent(const Event& event) {
-    static LogItem item; // this is not a race condition- LogEvent is only called from the EventManager thread
-    item.itemType = LogItem::EVENT_ITEM;
-    item.item.event = event;
-    item.itemSize = sizeof(Event);
-    xQueueSend(queue, &item, 0);
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    switch(event.eventType) {
+        case Event::ARM_EVENT:
+            // armed again before the task logged the last flight's ring, on the ground it can be finished here
+            if (mode == LANDED_DRAIN_MODE) {
+                ringDrainLocked(RING_SIZE);
+                drainedLocked();
+            }
+            beginSessionLocked();
+            setModeLocked(PRELAUNCH_MODE);
+            break;
+        case Event::LIFTOFF_EVENT:
+            // what led up to liftoff goes ahead of the live stream, the task logs it
+            setModeLocked(DRAIN_MODE);
+            if (taskHandle != nullptr) {
+                xTaskNotifyGive(taskHandle);
+            }
+            break;
+        case Event::DISARM_EVENT:
+        case Event::LANDING_EVENT:
+            setModeLocked(IDLE_MODE);
+            break;
+    }
+    appendLocked(EVENT_RECORD, &event, sizeof(event));
+    // the disarm is the last record of the session
+    if (event.eventType == Event::DISARM_EVENT) {
+        endSessionLocked();
+    } else if (event.eventType & FLUSH_EVENTS) {
+        requestFlushLocked();
+    }
+    xSemaphoreGive(bufferLock);
+
+    setPeriodFromEvent(event);
 }
 
 void DataLoggerClass::LogStatus(const StatusPacket &status) {
-    static LogItem item; // this is not a race condition - LogStatus is only called from this thread
-    item.itemType = LogItem::STATUS_ITEM;
-    item.item.statusPacket = status;
-    item.itemSize = sizeof(StatusPacket);
-    xQueueSend(queue, &item, 0);
-}
\ No newline at end of file
+    append(STATUS_RECORD, &status, sizeof(status));
+}
+
+void DataLoggerClass::LogIMU(const IMUBatch& batch) {
+    // one lock for the whole batch, it's 16 frames a tick
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    if (mode == IDLE_MODE || mode == LANDED_DRAIN_MODE) {
+        goto out;
+    }
+    for (size_t i = 0; i < batch.count; i++) {
+        const auto &frame = batch.frames[i];
+        LogIMUSample sample;
+        sample.time = batch.time - (batch.count - 1 - i) * batch.periodUS;
+        memcpy(sample.acc, frame.acc, sizeof(sample.acc));
+        memcpy(sample.gyro, frame.gyro, sizeof(sample.gyro));
+        sample.faults = batch.faults;
+        if (mode == FLIGHT_MODE) {
+            appendLocked(IMU_RECORD, &sample, sizeof(sample));
+        } else {
+            ringPushLocked(IMU_RECORD, &sample);
+        }
+    }
+
+out:
+    xSemaphoreGive(bufferLock);
+}
+
+void DataLoggerClass::LogBaro(const BarometerData& data) {
+    const LogBaroSample sample = {
+        .time = data.time,
+        .altitude = data.altitude,
+        .temperature = data.temperature,
+        .faults = data.faults,
+    };
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    if (mode == FLIGHT_MODE) {
+        appendLocked(BARO_RECORD, &sample, sizeof(sample));
+    } else if (mode == PRELAUNCH_MODE || mode == DRAIN_MODE) {
+        ringPushLocked(BARO_RECORD, &sample);
+    }
+    xSemaphoreGive(bufferLock);
+}
+
+void DataLoggerClass::LogGPS(const GPSFix& fix) {
+    xSemaphoreTake(bufferLock, portMAX_DELAY);
+    if (mode == DRAIN_MODE || mode == FLIGHT_MODE) {
+        appendLocked(GPS_RECORD, &fix, sizeof(fix));
+    }
+    xSemaphoreGive(bufferLock);
+}
@@ -4,93 +4,181 @@
 #include "packet.h"
 #include "eventmanager.h"
 #include "statusmanager.h"
+#include "imufusion.h"
+#include "baro-subsystem.h"
+#include "gps-subsystem.h"
+#include "logformat.h"
+#include "logbuffers.h"
+#include "filelogstorage.h"
+#include "partitionlogstorage.h"
 #include <LittleFS.h>
 
-
 /**
- * @brief DataLogger logs key data in binary format to flash in regular intervals
- *
- * The DataLogger will essentailly log status packets every n milliseconds and
- * also record events
- *
- * The file backing will be managed such that it does not fill up the disk
- *
- * The tick should be called every 100ms or so in flight, but every 10s on pad and ground
- *
- *  let's imagine a 600 second flight w/ combined one hour on the ground
- *  assuming status packets are 128 bytes
- *  flight portion would take 750kB
- *  one hour combined pad and ground at 10s interval would take 45kB
+ * @brief DataLogger logs flight data in binary format to flash
  *
- *  all together that is approx 800kB/flight
- *     "storageTot": 1408,
- *     "storageUsed": 156
+ * Records are appended to one of two large RAM buffers, each a whole number of flash blocks, see LogBuffers. When the
+ * buffer that is filling can't take the next record its tail is padded and it is handed to the logger task, which
+ * writes it with a single file write while producers carry on in the other buffer. Producers never touch flash, they
+ * only copy under a short lock, so the IMU can log every frame from the SPI ticker. A record only gets dropped if both
+ * buffers are full, i.e. flash can't keep up, and drops are counted.
  *
- *  with change to partition, now we have:
- *     "storageTot": 1536,
- *     "storageUsed": 156
- *  that gives 1380KB free
+ * The records are those of logformat.h. A record that won't fit in what is left of a block goes in the next one, and
+ * every block starts with keyframes. The task seals each block with its commit record just before writing it, so the
+ * CRC is never computed under the lock.
  *
- *  we need to make flights smaller
+ * What is logged:
+ *  - events, always
+ *  - status packets, at a rate set by the flight phase: 10s armed on the pad, 100ms to apogee, 1s under canopy,
+ *    5 minutes after landing, none disarmed
+ *  - every IMU frame, baro sample and GPS fix from liftoff to landing
  *
- *  30m on pad at 10s
- *  30s to apogee at 100ms
- *  300s to gnd at 1s
+ * While armed, IMU frames and baro samples go round a ring in PSRAM holding the last couple of seconds instead of to
+ * flash. On liftoff the ring is logged ahead of the live stream, so the log starts before ignition, without the pad
+ * wait wearing the flash. The task logs the ring a chunk at a time, so producers never wait on more than a chunk, and
+ * samples keep going into the ring until it is empty. Events and GPS fixes in that time are logged straight away,
+ * ahead of the older samples still in the ring. A flight that lands or is disarmed before then still has the rest of
+ * the ring logged by the task, and the session only ends after it.
  *
+ * A partly filled buffer is written after a minute, whenever recording stops and right after every flight event,
+ * so the pad and ground phases aren't lost with the power and an event is on flash within one buffer write of
+ * happening. Each such write pads to the next block.
  *
- *  okay, so the only way to adjust tick frequency means we need to
- *  make the adjustable ticking system
- *  which is a big change
- *
- * Fuck it, we make it a threaded subsystem and fixit later
+ * Each arming is a session, logged as one flight from arm to disarm. Flights go to the flightlog partition if the
+ * partition table has one, or to files on LittleFS otherwise, see PartitionLogStorage and FileLogStorage. Storage
+ * housekeeping runs between writes, never in flight. Nothing is logged while disarmed. A flight cut short by a power
+ * loss is recovered at boot up to its last sealed block.
  *
+ * An IMU frame takes about 7 bytes, so a minute of flight at full rate is around 700KB, of the 3.2MB flightlog
+ * partition or the 1.4MB of LittleFS.
  *
  */
 class DataLoggerClass : public ThreadedSubsystem {
     public:
+        /**
+         * @brief what the logger has done so far
+         *
+         */
+        struct Stats {
+            uint32_t records;       ///< appended
+            uint32_t dropped;       ///< lost because both buffers were full
+            uint32_t writes;        ///< buffers written
+            uint32_t writeErrors;   ///< short writes
+            uint64_t bytes;         ///< written, padding included
+            uint64_t writeMicros;   ///< total time in file writes
+            uint32_t lastWriteMicros;
+            uint32_t maxWriteMicros;
+        };
+
         DataLoggerClass();
         virtual ~DataLoggerClass();
         virtual Status setup();
-        virtual Status start();
 
-        uint32_t startFlush, endFlush; // FIXME: temprorary
+        /**
+         * @brief copy of the stats
+         *
+         */
+        Stats getStats() const;
+
+        /**
+         * @brief log records, drops, write latency and throughput
+         *
+         */
+        void logStats();
+
+        /**
+         * @brief list logged flights, oldest first
+         *
+         * @return size_t number of flights filled in
+         */
+        size_t listFlights(LogFlight *out, size_t max);
+
+        /**
+         * @brief read part of a flight's log
+         *
+         * @return size_t bytes read, 0 past the end
+         */
+        size_t readFlight(uint32_t ordinal, size_t offset, uint8_t *out, size_t length);
 
     protected:
         virtual void taskFunction(void *parameter);
+        virtual int taskPriority() const;
 
     private:
-        struct LogItem {
-            enum ItemType : uint8_t {
-                STATUS_ITEM = 0,
-                EVENT_ITEM = 1,
-                INVALID_ITEM = 0xFF
-            } itemType;
-            size_t itemSize;
+        static constexpr uint32_t MAX_BUFFER_AGE_MS = 60 * 1000; // write a partly filled buffer after this long
+        static constexpr size_t PRELAUNCH_SECONDS = 2;
+        static constexpr size_t RING_SIZE = PRELAUNCH_SECONDS * (1600 + 200); // IMU and baro samples
+        static constexpr size_t RING_DRAIN_CHUNK = 64; // entries logged per hold of bufferLock, about 4 IMU batches
+        // events worth a padded block to get onto flash now. Not the apogee prediction: it is published every 250ms
+        // through the coast, while a block takes about 300ms to fill, so each flush would pad away most of a block and
+        // add a write. The apogee itself follows it soon enough.
+        static constexpr uint32_t FLUSH_EVENTS = Event::ALL_EVENT_MASK & ~Event::APOGEE_PREDICTED_EVENT;
+
+        enum Mode {
+            IDLE_MODE,              // events and status only
+            PRELAUNCH_MODE,         // samples go round the ring
+            DRAIN_MODE,             // samples still go round the ring while the task logs it, a chunk at a time
+            FLIGHT_MODE,            // samples are logged
+            LANDED_DRAIN_MODE,      // the flight ended during DRAIN_MODE, no new samples, the task finishes the ring
+        };
+
+        struct RingEntry {
+            LogRecordType type;
             union {
-                Event event;
-                StatusPacket statusPacket;
-            } item;
-            const uint8_t *asBytes() const {
-                return (const u_int8_t*)(&item);
-            }
+                LogIMUSample imu;
+                LogBaroSample baro;
+            };
         };
 
-        static constexpr size_t QUEUE_DEPTH = 8;
-        static constexpr size_t BUFFER_SIZE = 4;
+        LogBuffers buffers;         // under bufferLock, but a full one is the task's until released
+        SemaphoreHandle_t bufferLock;
+        StaticSemaphore_t bufferLockBuffer;
+
+        uint32_t session;           // current session, 0 while disarmed
+        uint32_t sessions;          // since boot
+        uint32_t logId;             // of the current session
+        bool sessionEnding;         // disarmed in LANDED_DRAIN_MODE, the session ends once the ring is logged
+
+        // storage is only touched under storageLock
+        LogStorage *storage;
+        FileLogStorage fileStorage;
+        PartitionLogStorage partitionStorage;
+        uint32_t storageSession;    // session the open flight belongs to, 0 if none
+        uint32_t blockSequence;     // blocks sealed in the open flight
+        SemaphoreHandle_t storageLock;
+        StaticSemaphore_t storageLockBuffer;
 
-        uint8_t queueStorage[QUEUE_DEPTH * sizeof(Event)];
-        QueueHandle_t queue;
-        StaticQueue_t staticQueue;
         uint32_t periodMS;
-        LogItem buffer[BUFFER_SIZE];
-        size_t buffLen;
-        fs::File file;
+        Mode mode;
+        RingEntry *ring;
+        size_t ringHead;            // next entry to write
+        size_t ringCount;
+        bool flushWanted;
+        Stats stats;
+
+        bool append(LogRecordType type, const void *payload, size_t length);
+        bool appendLocked(LogRecordType type, const void *payload, size_t length);
+        void requestFlushLocked();
+        void flush();
+        void writeBuffers();
 
         void setPeriod(uint32_t period);
         uint32_t getPeriod() const;
+        void beginSessionLocked();
+        void endSessionLocked();
+        bool maintainStorage();
+
+        void setModeLocked(Mode newMode);
+        void ringPushLocked(LogRecordType type, const void *sample);
+        size_t ringDrainLocked(size_t max);
+        void drainedLocked();
+        void ringDrain();
+
         void LogEvent(const Event& event);
         void LogStatus(const StatusPacket& status);
+        void LogIMU(const IMUBatch& batch);
+        void LogBaro(const BarometerData& data);
+        void LogGPS(const GPSFix& fix);
         void setPeriodFromEvent(const Event& event);
 };
 
-extern DataLoggerClass DataLogger;
\ No newline at end of file
+extern DataLoggerClass DataLogger;
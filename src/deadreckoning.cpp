@@ -0,0 +1,90 @@
+#include "deadreckoning.h"
+#include <math.h>
+
+DeadReckoning::DeadReckoning() : gravity{0, 0, G}, up{0, 0, 1}, isRunning(false), vel(0), alt(0), vertAcc(0) {
+}
+
+void DeadReckoning::calibrate(float dt, const float acc[3]) {
+    if (isRunning || dt <= 0) {
+        return;
+    }
+    const auto alpha = dt / (calibrationTau + dt);
+    for (auto i = 0; i < 3; i++) {
+        gravity[i] += alpha * (acc[i] - gravity[i]);
+    }
+}
+
+void DeadReckoning::start(float altitude, float velocity) {
+    const auto norm = sqrtf(gravity[0] * gravity[0] + gravity[1] * gravity[1] + gravity[2] * gravity[2]);
+    if (norm > 0) {
+        for (auto i = 0; i < 3; i++) {
+            up[i] = gravity[i] / norm;
+        }
+    }
+    alt = altitude;
+    vel = velocity;
+    vertAcc = 0;
+    isRunning = true;
+}
+
+void DeadReckoning::stop() {
+    isRunning = false;
+}
+
+void DeadReckoning::update(float dt, const float acc[3], const float gyro[3]) {
+    if (!isRunning || dt <= 0) {
+        return;
+    }
+
+    // a vector fixed in the world frame turns the other way in the body frame: du/dt = u x w
+    const float du[3] = {
+        up[1] * gyro[2] - up[2] * gyro[1],
+        up[2] * gyro[0] - up[0] * gyro[2],
+        up[0] * gyro[1] - up[1] * gyro[0],
+    };
+    float norm = 0;
+    for (auto i = 0; i < 3; i++) {
+        up[i] += du[i] * dt;
+        norm += up[i] * up[i];
+    }
+    norm = sqrtf(norm);
+    for (auto i = 0; i < 3; i++) {
+        up[i] /= norm;
+    }
+
+    vertAcc = acc[0] * up[0] + acc[1] * up[1] + acc[2] * up[2] - G;
+    alt += vel * dt + 0.5f * vertAcc * dt * dt;
+    vel += vertAcc * dt;
+}
+
+void DeadReckoning::correct(float altitude, float velocity, float gain) {
+    if (!isRunning) {
+        return;
+    }
+    alt += gain * (altitude - alt);
+    vel += gain * (velocity - vel);
+}
+
+bool DeadReckoning::running() const {
+    return isRunning;
+}
+
+float DeadReckoning::velocity() const {
+    return vel;
+}
+
+float DeadReckoning::altitude() const {
+    return alt;
+}
+
+float DeadReckoning::verticalAcceleration() const {
+    return vertAcc;
+}
+
+float DeadReckoning::axialAcceleration(const float acc[3]) const {
+    const auto norm = sqrtf(gravity[0] * gravity[0] + gravity[1] * gravity[1] + gravity[2] * gravity[2]);
+    if (norm == 0) {
+        return 0;
+    }
+    return (acc[0] * gravity[0] + acc[1] * gravity[1] + acc[2] * gravity[2]) / norm;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Vertical velocity and altitude from the IMU alone
+ *
+ * While on the pad the accelerometer only measures gravity, so its average gives the body frame up axis. From
+ * liftoff the up axis is carried along with the gyro rates, the specific force is projected on it and gravity is
+ * removed to get vertical acceleration, which is integrated into velocity and altitude.
+ *
+ * Integration drifts, so while the baro is trusted the estimate is pulled toward it. While it is not (transonic), the
+ * estimate runs free.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class DeadReckoning {
+    public:
+        DeadReckoning();
+
+        /**
+         * @brief feed an accelerometer sample taken at rest, to learn the up axis
+         *
+         * @param dt seconds since the previous sample
+         * @param acc specific force in m/s^2, body frame
+         */
+        void calibrate(float dt, const float acc[3]);
+
+        /**
+         * @brief start integrating from the given state
+         *
+         * @param altitude starting altitude in m
+         * @param velocity starting vertical velocity in m/s
+         */
+        void start(float altitude, float velocity);
+
+        /**
+         * @brief stop integrating and go back to calibrating
+         *
+         */
+        void stop();
+
+        /**
+         * @brief integrate an IMU sample
+         *
+         * @param dt seconds since the previous sample
+         * @param acc specific force in m/s^2, body frame
+         * @param gyro angular rate in rad/s, body frame
+         */
+        void update(float dt, const float acc[3], const float gyro[3]);
+
+        /**
+         * @brief pull the estimate toward the baro
+         *
+         * @param altitude baro altitude in m
+         * @param velocity baro vertical velocity in m/s
+         * @param gain 0 ignores the baro, 1 replaces the estimate with it
+         */
+        void correct(float altitude, float velocity, float gain);
+
+        bool running() const;
+        float velocity() const;
+        float altitude() const;
+
+        /**
+         * @brief acceleration along the up axis, gravity removed
+         *
+         * @return float m/s^2
+         */
+        float verticalAcceleration() const;
+
+        /**
+         * @brief specific force along the body axis that pointed up on the pad
+         *
+         * @param acc specific force in m/s^2, body frame
+         * @return float m/s^2, positive toward the nose
+         */
+        float axialAcceleration(const float acc[3]) const;
+
+    private:
+        static constexpr float G = 9.8f;
+        static constexpr float calibrationTau = 1.0f; // s, time constant of the gravity average
+
+        float gravity[3]; // average specific force at rest, body frame
+        float up[3]; // unit up axis, body frame
+        bool isRunning;
+        float vel;
+        float alt;
+        float vertAcc;
+};
@@ -48,7 +48,7 @@ void EventManagerClass::taskFunction(void *parameter) {
             rwLock.RLock();
             for (auto i=0; i < numSubscriptions; i++) {
                 auto subscription = &subscriptions[i];
-                if (event.eventType & subscription->mask != 0) {
+                if ((event.eventType & subscription->mask) != 0) {
                     subscription->fn(event, subscription->ctx);
                 }
             }
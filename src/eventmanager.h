@@ -31,7 +31,7 @@ struct Event {
 
     uint32_t timestamp;
     enum EventType : uint32_t {
-        START_EVENT =           0,
+        START_EVENT =           1 << 13, ///< not 0, no subscription mask could match that
         ARM_EVENT =             1 << 0,
         DISARM_EVENT =          1 << 1,
         LIFTOFF_EVENT =         1 << 2,
@@ -44,6 +44,7 @@ struct Event {
         LANDING_EVENT =         1 << 9,
         LOST_ROCKET_EVENT =     1 << 10,
         LOW_BATTERY_EVENT =     1 << 11,
+        APOGEE_PREDICTED_EVENT = 1 << 12, ///< eventArg1 predicted millis() of apogee, eventArg2 confidence percent
 
         ALL_EVENT_MASK =        0xFFFFFFFF
     } eventType;
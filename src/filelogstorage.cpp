@@ -0,0 +1,244 @@
+#include "filelogstorage.h"
+#include "logformat.h"
+#include "configmanager.h"
+#include "log.h"
+#include <stdlib.h>
+
+static constexpr char LOG_DIR[] = "/datalogs";
+static constexpr char RECOVER_PATH[] = "/recover.tmp";     // outside LOG_DIR so it's never taken for a log
+
+FileLogStorage::FileLogStorage() : nextOrdinal(1), openOrdinal(0), evictWanted(true) {
+}
+
+bool FileLogStorage::begin() {
+    LittleFS.mkdir(LOG_DIR);
+    char oldest[MAX_PATH];
+    uint32_t newest;
+    if (scanLogs(oldest, sizeof(oldest), newest) > 0) {
+        nextOrdinal = newest + 1;
+        recover(newest);
+    }
+    return true;
+}
+
+bool FileLogStorage::open(uint32_t epoch) {
+    char path[MAX_PATH];
+    close();
+
+    const auto ordinal = nextOrdinal++;
+    if (epoch != 0) {
+        snprintf(path, sizeof(path), "%s/%05lu-%lu.log", LOG_DIR, (unsigned long)ordinal, (unsigned long)epoch);
+    } else {
+        snprintf(path, sizeof(path), "%s/%05lu.log", LOG_DIR, (unsigned long)ordinal);
+    }
+    file = LittleFS.open(path, "w");
+    if (!file) {
+        Log.errorln("datalogger: could not create %s", path);
+        return false;
+    }
+    openOrdinal = ordinal;
+    Log.noticeln("datalogger: logging to %s", path);
+    return true;
+}
+
+size_t FileLogStorage::write(const uint8_t *data, size_t length, bool) {
+    if (!file) {
+        return 0;
+    }
+    const auto written = file.write(data, length);
+    file.flush();
+    return written;
+}
+
+void FileLogStorage::close() {
+    if (file) {
+        file.close();
+        evictWanted = true;
+    }
+    file = fs::File();
+    openOrdinal = 0;
+}
+
+bool FileLogStorage::maintain(bool, bool armed) {
+    // deleting logs can take a while, and the pad is no place for it
+    if (!armed && !file && evictWanted) {
+        evictWanted = false;
+        evict();
+    }
+    return false;
+}
+
+size_t FileLogStorage::flights(LogFlight *out, size_t max) {
+    size_t count = 0;
+    auto dir = LittleFS.open(LOG_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return 0;
+    }
+    for (auto f = dir.openNextFile(); f && count < max; f = dir.openNextFile()) {
+        const auto name = f.name();
+        char *end;
+        const auto ordinal = strtoul(name, &end, 10);
+        if (end == name || f.isDirectory()) {
+            continue;
+        }
+        LogFlight flight;
+        flight.ordinal = ordinal;
+        flight.epoch = *end == '-' ? strtoul(end + 1, nullptr, 10) : 0;
+        flight.bytes = f.size();
+        flight.open = ordinal == openOrdinal;
+
+        // keep them in order as they come
+        auto i = count++;
+        for (; i > 0 && out[i - 1].ordinal > ordinal; i--) {
+            out[i] = out[i - 1];
+        }
+        out[i] = flight;
+    }
+    return count;
+}
+
+size_t FileLogStorage::read(uint32_t ordinal, size_t offset, uint8_t *out, size_t length) {
+    char path[MAX_PATH];
+    if (!findLog(ordinal, path, sizeof(path))) {
+        return 0;
+    }
+    auto f = LittleFS.open(path, "r");
+    if (!f || !f.seek(offset)) {
+        return 0;
+    }
+    return f.read(out, length);
+}
+
+void FileLogStorage::logStats() {
+    Log.noticeln("datalogger: %luKB of %luKB storage used", (unsigned long)(LittleFS.usedBytes() / 1024),
+        (unsigned long)(LittleFS.totalBytes() / 1024));
+}
+
+/**
+ * @brief find the flight logs with the lowest and highest ordinals
+ *
+ * @param oldestPath filled in with the path of the oldest, if there is one
+ * @param newest highest ordinal
+ * @return size_t number of logs
+ */
+size_t FileLogStorage::scanLogs(char *oldestPath, size_t len, uint32_t &newest) {
+    size_t count = 0;
+    uint32_t oldest = 0;
+    newest = 0;
+
+    auto dir = LittleFS.open(LOG_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return 0;
+    }
+    for (auto f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        const auto name = f.name();
+        char *end;
+        const auto ordinal = strtoul(name, &end, 10);
+        if (end == name || f.isDirectory()) {
+            continue;
+        }
+        if (count == 0 || ordinal < oldest) {
+            oldest = ordinal;
+            snprintf(oldestPath, len, "%s/%s", LOG_DIR, name);
+        }
+        if (ordinal > newest) {
+            newest = ordinal;
+        }
+        count++;
+    }
+    return count;
+}
+
+bool FileLogStorage::findLog(uint32_t ordinal, char *path, size_t len) {
+    auto dir = LittleFS.open(LOG_DIR);
+    if (!dir || !dir.isDirectory()) {
+        return false;
+    }
+    for (auto f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        const auto name = f.name();
+        char *end;
+        if (strtoul(name, &end, 10) == ordinal && end != name) {
+            snprintf(path, len, "%s/%s", LOG_DIR, name);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief cut a log back to its last sealed block
+ *
+ * LittleFS keeps a file as of its last flush, so this only finds anything if the power went in the middle of one.
+ * There is no truncate, so the sealed blocks are copied to a new file that replaces the log.
+ */
+void FileLogStorage::recover(uint32_t ordinal) {
+    char path[MAX_PATH];
+    uint32_t id = 0;
+    size_t sealed = 0;
+    fs::File src, dst;
+    auto block = static_cast<uint8_t*>(malloc(LogFormat::BLOCK_SIZE));
+    if (block == nullptr || !findLog(ordinal, path, sizeof(path))) {
+        goto out;
+    }
+    src = LittleFS.open(path, "r");
+    if (!src) {
+        goto out;
+    }
+    while (src.read(block, LogFormat::BLOCK_SIZE) == LogFormat::BLOCK_SIZE &&
+        (sealed > 0 || logId(block, id)) && logSealed(block, id, sealed)) {
+        sealed++;
+    }
+    if (sealed * LogFormat::BLOCK_SIZE == src.size()) {
+        goto out;
+    }
+
+    Log.noticeln("datalogger: recovering %s, %luKB of %luKB sealed", path,
+        (unsigned long)(sealed * LogFormat::BLOCK_SIZE / 1024), (unsigned long)(src.size() / 1024));
+    dst = LittleFS.open(RECOVER_PATH, "w");
+    if (!dst || !src.seek(0)) {
+        Log.errorln("datalogger: could not recover %s", path);
+        goto out;
+    }
+    for (size_t i = 0; i < sealed; i++) {
+        if (src.read(block, LogFormat::BLOCK_SIZE) != LogFormat::BLOCK_SIZE ||
+            dst.write(block, LogFormat::BLOCK_SIZE) != LogFormat::BLOCK_SIZE) {
+            Log.errorln("datalogger: could not recover %s", path);
+            dst.close();
+            LittleFS.remove(RECOVER_PATH);
+            goto out;
+        }
+    }
+    src.close();
+    dst.close();
+    if (!LittleFS.remove(path) || !LittleFS.rename(RECOVER_PATH, path)) {
+        Log.errorln("datalogger: could not replace %s", path);
+    }
+
+out:
+    free(block);
+}
+
+/**
+ * @brief delete the oldest logs until there is the configured free space, but never the newest
+ *
+ * @note only call while disarmed
+ */
+void FileLogStorage::evict() {
+    uint32_t reserveKB = 0;
+    ConfigManager.readData([](const ConfigData &config, void *p) {
+        *static_cast<uint32_t*>(p) = config.logReserveKB;
+    }, &reserveKB);
+
+    while ((LittleFS.totalBytes() - LittleFS.usedBytes()) / 1024 < reserveKB) {
+        char oldest[MAX_PATH];
+        uint32_t newest;
+        if (scanLogs(oldest, sizeof(oldest), newest) < 2) {
+            break;
+        }
+        Log.noticeln("datalogger: deleting %s to free space", oldest);
+        if (!LittleFS.remove(oldest)) {
+            Log.errorln("datalogger: could not delete %s", oldest);
+            break;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "logstorage.h"
+#include <LittleFS.h>
+
+/**
+ * @brief Flight logs as files in /datalogs on LittleFS
+ *
+ * Files are named by an ordinal that counts up across boots, followed by the GPS epoch if there was a fix, e.g.
+ * 00012-1760000000.log or 00012.log. After a flight is closed, and at boot, the oldest logs are deleted until the free
+ * space is back above the configured reserve. The newest log is never deleted. At boot the newest log is also cut
+ * back to its last sealed block, in case the power went while it was written.
+ *
+ * LittleFS has to be mounted already.
+ *
+ */
+class FileLogStorage : public LogStorage {
+    public:
+        FileLogStorage();
+
+        bool begin();
+        bool open(uint32_t epoch);
+        size_t write(const uint8_t *data, size_t length, bool flying);
+        void close();
+        bool maintain(bool flying, bool armed);
+        size_t flights(LogFlight *out, size_t max);
+        size_t read(uint32_t ordinal, size_t offset, uint8_t *out, size_t length);
+        void logStats();
+
+    private:
+        static constexpr size_t MAX_PATH = 48;
+
+        fs::File file;
+        uint32_t nextOrdinal;
+        uint32_t openOrdinal;       // 0 if none
+        bool evictWanted;
+
+        size_t scanLogs(char *oldestPath, size_t len, uint32_t &newest);
+        bool findLog(uint32_t ordinal, char *path, size_t len);
+        void recover(uint32_t ordinal);
+        void evict();
+};
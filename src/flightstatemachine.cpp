@@ -0,0 +1,130 @@
+#include "flightstatemachine.h"
+#include <math.h>
+
+static constexpr auto FT_PER_METER = 0.3048f;
+static constexpr auto G = 9.8f;
+
+static constexpr auto liftOffAltThresh = 100 * FT_PER_METER; // threshold to detect liftoff
+static constexpr uint32_t liftOffDwellMS = 100; // how long we must be going up before liftoff
+static constexpr auto vertVelThresh = 100 * FT_PER_METER; // threshold to stablish boost
+
+static constexpr auto chuteVelThresh = 200 * FT_PER_METER; // threshold of under chute/lawn dart
+static constexpr auto chuteAccThresh = 3.0f; // threshold of under chute/lawn dart
+
+static constexpr uint32_t apogeeDwellMS = 1000; // how long we must be below max altitude
+static constexpr uint32_t lostThresholdMS = 2*3600*1000UL; // how long before your rocket is "lost"
+static constexpr auto lowBatteryVolts = 6.4f; // 2S lipo at 3.2V/cell
+
+static bool liftoffGuard(const FlightSnapshot &s, uint32_t) {
+      //   GPS and barometer agree that we've ascended at least 100' and we've been "going up"
+      //   according to baro and accelerometers for at least 100ms
+      const auto goingUp = s.goingUpSince != 0 && s.time - s.goingUpSince > liftOffDwellMS;
+      return goingUp && s.gpsAGL > liftOffAltThresh && s.agl > liftOffAltThresh;
+}
+
+static bool burnoutGuard(const FlightSnapshot &s, uint32_t) {
+      return !s.thrusting && s.vertVel > vertVelThresh;
+}
+
+static bool airstartGuard(const FlightSnapshot &s, uint32_t) {
+      return s.thrusting && s.vertVel > vertVelThresh;
+}
+
+static bool apogeeGuard(const FlightSnapshot &s, uint32_t) {
+      return !s.machLockout && s.agl < s.maxAGL && s.time - s.maxAGLTime > apogeeDwellMS;
+}
+
+static bool underChuteGuard(const FlightSnapshot &s, uint32_t) {
+      return -s.vertVel < chuteVelThresh && fabsf(s.vertAcc) < chuteAccThresh;
+}
+
+static bool lawnDartGuard(const FlightSnapshot &s, uint32_t) {
+      return -s.vertVel > chuteVelThresh && fabsf(s.vertAcc) > chuteAccThresh;
+}
+
+static bool touchdownGuard(const FlightSnapshot &s, uint32_t) {
+      // at rest the accelerometer reads 1G plus noise and bias, so the old last_acc < G only held about half the time
+      // on the ground, and never with a positive bias. Allow the same 1m/s^2 as the other two terms.
+      return fabsf(s.vertVel) < 1 && fabsf(s.vertAcc) < 1 && s.accMag < G + 1;
+}
+
+static bool lostGuard(const FlightSnapshot &, uint32_t msInState) {
+      return msInState > lostThresholdMS;
+}
+
+static bool powerFailGuard(const FlightSnapshot &s, uint32_t) {
+      return s.batteryVolts > 0 && s.batteryVolts < lowBatteryVolts;
+}
+
+// rows for a state are evaluated in order, the first guard that passes wins
+static const FlightStateMachine::Transition transitions[] = {
+      {FlightStateMachine::ARMED,         liftoffGuard,       FlightStateMachine::BOOST,          FlightStateMachine::LIFTOFF_SIGNAL},
+      {FlightStateMachine::BOOST,         burnoutGuard,       FlightStateMachine::COAST,          FlightStateMachine::BURNOUT_SIGNAL},
+      {FlightStateMachine::COAST,         airstartGuard,      FlightStateMachine::BOOST,          FlightStateMachine::AIRSTART_SIGNAL},
+      {FlightStateMachine::COAST,         apogeeGuard,        FlightStateMachine::APOGEE,         FlightStateMachine::APOGEE_SIGNAL},
+      {FlightStateMachine::APOGEE,        underChuteGuard,    FlightStateMachine::UNDER_CHUTE,    FlightStateMachine::NO_SIGNAL},
+      {FlightStateMachine::APOGEE,        lawnDartGuard,      FlightStateMachine::LAWN_DART,      FlightStateMachine::LAWN_DART_SIGNAL},
+      {FlightStateMachine::LAWN_DART,     underChuteGuard,    FlightStateMachine::UNDER_CHUTE,    FlightStateMachine::NO_SIGNAL},
+      {FlightStateMachine::LAWN_DART,     touchdownGuard,     FlightStateMachine::TOUCHDOWN,      FlightStateMachine::LANDING_SIGNAL},
+      {FlightStateMachine::UNDER_CHUTE,   touchdownGuard,     FlightStateMachine::TOUCHDOWN,      FlightStateMachine::LANDING_SIGNAL},
+      {FlightStateMachine::TOUCHDOWN,     lostGuard,          FlightStateMachine::LOST,           FlightStateMachine::LOST_ROCKET_SIGNAL},
+      {FlightStateMachine::TOUCHDOWN,     powerFailGuard,     FlightStateMachine::POWER_FAIL,     FlightStateMachine::LOW_BATTERY_SIGNAL},
+      {FlightStateMachine::LOST,          powerFailGuard,     FlightStateMachine::POWER_FAIL,     FlightStateMachine::LOW_BATTERY_SIGNAL},
+};
+static constexpr size_t numTransitions = sizeof(transitions) / sizeof(transitions[0]);
+
+FlightStateMachine::FlightStateMachine() : current(INIT), stateEntered(0), index{}, traceHead(0), traceCount(0) {
+      // build the per state index, the table is grouped by from state
+      for (size_t i = 0; i < numTransitions; i++) {
+            auto &range = index[transitions[i].from];
+            if (range.count == 0) {
+                  range.first = i;
+            }
+            range.count++;
+      }
+}
+
+void FlightStateMachine::reset(State newState, uint32_t time) {
+      if (newState != current) {
+            record(time, current, newState);
+      }
+      current = newState;
+      stateEntered = time;
+}
+
+const FlightStateMachine::Transition *FlightStateMachine::step(const FlightSnapshot &snapshot) {
+      const auto &range = index[current];
+      const auto msInState = snapshot.time - stateEntered;
+
+      for (auto i = range.first; i < range.first + range.count; i++) {
+            const auto transition = &transitions[i];
+            if (transition->guard(snapshot, msInState)) {
+                  record(snapshot.time, current, transition->to);
+                  current = transition->to;
+                  stateEntered = snapshot.time;
+                  return transition;
+            }
+      }
+      return nullptr;
+}
+
+FlightStateMachine::State FlightStateMachine::state() const {
+      return current;
+}
+
+size_t FlightStateMachine::traceLength() const {
+      return traceCount;
+}
+
+const FlightStateMachine::TraceEntry &FlightStateMachine::trace(size_t i) const {
+      const auto oldest = (traceHead + TRACE_SIZE - traceCount) % TRACE_SIZE;
+      return traceEntries[(oldest + i) % TRACE_SIZE];
+}
+
+void FlightStateMachine::record(uint32_t time, State from, State to) {
+      traceEntries[traceHead] = TraceEntry{time, from, to};
+      traceHead = (traceHead + 1) % TRACE_SIZE;
+      if (traceCount < TRACE_SIZE) {
+            traceCount++;
+      }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Estimator output that the flight state machine decides on
+ *
+ * Plain data, so it can be filled from live sensors by StateManager or from a replayed log on the host.
+ *
+ */
+struct FlightSnapshot {
+    uint32_t time;          ///< ms timestamp of this snapshot
+    float agl;              ///< altitude above ground, m: fused baro and gps, blended with dead reckoning under mach lockout
+    float maxAGL;           ///< highest agl since arming, m
+    uint32_t maxAGLTime;    ///< time maxAGL was recorded, ms
+    float gpsAGL;           ///< filtered gps altitude above ground, m
+    float vertVel;          ///< vertical velocity, m/s, positive up, blended like agl
+    float vertAcc;          ///< vertical acceleration, m/s^2, positive up
+    float accMag;           ///< filtered magnitude of measured acceleration, m/s^2
+    float batteryVolts;     ///< battery voltage, 0 if not measured yet
+    uint32_t goingUpSince;  ///< time baro and accelerometer started agreeing we are going up, 0 if not
+    bool thrusting;         ///< a motor is burning, from the staging detector
+    bool machLockout;       ///< baro is untrusted (transonic)
+};
+
+/**
+ * @brief Table driven flight state machine
+ *
+ * Each transition is a row of (from, guard, to, signal). Guards are pure functions of a FlightSnapshot and the time
+ * spent in the current state. The rows for a state are indexed at construction, so a step only evaluates the guards
+ * leaving the current state. The machine has no side effects: the caller acts on the returned transition, which
+ * makes it usable both in flight and for replaying recorded or simulated flights on the host.
+ *
+ */
+class FlightStateMachine {
+    public:
+        /**
+         * @brief flight states, in the same order as Packet::State
+         *
+         */
+        enum State : uint8_t {
+            INIT,
+            DISARMED,
+            ARMED,
+            BOOST,
+            COAST,
+            APOGEE,
+            UNDER_CHUTE,
+            LAWN_DART,
+            TOUCHDOWN,
+            LOST,
+            POWER_FAIL,
+            UNKNOWN,
+            NUM_STATES
+        };
+
+        /**
+         * @brief what a transition means to the rest of the system
+         *
+         */
+        enum Signal : uint8_t {
+            NO_SIGNAL,
+            LIFTOFF_SIGNAL,
+            BURNOUT_SIGNAL,
+            AIRSTART_SIGNAL,
+            APOGEE_SIGNAL,
+            LAWN_DART_SIGNAL,
+            LANDING_SIGNAL,
+            LOST_ROCKET_SIGNAL,
+            LOW_BATTERY_SIGNAL
+        };
+
+        typedef bool(Guard)(const FlightSnapshot &snapshot, uint32_t msInState);
+
+        struct Transition {
+            State from;
+            Guard *guard;
+            State to;
+            Signal signal;
+        };
+
+        struct TraceEntry {
+            uint32_t time;
+            State from;
+            State to;
+        };
+
+        static constexpr size_t TRACE_SIZE = 16;
+
+        FlightStateMachine();
+
+        /**
+         * @brief force the machine into a state, used for arming and disarming
+         *
+         * @param newState the state to enter
+         * @param time ms timestamp of entering it
+         */
+        void reset(State newState, uint32_t time);
+
+        /**
+         * @brief evaluate the transitions leaving the current state
+         *
+         * @param snapshot current estimate
+         * @return const Transition* the transition taken, or nullptr if none
+         */
+        const Transition *step(const FlightSnapshot &snapshot);
+
+        /**
+         * @brief get the current state
+         *
+         * @return State
+         */
+        State state() const;
+
+        /**
+         * @brief number of entries in the transition trace
+         *
+         * @return size_t up to TRACE_SIZE
+         */
+        size_t traceLength() const;
+
+        /**
+         * @brief get an entry of the transition trace
+         *
+         * @param i index, 0 is the oldest retained transition
+         * @return const TraceEntry&
+         */
+        const TraceEntry &trace(size_t i) const;
+
+    private:
+        struct Range {
+            uint8_t first;
+            uint8_t count;
+        };
+
+        State current;
+        uint32_t stateEntered;
+        Range index[NUM_STATES];
+
+        TraceEntry traceEntries[TRACE_SIZE];
+        size_t traceHead;
+        size_t traceCount;
+
+        void record(uint32_t time, State from, State to);
+};
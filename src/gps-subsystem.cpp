@@ -5,7 +5,14 @@
 
 GPSSubsystemClass GPSSubsystem;
 
-GPSSubsystemClass::GPSSubsystemClass() : DataProvider<GPSFix>(rwLock), gpsLoopMillis(0), positioningMillis(0), noFixYet(true) {
+// a moving receiver never repeats altitude and velocity to the mm, a stationary one can for a few epochs
+static constexpr SensorHealth::Limits LIMITS = {2000000, 50, 0, 0};
+
+GPSSubsystemClass::GPSSubsystemClass() : DataProvider<GPSFix>(rwLock), device(NULL), health(LIMITS), fixMillis(0), noFixYet(true)
+#ifdef GPS_BENCHMARK
+    , busMicros(0), maxBusMicros(0), ticks(0)
+#endif
+{
     name = "GPS";
     static BaseSubsystem* deps[] = {&StatusManager, &LogWriter, NULL};
     static SubsystemManagerClass::Spec spec(this, deps);
@@ -19,19 +26,40 @@ GPSSubsystemClass::~GPSSubsystemClass() {
 BaseSubsystem::Status GPSSubsystemClass::setup() {
     setStatus(BaseSubsystem::FAULT);
 
-    Wire.begin(I2C_SDA, I2C_SCL);
-    if (!gps.begin()) {
+    I2CBus.begin(I2C_SDA, I2C_SCL);
+    device = I2CBus.addDevice("GPS", 0x42, 400000, I2CBusClass::LOW_PRIORITY);
+    if (device == NULL || !I2CBus.acquire(device)) {
+        goto out;
+    }
+    if (!gps.begin(I2CBus.wire())) {
         Log.errorln("GPS did not enumerate");
         goto out;
     }
+    // UBX only on I2C, NMEA would just be more bytes to drain every tick
+#ifdef GPS_SPEW
+    if (!gps.setI2COutput(COM_TYPE_UBX | COM_TYPE_NMEA)) {
+#else
+    if (!gps.setI2COutput(COM_TYPE_UBX)) {
+#endif
+        Log.errorln("Couldn't set gps I2C output");
+        goto out;
+    }
     if (!gps.setMeasurementRate(100)) {
         Log.errorln("Couldn't set gps rate to 10hz");
         goto out;
     }
+    // the receiver pushes a NAV-PVT every epoch, tick just drains it
+    if (!gps.setAutoPVT(true)) {
+        Log.errorln("Couldn't enable gps auto PVT");
+        goto out;
+    }
     gps.setI2CpollingWait(25);
     setStatus(BaseSubsystem::READY);
 
 out:
+    if (device != NULL) {
+        I2CBus.release(device);
+    }
     return getStatus();
 }
 
@@ -42,15 +70,71 @@ GPSFix GPSSubsystemClass::getFix() const {
     return ret;
 }
 
+// days since 1970-01-01 of a civil date, Howard Hinnant's algorithm
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = y - era * 400;
+    const uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int32_t>(doe) - 719468;
+}
+
+void GPSSubsystemClass::parsePVT(const UBX_NAV_PVT_data_t &pvt) {
+    data.fixType = pvt.fixType;
+    data.latitude = pvt.lat;
+    data.longitude = pvt.lon;
+    data.altitude = pvt.hMSL;
+    data.sats = pvt.numSV;
+    data.hAcc = pvt.hAcc;
+    data.vAcc = pvt.vAcc;
+    data.velN = pvt.velN;
+    data.velE = pvt.velE;
+    data.velD = pvt.velD;
+    data.sAcc = pvt.sAcc;
+
+    // nano is signed, the second can be rounded up
+    int32_t nano = pvt.nano;
+    int32_t sec = pvt.sec;
+    if (nano < 0) {
+        nano += 1000000000;
+        sec--;
+    }
+    data.epoch = daysFromCivil(pvt.year, pvt.month, pvt.day) * 86400 + pvt.hour * 3600 + pvt.min * 60 + sec;
+    fixMillis = nano / 1000000;
+}
+
 BaseSubsystem::Status GPSSubsystemClass::tick() {
-    rwLock.Lock();
+#ifdef GPS_BENCHMARK
+    const auto start = micros();
+#endif
+    // non-blocking with auto PVT, true only when a new epoch was parsed. It reads everything the receiver has
+    // buffered, not one message, so a backlog (or NMEA with GPS_SPEW) is all drained in this tick
+    if (!I2CBus.acquire(device)) {
+        return getStatus();
+    }
+    const auto fresh = gps.getPVT();
+    const auto now = timestampUS();
+    I2CBus.release(device);
+#ifdef GPS_BENCHMARK
+    const auto elapsed = micros() - start;
+    busMicros += elapsed;
+    if (elapsed > maxBusMicros) {
+        maxBusMicros = elapsed;
+    }
+    if (++ticks == 100) {
+        Log.noticeln("GPS bus time per tick: avg %luus max %luus", busMicros / ticks, maxBusMicros);
+        busMicros = maxBusMicros = ticks = 0;
+    }
+#endif
+    updateHealth(fresh, now);
+    if (!fresh) {
+        return getStatus();
+    }
 
-    data.fixType = gps.getFixType();
-    data.latitude = gps.getLatitude();
-    data.longitude = gps.getLongitude();
-    data.altitude = gps.getAltitudeMSL();
-    data.epoch = gps.getUnixEpoch();
-    data.sats = gps.getSIV();
+    rwLock.Lock();
+    parsePVT(gps.packetUBXNAVPVT->data);
+    data.time = now;
 
     // If this is the first fix, and we've never had a fix- set the time
     if (data.fixType > 1 && noFixYet) {
@@ -64,9 +148,30 @@ BaseSubsystem::Status GPSSubsystemClass::tick() {
     return getStatus();
 }
 
+void GPSSubsystemClass::updateHealth(bool fresh, uint64_t now) {
+    if (fresh) {
+        const auto &pvt = gps.packetUBXNAVPVT->data;
+        const float values[] = {
+            static_cast<float>(pvt.hMSL),
+            static_cast<float>(pvt.velN),
+            static_cast<float>(pvt.velE),
+            static_cast<float>(pvt.velD)
+        };
+        health.update(now, values, 4);
+    }
+    health.check(now);
+    if (health.healthChanged()) {
+        StatusManager.setBoolStatusFlag(health.healthy(), Packet::GPS_STATUS);
+    }
+}
+
 bool GPSSubsystemClass::lowPowerMode() {
     setRTC();
+    if (!I2CBus.acquire(device)) {
+        return false;
+    }
     auto ret = gps.powerSaveMode();
+    I2CBus.release(device);
     if (ret) {
         setStatus(STOPPED);
     }
@@ -75,10 +180,9 @@ bool GPSSubsystemClass::lowPowerMode() {
 
 void GPSSubsystemClass::setRTC() {
     if (data.fixType > 1) {
-        auto milliseconds = gps.getMillisecond();
         struct timeval tv = {
             .tv_sec = static_cast<time_t>(data.epoch), // squash warning about narrowing uint32 to int32
-            .tv_usec = milliseconds*1000
+            .tv_usec = fixMillis*1000
         };
         settimeofday(&tv, NULL);
         Log.infoln("Setting time at %d.%ld", tv.tv_sec, tv.tv_usec);
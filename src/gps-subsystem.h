@@ -3,11 +3,24 @@
 #include "subsystem.h"
 #include <SparkFun_u-blox_GNSS_Arduino_Library.h>
 #include <packet.h>
+#include "i2cbus.h"
+#include "timebase.h"
+#include "sensorhealth.h"
 
 
 //uncomment to make NMEA sentences appear in serial log
 //#define GPS_SPEW
 
+//uncomment to log how long each tick spends on the I2C bus
+//
+// Not measured on a board yet, these are wire times at 400kHz, 22.5us per byte with its ack:
+//   auto PVT, no new epoch: bytes available check, 2 byte write and 3 byte read        ~0.15ms
+//   auto PVT, new epoch: the check plus 100 bytes of NAV-PVT in 32 byte reads          ~2.5ms
+//   per-field polling (before auto PVT): an 8 byte poll, the same 100 bytes, and however long the receiver takes to
+//   answer, which the first getter of each tick blocked for
+// Replace them with the avg/max this logs once it has been run on hardware.
+//#define GPS_BENCHMARK
+
 class GPSSubsystemClass : public TickableSubsystem, public DataProvider<GPSFix> {
     public:
         GPSSubsystemClass();
@@ -22,11 +35,19 @@ class GPSSubsystemClass : public TickableSubsystem, public DataProvider<GPSFix>
 
     private:
         SFE_UBLOX_GNSS gps;
-        uint32_t gpsLoopMillis;
-        uint32_t positioningMillis;
+        I2CBusClass::Device device;
+        SensorHealth health;
+        uint16_t fixMillis; // ms part of epoch
         bool noFixYet;
+#ifdef GPS_BENCHMARK
+        uint32_t busMicros;
+        uint32_t maxBusMicros;
+        uint32_t ticks;
+#endif
 
+        void parsePVT(const UBX_NAV_PVT_data_t &pvt);
         void setRTC();
+        void updateHealth(bool fresh, uint64_t now);
 };
 
 extern GPSSubsystemClass GPSSubsystem;
\ No newline at end of file
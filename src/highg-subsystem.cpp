@@ -0,0 +1,147 @@
+#include "highg-subsystem.h"
+#include "pins.h"
+#include "log.h"
+#include "statusmanager.h"
+
+HighGSubsystemClass HighGSubsystem;
+
+static constexpr uint8_t DEVID =            0x00;
+static constexpr uint8_t BW_RATE =          0x2C;
+static constexpr uint8_t POWER_CTL =        0x2D;
+static constexpr uint8_t DATA_FORMAT =      0x31;
+static constexpr uint8_t DATAX0 =           0x32;
+static constexpr uint8_t FIFO_CTL =         0x38;
+static constexpr uint8_t FIFO_STATUS =      0x39;
+
+static constexpr uint8_t DEVID_VALUE =      0xE5;
+static constexpr uint8_t RATE_800HZ =       0x0D;
+static constexpr uint8_t MEASURE =          0x08;
+static constexpr uint8_t FORMAT =           0x0B; // 4 wire SPI, right justified, reserved bits set
+static constexpr uint8_t FIFO_STREAM =      0x80;
+
+static constexpr uint8_t SPI_READ =         0x80;
+static constexpr uint8_t SPI_MULTIBYTE =    0x40;
+static constexpr int SPI_CLOCK =            5000000;
+static constexpr uint8_t SPI_MODE =         3;
+
+static constexpr float SCALE = 0.049f * 9.80665f; // m/s^2 per LSB
+
+// 13 bit samples, the rail is just inside +-200g
+static constexpr SensorHealth::Limits LIMITS = {250000, 50, 4090 * SCALE, 0};
+
+// board axes to BMI088 axes, the parts are mounted in the same orientation
+static constexpr int axisMap[3] = {0, 1, 2};
+static constexpr float axisSign[3] = {1, 1, 1};
+
+HighGSubsystemClass::HighGSubsystemClass() : DataProvider<HighGBatch>(rwLock), device(NULL), fitted(false), health(LIMITS) {
+    name = "high-g";
+    static BaseSubsystem* deps[] = {&StatusManager, &LogWriter, NULL};
+    static SubsystemManagerClass::Spec spec(this, deps);
+    SubsystemManager.addSubsystem(&spec);
+    data.count = 0;
+    data.faults = 0;
+    data.periodUS = periodUS;
+}
+
+HighGSubsystemClass::~HighGSubsystemClass() {
+}
+
+BaseSubsystem::Status HighGSubsystemClass::setup() {
+    alignas(4) uint8_t id[4] = {};
+
+    setStatus(BaseSubsystem::FAULT);
+
+    if (!SPIBus.begin(SPI_SCK, SPI_MISO, SPI_MOSI)) {
+        goto out;
+    }
+    device = SPIBus.addDevice(HIG_CS, SPI_CLOCK, SPI_MODE, HighGBatch::MAX_FRAMES + 1);
+    if (device == NULL) {
+        goto out;
+    }
+
+    // the part is optional, without it IMU fusion passes the BMI088 through, so don't hold up arming
+    SPIBus.readRegisters(device, DEVID, id, 1);
+    if (id[0] != DEVID_VALUE) {
+        Log.noticeln("high-g not fitted, device id: %x", id[0]);
+        setStatus(BaseSubsystem::STOPPED);
+        goto out;
+    }
+    fitted = true;
+
+    SPIBus.writeRegister(device, DATA_FORMAT, FORMAT);
+    SPIBus.writeRegister(device, BW_RATE, RATE_800HZ);
+    SPIBus.writeRegister(device, FIFO_CTL, FIFO_STREAM);
+    SPIBus.writeRegister(device, POWER_CTL, MEASURE);
+
+    setStatus(BaseSubsystem::READY);
+out:
+    return getStatus();
+}
+
+BaseSubsystem::Status HighGSubsystemClass::start() {
+    // stays stopped if it isn't there, the ticker restarts its subsystems after low power
+    if (!fitted) {
+        return getStatus();
+    }
+    return TickableSubsystem::start();
+}
+
+BaseSubsystem::Status HighGSubsystemClass::tick() {
+    size_t entries;
+    size_t queued = 0;
+    uint64_t now = 0;
+
+    rwLock.Lock();
+
+    if (!SPIBus.readRegisters(device, FIFO_STATUS, fifoStatus, 1)) {
+        setStatus(BaseSubsystem::FAULT);
+        goto out;
+    }
+    // the newest entry is the one just counted
+    now = timestampUS();
+    entries = fifoStatus[0] & 0x3F;
+    if (entries > HighGBatch::MAX_FRAMES) {
+        entries = HighGBatch::MAX_FRAMES;
+    }
+
+    // each entry pops the FIFO when its chip select ends, queue them all and wait once
+    for (size_t i = 0; i < entries; i++) {
+        auto &t = entryReads[i];
+        t = {};
+        t.address = DATAX0 | SPI_READ | SPI_MULTIBYTE;
+        t.rx = entryBytes[i];
+        t.length = 6;
+        if (!SPIBus.queue(device, t)) {
+            break;
+        }
+        queued++;
+    }
+    for (size_t i = 0; i < queued; i++) {
+        SPIBus.wait(device);
+    }
+
+    for (size_t i = 0; i < queued; i++) {
+        const auto raw = entryBytes[i];
+        for (auto axis = 0; axis < 3; axis++) {
+            const int16_t value = raw[axis * 2] | (raw[axis * 2 + 1] << 8);
+            data.acc[i][axisMap[axis]] = axisSign[axis] * value * SCALE;
+        }
+        health.update(now - (queued - 1 - i) * periodUS, data.acc[i], 3);
+    }
+    data.count = queued;
+    data.time = now;
+
+out:
+    health.check(timestampUS());
+    data.faults = health.faults();
+    const auto healthChanged = health.healthChanged();
+    const auto healthy = health.healthy();
+    rwLock.UnLock();
+
+    if (healthChanged) {
+        StatusManager.setBoolStatusFlag(healthy, Packet::HIGH_G_STATUS);
+    }
+
+    callCallbacks();
+    return getStatus();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <subsystem.h>
+#include "spibus.h"
+#include "timebase.h"
+#include "sensorhealth.h"
+
+/**
+ * @brief every high-g frame buffered since the last tick, oldest first
+ *
+ */
+struct HighGBatch {
+    static constexpr size_t MAX_FRAMES = 32; // FIFO depth
+
+    uint64_t time; // timestampUS() of the newest frame
+    uint32_t periodUS; // time between frames
+    size_t count;
+    uint8_t faults; // SensorHealth::Fault of the stream, 0 if healthy
+    float acc[MAX_FRAMES][3]; // m/s^2, BMI088 axes
+};
+
+/**
+ * @brief ADXL375 +-200g accelerometer on HIG_CS
+ *
+ * Runs at 800Hz into its 32 entry FIFO in stream mode. The FIFO can only be read one entry per chip select, so each
+ * tick queues one transaction per entry on the SPI bus and waits once for all of them.
+ *
+ * Boards without one fitted leave it STOPPED rather than FAULT, so they can still arm.
+ *
+ */
+class HighGSubsystemClass : public TickableSubsystem, public DataProvider<HighGBatch> {
+public:
+    HighGSubsystemClass();
+    virtual ~HighGSubsystemClass();
+
+    BaseSubsystem::Status setup();
+    BaseSubsystem::Status start();
+    BaseSubsystem::Status tick();
+
+private:
+    static constexpr uint32_t periodUS = 1250; // 800Hz
+
+    SPIBusClass::Device device;
+    bool fitted; // answered with the right device id
+    SensorHealth health;
+
+    SPITransaction entryReads[HighGBatch::MAX_FRAMES];
+    alignas(4) uint8_t entryBytes[HighGBatch::MAX_FRAMES][8];
+    alignas(4) uint8_t fifoStatus[4];
+};
+
+extern HighGSubsystemClass HighGSubsystem;
@@ -0,0 +1,233 @@
+#include "i2cbus.h"
+#include "log.h"
+
+I2CBusClass I2CBus;
+
+I2CBusClass::I2CBusClass() : initialized(false), devices{}, numDevices(0), owner(NULL), held{}, depth(0),
+    acquiredMicros(0), chargedMicros(0), currentClock(0), waiters{}, numWaiters(0) {
+    stateLock = xSemaphoreCreateMutexStatic(&stateLockBuffer);
+}
+
+bool I2CBusClass::begin(int sda, int scl) {
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    if (!initialized) {
+        initialized = Wire.begin(sda, scl);
+        if (!initialized) {
+            Log.errorln("i2c bus init failed");
+        }
+    }
+    const auto ret = initialized;
+    xSemaphoreGive(stateLock);
+    return ret;
+}
+
+I2CBusClass::Device I2CBusClass::addDevice(const char *name, uint8_t address, uint32_t clockHz, uint8_t priority) {
+    Device device = NULL;
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    if (numDevices < maxDevices) {
+        device = &devices[numDevices++];
+        device->name = name;
+        device->address = address;
+        device->clockHz = clockHz;
+        device->priority = priority;
+    } else {
+        Log.errorln("i2c bus full, can't add %s", name);
+    }
+    xSemaphoreGive(stateLock);
+    return device;
+}
+
+bool I2CBusClass::acquire(Device device, TickType_t timeout) {
+    const auto self = xTaskGetCurrentTaskHandle();
+    const auto start = micros();
+
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    if (owner == self) {
+        if (depth == maxDepth) {
+            xSemaphoreGive(stateLock);
+            return false;
+        }
+        // from here the bus time is the nested device's
+        chargeHeld(micros());
+        held[depth++] = device;
+        setClock(device);
+        xSemaphoreGive(stateLock);
+        return true;
+    }
+    if (owner == NULL) {
+        owner = self;
+    } else {
+        if (numWaiters == maxWaiters) {
+            xSemaphoreGive(stateLock);
+            return false;
+        }
+        waiters[numWaiters++] = {self, device};
+        xSemaphoreGive(stateLock);
+
+        // release() makes us the owner before it notifies
+        ulTaskNotifyTake(pdTRUE, timeout);
+
+        xSemaphoreTake(stateLock, portMAX_DELAY);
+        if (owner != self) {
+            for (size_t i = 0; i < numWaiters; i++) {
+                if (waiters[i].task == self) {
+                    waiters[i] = waiters[--numWaiters];
+                    break;
+                }
+            }
+            xSemaphoreGive(stateLock);
+            return false;
+        }
+        // handed over just as we timed out, drop the notification so the next wait doesn't return early
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+    depth = 1;
+    held[0] = device;
+    xSemaphoreGive(stateLock);
+
+    const auto waited = micros() - start;
+    if (waited > device->maxWaitMicros) {
+        device->maxWaitMicros = waited;
+    }
+    setClock(device);
+    acquiredMicros = chargedMicros = micros();
+    return true;
+}
+
+void I2CBusClass::setClock(Device device) {
+    if (device->clockHz != currentClock) {
+        Wire.setClock(device->clockHz);
+        currentClock = device->clockHz;
+    }
+}
+
+void I2CBusClass::chargeHeld(uint32_t now) {
+    held[depth - 1]->busMicros += now - chargedMicros;
+    chargedMicros = now;
+}
+
+void I2CBusClass::release(Device device) {
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    if (owner != xTaskGetCurrentTaskHandle() || depth == 0) {
+        xSemaphoreGive(stateLock);
+        return;
+    }
+
+    const auto now = micros();
+    chargeHeld(now);
+    if (--depth > 0) {
+        // back to the enclosing device
+        setClock(held[depth - 1]);
+        xSemaphoreGive(stateLock);
+        return;
+    }
+
+    const auto hold = now - acquiredMicros;
+    if (hold > held[0]->maxHoldMicros) {
+        held[0]->maxHoldMicros = hold;
+    }
+
+    // highest priority waiter next, first come first served among equals
+    owner = NULL;
+    held[0] = NULL;
+    if (numWaiters > 0) {
+        size_t next = 0;
+        for (size_t i = 1; i < numWaiters; i++) {
+            if (waiters[i].device->priority > waiters[next].device->priority) {
+                next = i;
+            }
+        }
+        owner = waiters[next].task;
+        for (size_t i = next + 1; i < numWaiters; i++) {
+            waiters[i - 1] = waiters[i];
+        }
+        numWaiters--;
+        xTaskNotifyGive(owner);
+    }
+    xSemaphoreGive(stateLock);
+}
+
+TwoWire &I2CBusClass::wire() {
+    return Wire;
+}
+
+bool I2CBusClass::countResult(Device device, bool ok) {
+    device->transactions++;
+    if (!ok) {
+        device->errors++;
+    }
+    return ok;
+}
+
+bool I2CBusClass::write(Device device, const uint8_t *buf, size_t len) {
+    if (!acquire(device)) {
+        return false;
+    }
+    Wire.beginTransmission(device->address);
+    Wire.write(buf, len);
+    const auto ok = Wire.endTransmission() == 0;
+    release(device);
+    return countResult(device, ok);
+}
+
+bool I2CBusClass::read(Device device, uint8_t *buf, size_t len) {
+    if (!acquire(device)) {
+        return false;
+    }
+    auto ok = Wire.requestFrom(device->address, len) == len;
+    for (size_t i = 0; ok && i < len; i++) {
+        buf[i] = Wire.read();
+    }
+    release(device);
+    return countResult(device, ok);
+}
+
+bool I2CBusClass::writeRegister(Device device, uint8_t reg, uint8_t value) {
+    const uint8_t buf[] = {reg, value};
+    return write(device, buf, sizeof(buf));
+}
+
+bool I2CBusClass::readRegisters(Device device, uint8_t reg, uint8_t *buf, size_t len) {
+    if (!acquire(device)) {
+        return false;
+    }
+    Wire.beginTransmission(device->address);
+    Wire.write(reg);
+    auto ok = Wire.endTransmission(false) == 0; // repeated start
+    ok = ok && Wire.requestFrom(device->address, len) == len;
+    for (size_t i = 0; ok && i < len; i++) {
+        buf[i] = Wire.read();
+    }
+    release(device);
+    return countResult(device, ok);
+}
+
+bool I2CBusClass::readBatch(Device device, const Read *reads, size_t count) {
+    if (!acquire(device)) {
+        return false;
+    }
+    auto ok = true;
+    for (size_t i = 0; ok && i < count; i++) {
+        Wire.beginTransmission(device->address);
+        Wire.write(reads[i].reg);
+        ok = Wire.endTransmission() == 0;
+        ok = ok && Wire.requestFrom(device->address, reads[i].length) == reads[i].length;
+        for (size_t k = 0; ok && k < reads[i].length; k++) {
+            reads[i].buf[k] = Wire.read();
+        }
+        countResult(device, ok);
+    }
+    release(device);
+    return ok;
+}
+
+void I2CBusClass::logStats() {
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    for (size_t i = 0; i < numDevices; i++) {
+        const auto &d = devices[i];
+        // the logger has no 64 bit format, ms fits 32 bits for 49 days
+        Log.noticeln("i2c %s: %lu transactions %lu errors, %lums on bus, longest hold %luus, longest wait %luus",
+            d.name, d.transactions, d.errors, (unsigned long)(d.busMicros / 1000), d.maxHoldMicros, d.maxWaitMicros);
+    }
+    xSemaphoreGive(stateLock);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+/**
+ * @brief a chip on the I2C bus and what it has cost the bus
+ *
+ */
+struct I2CDevice {
+    const char *name;
+    uint8_t address;
+    uint32_t clockHz;
+    uint8_t priority;       ///< higher gets the bus first when several tasks wait
+
+    uint64_t busMicros;     ///< total time holding the bus, not counting time a nested device held it
+    uint32_t maxHoldMicros; ///< longest single hold
+    uint32_t maxWaitMicros; ///< longest wait for the bus
+    uint32_t transactions;
+    uint32_t errors;
+};
+
+/**
+ * @brief Owns Wire and hands it to one task at a time
+ *
+ * A task acquires the bus for a device, does any number of transfers, and releases it. While the bus is held other
+ * tasks sleep, and on release it goes to the waiting device with the highest priority, so a baro read in flight is
+ * never stuck behind a GPS drain. Acquiring is reentrant for the owning task, also for a different device: bus time
+ * and clock are the innermost device's until it is released. The bus clock is switched to the device's on acquire.
+ *
+ * Third party drivers that talk to Wire themselves must only be called between acquire() and release().
+ *
+ */
+class I2CBusClass {
+    public:
+        typedef I2CDevice* Device;
+
+        /**
+         * @brief one read of a batch: the register or command byte is written, then length bytes are read
+         *
+         */
+        struct Read {
+            uint8_t reg;
+            uint8_t *buf;
+            size_t length;
+        };
+
+        enum Priority : uint8_t {
+            LOW_PRIORITY,       ///< bulk, e.g. GPS
+            NORMAL_PRIORITY,
+            HIGH_PRIORITY       ///< flight critical, e.g. baro
+        };
+
+        I2CBusClass();
+
+        /**
+         * @brief set up the bus, safe to call more than once
+         *
+         * @return true bus is ready
+         */
+        bool begin(int sda, int scl);
+
+        /**
+         * @brief add a chip to the bus
+         *
+         * @param name for logging
+         * @param address 7 bit address
+         * @param clockHz bus clock to use with it
+         * @param priority higher wins when the bus is contended
+         * @return Device handle, NULL when full
+         */
+        Device addDevice(const char *name, uint8_t address, uint32_t clockHz, uint8_t priority);
+
+        /**
+         * @brief sleep until the bus is ours
+         *
+         * @param device
+         * @param timeout ticks to wait
+         * @return true acquired, pair with release()
+         */
+        bool acquire(Device device, TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief give the bus to the next waiter
+         *
+         */
+        void release(Device device);
+
+        /**
+         * @brief the bus for third party drivers, only between acquire() and release()
+         *
+         */
+        TwoWire &wire();
+
+        // these acquire the bus themselves, wrap several in acquire() and release() to keep it between them
+        bool write(Device device, const uint8_t *buf, size_t len);
+        bool read(Device device, uint8_t *buf, size_t len);
+        bool writeRegister(Device device, uint8_t reg, uint8_t value);
+        bool readRegisters(Device device, uint8_t reg, uint8_t *buf, size_t len);
+
+        /**
+         * @brief several reads in one hold of the bus, for chips that don't auto-increment, e.g. the MS5611 PROM
+         *
+         * Each read is a write of its register with a stop, then a read, which the MS5611 needs and register chips
+         * accept. Nobody else gets the bus between them, and it is acquired and clocked once rather than per read.
+         *
+         * @return true all of them read, stops at the first failure
+         */
+        bool readBatch(Device device, const Read *reads, size_t count);
+
+        /**
+         * @brief log bus time of every device
+         *
+         */
+        void logStats();
+
+    private:
+        static constexpr size_t maxDevices = 8;
+        static constexpr size_t maxWaiters = 8;
+        static constexpr size_t maxDepth = 4;
+
+        struct Waiter {
+            TaskHandle_t task;
+            Device device;
+        };
+
+        bool countResult(Device device, bool ok);
+        void setClock(Device device);
+        void chargeHeld(uint32_t now);
+
+        bool initialized;
+        SemaphoreHandle_t stateLock;
+        StaticSemaphore_t stateLockBuffer;
+
+        I2CDevice devices[maxDevices];
+        size_t numDevices;
+
+        TaskHandle_t owner;
+        Device held[maxDepth];  // devices the owner has acquired, innermost last
+        uint8_t depth;
+        uint32_t acquiredMicros; // when the owner first acquired the bus
+        uint32_t chargedMicros; // bus time up to here is charged to a device already
+        uint32_t currentClock;
+
+        Waiter waiters[maxWaiters];
+        size_t numWaiters;
+};
+
+extern I2CBusClass I2CBus;
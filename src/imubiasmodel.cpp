@@ -0,0 +1,112 @@
+#include "imubiasmodel.h"
+#include <math.h>
+
+void IMUBiasModel::LineFit::reset() {
+    n = 0;
+    t = tt = 0;
+    for (auto i = 0; i < 3; i++) {
+        y[i] = ty[i] = 0;
+    }
+}
+
+void IMUBiasModel::LineFit::add(float newT, const float newY[3]) {
+    if (n < fitWindow) {
+        n++;
+    }
+    const auto alpha = 1.0f / n;
+    t += alpha * (newT - t);
+    tt += alpha * (newT * newT - tt);
+    for (auto i = 0; i < 3; i++) {
+        y[i] += alpha * (newY[i] - y[i]);
+        ty[i] += alpha * (newT * newY[i] - ty[i]);
+    }
+}
+
+bool IMUBiasModel::LineFit::slopes(float out[3]) const {
+    const auto var = tt - t * t;
+    if (var < minTempSD * minTempSD) {
+        return false;
+    }
+    for (auto i = 0; i < 3; i++) {
+        out[i] = (ty[i] - t * y[i]) / var;
+    }
+    return true;
+}
+
+IMUBiasModel::IMUBiasModel() : learning(true), haveRef(false), still(false), gyroStats(stillWindow),
+    accStats(stillWindow), coeffs{} {
+    gyroFit.reset();
+    accFit.reset();
+}
+
+void IMUBiasModel::setLearning(bool newLearning) {
+    learning = newLearning;
+    if (!learning) {
+        still = false;
+    }
+}
+
+bool IMUBiasModel::update(float temperature, const float acc[3], const float gyro[3]) {
+    if (!learning) {
+        return false;
+    }
+    if (!haveRef) {
+        coeffs.refTemp = temperature;
+        haveRef = true;
+    }
+
+    gyroStats.add(sqrtf(gyro[0] * gyro[0] + gyro[1] * gyro[1] + gyro[2] * gyro[2]));
+    accStats.add(sqrtf(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]));
+    const auto wasStill = still;
+    still = gyroStats.count() == stillWindow && gyroStats.mean() < maxStillGyro &&
+        gyroStats.stddev() < maxStillGyroSD && accStats.stddev() < maxStillAccSD;
+    if (!still) {
+        // it may have been put down another way up, the gravity part of the accelerometer fit is stale
+        if (wasStill) {
+            accFit.reset();
+        }
+        return false;
+    }
+
+    // temperatures relative to the reference keep the sums small
+    const auto t = temperature - coeffs.refTemp;
+    gyroFit.add(t, gyro);
+    accFit.add(t, acc);
+
+    float slope[3];
+    if (gyroFit.slopes(slope)) {
+        for (auto i = 0; i < 3; i++) {
+            coeffs.gyroSlope[i] = slope[i];
+        }
+    }
+    if (accFit.slopes(slope)) {
+        for (auto i = 0; i < 3; i++) {
+            coeffs.accSlope[i] = slope[i];
+        }
+    }
+    for (auto i = 0; i < 3; i++) {
+        coeffs.gyroBias[i] = gyroFit.y[i] - coeffs.gyroSlope[i] * gyroFit.t;
+    }
+    return true;
+}
+
+bool IMUBiasModel::stationary() const {
+    return still;
+}
+
+void IMUBiasModel::biases(float temperature, float acc[3], float gyro[3]) const {
+    const auto t = haveRef ? temperature - coeffs.refTemp : 0;
+    for (auto i = 0; i < 3; i++) {
+        acc[i] = coeffs.accSlope[i] * t;
+        gyro[i] = coeffs.gyroBias[i] + coeffs.gyroSlope[i] * t;
+    }
+}
+
+const IMUBiasModel::Coefficients &IMUBiasModel::coefficients() const {
+    return coeffs;
+}
+
+void IMUBiasModel::setCoefficients(const Coefficients &coefficients) {
+    coeffs = coefficients;
+    haveRef = true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include "runningstats.h"
+
+/**
+ * @brief IMU bias as a linear function of temperature, learned while still
+ *
+ * While the IMU is still the gyro should read zero, so whatever it reads is bias, and regressing it against
+ * temperature gives an offset and a slope per axis. The accelerometer also reads gravity, which can't be told apart
+ * from its bias without knowing the attitude, so only its slope is learned, from how the reading moves with
+ * temperature while the attitude doesn't. Stillness is decided from the running variance of the gyro and accelerometer
+ * magnitudes.
+ *
+ * Fed one averaged sample per batch, applying it costs a subtraction per axis per frame.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class IMUBiasModel {
+    public:
+        struct Coefficients {
+            float refTemp;      ///< C, temperature the offsets are at
+            float gyroBias[3];  ///< rad/s at refTemp
+            float gyroSlope[3]; ///< rad/s per C
+            float accSlope[3];  ///< m/s^2 per C
+        };
+
+        IMUBiasModel();
+
+        /**
+         * @brief learn from update(), only while disarmed
+         *
+         */
+        void setLearning(bool learning);
+
+        /**
+         * @brief feed an averaged sample
+         *
+         * @param temperature C
+         * @param acc m/s^2
+         * @param gyro rad/s
+         * @return true the coefficients changed
+         */
+        bool update(float temperature, const float acc[3], const float gyro[3]);
+
+        /**
+         * @brief is the IMU still, as of the last update
+         *
+         */
+        bool stationary() const;
+
+        /**
+         * @brief the biases to subtract at a temperature
+         *
+         * @param temperature C
+         * @param acc m/s^2, relative to refTemp
+         * @param gyro rad/s
+         */
+        void biases(float temperature, float acc[3], float gyro[3]) const;
+
+        const Coefficients &coefficients() const;
+        void setCoefficients(const Coefficients &coefficients);
+
+    private:
+        static constexpr uint32_t stillWindow = 100; // samples of magnitude stats, ~1s at 100Hz
+        static constexpr float maxStillGyro = 0.05f; // rad/s, a bias can't be bigger
+        static constexpr float maxStillGyroSD = 0.005f; // rad/s
+        static constexpr float maxStillAccSD = 0.05f; // m/s^2
+        static constexpr uint32_t fitWindow = 60000; // ~10 minutes of still samples
+        static constexpr float minTempSD = 0.5f; // C of spread before a slope is believed
+
+        // exponentially weighted means for a least squares line y = a + b t
+        struct LineFit {
+            uint32_t n;
+            float t, tt;
+            float y[3], ty[3];
+
+            void reset();
+            void add(float t, const float y[3]);
+            bool slopes(float out[3]) const; // false without enough temperature spread
+        };
+
+        bool learning;
+        bool haveRef;
+        bool still;
+        RunningStats gyroStats;
+        RunningStats accStats;
+        LineFit gyroFit;
+        LineFit accFit;
+        Coefficients coeffs;
+};
@@ -0,0 +1,102 @@
+#include "imufusion.h"
+#include "eventmanager.h"
+
+IMUFusionClass IMUFusion;
+
+IMUFusionClass::IMUFusionClass() : DataProvider<IMUBatch>(rwLock) {
+    name = "IMU fusion";
+    // the high-g is optional, without it the BMI088 passes through
+    static BaseSubsystem* deps[] = {&EventManager, &BMI088Subsystem, NULL};
+    static SubsystemManagerClass::Spec spec(this, deps);
+    SubsystemManager.addSubsystem(&spec);
+    highG.count = 0;
+    data.count = 0;
+}
+
+IMUFusionClass::~IMUFusionClass() {
+}
+
+BaseSubsystem::Status IMUFusionClass::setup() {
+    HighGSubsystem.registerCallback([](const HighGBatch &batch, void *p) {
+        static_cast<IMUFusionClass*>(p)->onHighG(batch);
+    }, this);
+    BMI088Subsystem.registerCallback([](const IMUBatch &batch, void *p) {
+        static_cast<IMUFusionClass*>(p)->onIMU(batch);
+    }, this);
+
+    // cross calibrate only while sitting on the pad
+    fusion.setLearning(true);
+    EventManager.subscribe([](const Event &event, void *p) {
+        auto self = static_cast<IMUFusionClass*>(p);
+        self->rwLock.Lock();
+        self->fusion.setLearning(event.eventType == Event::DISARM_EVENT);
+        self->rwLock.UnLock();
+    }, Event::ARM_EVENT | Event::DISARM_EVENT, this);
+
+    setStatus(READY);
+    return getStatus();
+}
+
+BaseSubsystem::Status IMUFusionClass::start() {
+    setStatus(RUNNING);
+    return getStatus();
+}
+
+void IMUFusionClass::onHighG(const HighGBatch &batch) {
+    rwLock.Lock();
+    highG = batch;
+    rwLock.UnLock();
+}
+
+void IMUFusionClass::onIMU(const IMUBatch &batch) {
+    rwLock.Lock();
+
+    data.time = batch.time;
+    data.periodUS = batch.periodUS;
+    data.count = batch.count;
+    data.faults = batch.faults;
+
+    // a faulted, stopped or late high-g is no better than the clipped BMI088
+    const auto haveHighG = highG.count > 0 && highG.faults == 0;
+    auto allFused = haveHighG;
+    for (size_t i = 0; i < batch.count; i++) {
+        const auto &in = batch.frames[i];
+        auto &out = data.frames[i];
+
+        // the high-g frame at or just after this one, or the newest if this frame is newer than all of them
+        const float *high = nullptr;
+        if (haveHighG) {
+            const int64_t frameTime = batch.time - static_cast<uint64_t>(batch.count - 1 - i) * batch.periodUS;
+            const int64_t age = static_cast<int64_t>(highG.time) - frameTime;
+            if (age < 0) {
+                if (-age <= highG.periodUS) {
+                    high = highG.acc[highG.count - 1];
+                }
+            } else {
+                const auto back = static_cast<uint64_t>(age) / highG.periodUS;
+                if (back < highG.count) {
+                    high = highG.acc[highG.count - 1 - back];
+                }
+            }
+        }
+
+        if (high != nullptr) {
+            fusion.fuse(in.acc, high, out.acc);
+        } else {
+            allFused = false;
+            for (auto axis = 0; axis < 3; axis++) {
+                out.acc[axis] = in.acc[axis];
+            }
+        }
+        for (auto axis = 0; axis < 3; axis++) {
+            out.gyro[axis] = in.gyro[axis];
+        }
+    }
+    // the high-g only takes over saturation if it covered every frame
+    if (allFused) {
+        data.faults &= ~SensorHealth::SATURATED;
+    }
+
+    rwLock.UnLock();
+    callCallbacks();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <subsystem.h>
+#include "bmi088-subsystem.h"
+#include "highg-subsystem.h"
+#include "accelfusion.h"
+
+/**
+ * @brief One continuous IMU stream from the BMI088 and the high-g accelerometer
+ *
+ * Republishes each BMI088 batch with acceleration fused with the high-g frames nearest in time, so consumers never
+ * see the BMI088 clip. The high-g offset is learned while disarmed. Frames without a healthy high-g frame within a
+ * high-g period of them pass through as the BMI088 read them, and the batch keeps the BMI088's SATURATED fault.
+ *
+ */
+class IMUFusionClass : public BaseSubsystem, public DataProvider<IMUBatch> {
+    public:
+        IMUFusionClass();
+        virtual ~IMUFusionClass();
+
+        BaseSubsystem::Status setup();
+        BaseSubsystem::Status start();
+
+    private:
+        void onHighG(const HighGBatch &batch);
+        void onIMU(const IMUBatch &batch);
+
+        AccelFusion fusion;
+        HighGBatch highG; // latest high-g batch
+};
+
+extern IMUFusionClass IMUFusion;
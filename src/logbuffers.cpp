@@ -0,0 +1,126 @@
+#include "logbuffers.h"
+#include <string.h>
+
+LogBuffers::LogBuffers() : buffers{}, current(0), sequence(0), since(0), onFull(nullptr), onFullArg(nullptr) {
+}
+
+void LogBuffers::begin(uint8_t *first, uint8_t *second, FullCallback *newOnFull, void *arg) {
+    buffers[0] = Buffer{};
+    buffers[0].data = first;
+    buffers[1] = Buffer{};
+    buffers[1].data = second;
+    current = 0;
+    onFull = newOnFull;
+    onFullArg = arg;
+}
+
+bool LogBuffers::append(uint32_t session, uint32_t logId, uint32_t now, LogRecordType type, const void *payload,
+    size_t length) {
+    uint8_t record[LogFormat::MAX_RECORD_SIZE];
+
+    // a buffer only holds one session
+    if ((buffers[current].length == BUFFER_SIZE ||
+        (buffers[current].length > 0 && buffers[current].session != session)) && !swap()) {
+        return false;
+    }
+    if (buffers[current].length % BLOCK_SIZE == 0) {
+        encoder.keyframe();
+    }
+    auto n = encode(type, payload, length, record);
+    if (n > BLOCK_DATA - buffers[current].length % BLOCK_SIZE) {
+        // records never straddle blocks, so every block decodes on its own
+        pad(buffers[current]);
+        if (buffers[current].length == BUFFER_SIZE && !swap()) {
+            return false;
+        }
+        encoder.keyframe();
+        n = encode(type, payload, length, record);
+    }
+
+    auto &b = buffers[current];
+    if (b.length == 0) {
+        since = now;
+        b.session = session;
+        b.logId = logId;
+    }
+    memcpy(b.data + b.length, record, n);
+    b.length += n;
+    return true;
+}
+
+size_t LogBuffers::encode(LogRecordType type, const void *payload, size_t length, uint8_t *out) {
+    switch (type) {
+        case HEADER_RECORD:
+            return encoder.header(*static_cast<const uint32_t*>(payload), out);
+        case IMU_KEY_RECORD:
+        case IMU_RECORD:
+            return encoder.imu(*static_cast<const LogIMUSample*>(payload), out);
+        case BARO_KEY_RECORD:
+        case BARO_RECORD:
+            return encoder.baro(*static_cast<const LogBaroSample*>(payload), out);
+        default:
+            return LogEncoder::raw(type, payload, length, out);
+    }
+}
+
+/**
+ * @brief fill the buffer with padding to the next block boundary, the commit goes over the end of it when written
+ *
+ */
+void LogBuffers::pad(Buffer &b) {
+    const auto end = (b.length + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    memset(b.data + b.length, PAD_RECORD, end - b.length);
+    b.length = end;
+}
+
+bool LogBuffers::swap() {
+    auto &other = buffers[1 - current];
+    if (other.full) {
+        return false;
+    }
+
+    auto &b = buffers[current];
+    pad(b);
+    b.full = true;
+    b.sequence = sequence++;
+    current = 1 - current;
+
+    if (onFull != nullptr) {
+        onFull(onFullArg);
+    }
+    return true;
+}
+
+size_t LogBuffers::activeLength() const {
+    return buffers[current].length;
+}
+
+uint32_t LogBuffers::activeSince() const {
+    return since;
+}
+
+bool LogBuffers::empty() const {
+    return buffers[current].length == 0 && !buffers[1 - current].full;
+}
+
+LogBuffers::Buffer *LogBuffers::next() {
+    Buffer *b = nullptr;
+    for (auto &candidate : buffers) {
+        if (candidate.full && (b == nullptr || candidate.sequence < b->sequence)) {
+            b = &candidate;
+        }
+    }
+    return b;
+}
+
+size_t LogBuffers::write(Buffer &b, LogStorage &storage, uint32_t &blockSequence, bool flying) {
+    for (size_t offset = 0; offset < b.length; offset += BLOCK_SIZE) {
+        logSeal(b.data + offset, b.logId, blockSequence++);
+    }
+    return storage.write(b.data, b.length, flying);
+}
+
+void LogBuffers::release(Buffer &b) {
+    b.length = 0;
+    b.full = false;
+}
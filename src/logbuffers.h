@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "logformat.h"
+#include "logstorage.h"
+
+/**
+ * @brief The two RAM buffers DataLogger appends log records to
+ *
+ * Records are encoded into the active buffer, a whole number of blocks. A record that won't fit in what is left of a
+ * block goes in the next one, the rest of the block is padding, and every block starts with keyframes so it decodes on
+ * its own. When the active buffer can't take the next record it is padded, marked full and the other one takes its
+ * place, so a record is only dropped when the other one hasn't been written yet. A buffer only holds one session.
+ *
+ * Full buffers are written oldest first, each with one write, sealing each block just before. A full buffer belongs to
+ * the writer until it is released, everything else must be serialized by the caller. Plain C++ so it can be run with
+ * a mock storage on the host.
+ *
+ */
+class LogBuffers {
+    public:
+        static constexpr size_t BLOCK_SIZE = LogFormat::BLOCK_SIZE;
+        static constexpr size_t BLOCK_DATA = LogFormat::BLOCK_DATA;     // the rest is the commit
+        static constexpr size_t BUFFER_SIZE = 8 * BLOCK_SIZE;   // ~2s of flight data per buffer
+
+        struct Buffer {
+            uint8_t *data;
+            size_t length;          ///< bytes appended, or to write once full
+            bool full;              ///< handed to the writer
+            uint32_t sequence;      ///< order the buffers were filled in
+            uint32_t session;       ///< which session the records belong to
+            uint32_t logId;         ///< and that session's LogHeader::id
+        };
+
+        typedef void(FullCallback)(void *arg);
+
+        LogBuffers();
+
+        /**
+         * @brief hand over the memory, BUFFER_SIZE bytes each
+         *
+         * @param onFull called when a buffer is handed to the writer, e.g. to wake it, may be NULL
+         */
+        void begin(uint8_t *first, uint8_t *second, FullCallback *onFull, void *arg);
+
+        /**
+         * @brief encode a record into the active buffer
+         *
+         * @param session the record belongs to, a different one from the active buffer's starts a new buffer
+         * @param logId the session's LogHeader::id
+         * @param now ms timestamp, kept for the first record in a buffer
+         * @return false dropped, both buffers are full
+         */
+        bool append(uint32_t session, uint32_t logId, uint32_t now, LogRecordType type, const void *payload,
+            size_t length);
+
+        /**
+         * @brief hand the active buffer to the writer even though it isn't full
+         *
+         * @return false if the other one hasn't been written yet
+         */
+        bool swap();
+
+        /**
+         * @brief bytes waiting in the active buffer
+         *
+         */
+        size_t activeLength() const;
+
+        /**
+         * @brief ms timestamp of the first record in the active buffer
+         *
+         */
+        uint32_t activeSince() const;
+
+        /**
+         * @brief nothing waiting to be written
+         *
+         */
+        bool empty() const;
+
+        /**
+         * @brief the full buffer to write next
+         *
+         * @return Buffer* oldest full one, NULL if none
+         */
+        Buffer *next();
+
+        /**
+         * @brief seal the buffer's blocks and write it
+         *
+         * @param blockSequence blocks sealed in the open flight so far, advanced past this buffer's
+         * @param flying passed on to storage
+         * @return size_t bytes written
+         */
+        static size_t write(Buffer &b, LogStorage &storage, uint32_t &blockSequence, bool flying);
+
+        /**
+         * @brief give a written buffer back to be filled
+         *
+         */
+        void release(Buffer &b);
+
+    private:
+        Buffer buffers[2];
+        size_t current;             // index of the buffer being filled
+        uint32_t sequence;
+        uint32_t since;             // ms of the first record in the active buffer
+        LogEncoder encoder;
+        FullCallback *onFull;
+        void *onFullArg;
+
+        size_t encode(LogRecordType type, const void *payload, size_t length, uint8_t *out);
+        static void pad(Buffer &b);
+};
@@ -0,0 +1,386 @@
+#include "logformat.h"
+#include <math.h>
+#include <string.h>
+
+static const char magic[4] = {'L', 'D', 'R', 'C'};
+
+static_assert(LogFormat::BLOCK_SIZE == 1 << 12, "header blockShift is out of date");
+static_assert(LogFormat::COMMIT_SIZE == 2 + sizeof(LogCommit), "commit size is out of date");
+
+size_t putVarint(uint8_t *out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+size_t getVarint(const uint8_t *in, size_t available, uint64_t &v) {
+    v = 0;
+    for (size_t n = 0; n < available && n < 10; n++) {
+        v |= static_cast<uint64_t>(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief the table for logCRC, built by the compiler
+ *
+ */
+struct CRCTable {
+    uint32_t entries[256];
+
+    constexpr CRCTable() : entries{} {
+        for (uint32_t i = 0; i < 256; i++) {
+            auto c = i;
+            for (auto bit = 0; bit < 8; bit++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+static constexpr CRCTable crcTable;
+
+uint32_t logCRC(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = crcTable.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t blockCRC(const uint8_t *block, uint32_t id) {
+    return logCRC(id, block, LogFormat::BLOCK_SIZE - sizeof(LogCommit::crc));
+}
+
+void logSeal(uint8_t *block, uint32_t id, uint32_t sequence) {
+    // the crc covers the rest of the commit record
+    auto p = block + LogFormat::BLOCK_DATA;
+    p[0] = COMMIT_RECORD;
+    p[1] = sizeof(LogCommit);
+    memcpy(p + 2 + offsetof(LogCommit, sequence), &sequence, sizeof(sequence));
+    const auto crc = blockCRC(block, id);
+    memcpy(p + 2 + offsetof(LogCommit, crc), &crc, sizeof(crc));
+}
+
+bool logSealed(const uint8_t *block, uint32_t id, uint32_t sequence) {
+    LogCommit commit;
+    const auto p = block + LogFormat::BLOCK_DATA;
+    if (p[0] != COMMIT_RECORD || p[1] != sizeof(commit)) {
+        return false;
+    }
+    memcpy(&commit, p + 2, sizeof(commit));
+    return commit.sequence == sequence && commit.crc == blockCRC(block, id);
+}
+
+bool logId(const uint8_t *block, uint32_t &id) {
+    LogHeader header;
+    if (block[0] != HEADER_RECORD || block[1] != sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, block + 2, sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != LogFormat::VERSION) {
+        return false;
+    }
+    id = header.id;
+    return true;
+}
+
+static int32_t quantize(float v, float scale) {
+    // bad values are flagged in the faults, only keep them from blowing up the deltas
+    constexpr float limit = 1e9f;
+    if (!isfinite(v)) {
+        return 0;
+    }
+    const auto q = v * scale;
+    if (q > limit) {
+        return limit;
+    }
+    if (q < -limit) {
+        return -limit;
+    }
+    return lroundf(q);
+}
+
+static constexpr uint8_t FAULTS_CHANGED = 0x80;
+static constexpr uint8_t PERIOD_CHANGED = 0x40;
+static constexpr uint8_t WIDTH_MASK = 0x3F;
+
+/**
+ * @brief encode one sample of a channel as a keyframe or a delta from the previous one
+ *
+ * keyframe payload: faults, time, then each value, as varints
+ *
+ * delta payload: a byte with FAULTS_CHANGED, PERIOD_CHANGED and the width in bits of the widest zigzagged value change,
+ * then the faults and the change in period if they changed, then every value change in that many bits, low bits first
+ */
+static size_t encodeChannel(LogChannel &c, LogRecordType keyType, LogRecordType deltaType, uint64_t time,
+    uint8_t faults, const int32_t *values, size_t n, uint8_t *out) {
+    auto p = out + 2;
+    if (!c.valid) {
+        out[0] = keyType;
+        *p++ = faults;
+        p += putVarint(p, time);
+        for (size_t i = 0; i < n; i++) {
+            p += putVarint(p, zigzag(values[i]));
+        }
+        c.period = 0;
+    } else {
+        out[0] = deltaType;
+        const auto period = static_cast<int64_t>(time - c.time);
+        uint64_t deltas[LogChannel::MAX_VALUES];
+        uint64_t all = 0;
+        for (size_t i = 0; i < n; i++) {
+            deltas[i] = zigzag(static_cast<int64_t>(values[i]) - c.values[i]);
+            all |= deltas[i];
+        }
+        uint8_t width = 0;
+        while (all >> width) {
+            width++;
+        }
+        auto flags = p++;
+        *flags = width;
+        if (faults != c.faults) {
+            *flags |= FAULTS_CHANGED;
+            *p++ = faults;
+        }
+        if (period != c.period) {
+            *flags |= PERIOD_CHANGED;
+            p += putVarint(p, zigzag(period - c.period));
+        }
+        uint64_t bits = 0;
+        size_t used = 0;
+        for (size_t i = 0; i < n; i++) {
+            bits |= deltas[i] << used;
+            used += width;
+            while (used >= 8) {
+                *p++ = static_cast<uint8_t>(bits);
+                bits >>= 8;
+                used -= 8;
+            }
+        }
+        if (used > 0) {
+            *p++ = static_cast<uint8_t>(bits);
+        }
+        c.period = period;
+    }
+    c.valid = true;
+    c.time = time;
+    c.faults = faults;
+    memcpy(c.values, values, n * sizeof(values[0]));
+
+    out[1] = static_cast<uint8_t>(p - out - 2);
+    return p - out;
+}
+
+/**
+ * @brief the reverse of encodeChannel
+ *
+ * @return false if the payload is malformed or a delta has nothing to apply to
+ */
+static bool decodeChannel(LogChannel &c, bool key, const uint8_t *in, size_t length, uint64_t &time, uint8_t &faults,
+    int32_t *values, size_t n) {
+    const auto end = in + length;
+    uint64_t v;
+    size_t used;
+
+    if (!key && !c.valid) {
+        return false;
+    }
+    if (key) {
+        if (length < 1) {
+            goto bad;
+        }
+        faults = *in++;
+        if (!(used = getVarint(in, end - in, v))) {
+            goto bad;
+        }
+        in += used;
+        time = v;
+        c.period = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!(used = getVarint(in, end - in, v))) {
+                goto bad;
+            }
+            in += used;
+            values[i] = static_cast<int32_t>(unzigzag(v));
+        }
+    } else {
+        if (length < 1) {
+            goto bad;
+        }
+        const auto flags = *in++;
+        const size_t width = flags & WIDTH_MASK;
+        faults = c.faults;
+        if (flags & FAULTS_CHANGED) {
+            if (in == end) {
+                goto bad;
+            }
+            faults = *in++;
+        }
+        if (flags & PERIOD_CHANGED) {
+            if (!(used = getVarint(in, end - in, v))) {
+                goto bad;
+            }
+            in += used;
+            c.period += unzigzag(v);
+        }
+        time = c.time + c.period;
+        if (width > 33 || static_cast<size_t>(end - in) != (n * width + 7) / 8) {
+            goto bad;
+        }
+        uint64_t bits = 0;
+        size_t have = 0;
+        for (size_t i = 0; i < n; i++) {
+            while (have < width) {
+                bits |= static_cast<uint64_t>(*in++) << have;
+                have += 8;
+            }
+            v = bits & ((1ull << width) - 1);
+            bits >>= width;
+            have -= width;
+            values[i] = static_cast<int32_t>(c.values[i] + unzigzag(v));
+        }
+    }
+
+    c.valid = true;
+    c.time = time;
+    c.faults = faults;
+    memcpy(c.values, values, n * sizeof(values[0]));
+    return true;
+
+bad:
+    // nothing after this can be trusted until the next keyframe
+    c.valid = false;
+    return false;
+}
+
+LogEncoder::LogEncoder() {
+    keyframe();
+}
+
+void LogEncoder::keyframe() {
+    imuChannel.valid = false;
+    baroChannel.valid = false;
+}
+
+size_t LogEncoder::header(uint32_t id, uint8_t *out) {
+    LogHeader header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = LogFormat::VERSION;
+    header.blockShift = 12;
+    header.id = id;
+    return raw(HEADER_RECORD, &header, sizeof(header), out);
+}
+
+size_t LogEncoder::imu(const LogIMUSample &sample, uint8_t *out) {
+    const int32_t values[] = {
+        quantize(sample.acc[0], LogFormat::ACC_SCALE),
+        quantize(sample.acc[1], LogFormat::ACC_SCALE),
+        quantize(sample.acc[2], LogFormat::ACC_SCALE),
+        quantize(sample.gyro[0], LogFormat::GYRO_SCALE),
+        quantize(sample.gyro[1], LogFormat::GYRO_SCALE),
+        quantize(sample.gyro[2], LogFormat::GYRO_SCALE),
+    };
+    return encodeChannel(imuChannel, IMU_KEY_RECORD, IMU_RECORD, sample.time, sample.faults, values, 6, out);
+}
+
+size_t LogEncoder::baro(const LogBaroSample &sample, uint8_t *out) {
+    const int32_t values[] = {
+        quantize(sample.altitude, LogFormat::ALTITUDE_SCALE),
+        sample.temperature,
+    };
+    return encodeChannel(baroChannel, BARO_KEY_RECORD, BARO_RECORD, sample.time, sample.faults, values, 2, out);
+}
+
+size_t LogEncoder::raw(LogRecordType type, const void *payload, size_t length, uint8_t *out) {
+    out[0] = type;
+    out[1] = static_cast<uint8_t>(length);
+    memcpy(out + 2, payload, length);
+    return 2 + length;
+}
+
+LogDecoder::LogDecoder() {
+    reset();
+}
+
+void LogDecoder::reset() {
+    imuChannel.valid = false;
+    baroChannel.valid = false;
+}
+
+size_t LogDecoder::next(const uint8_t *in, size_t available, Record &record) {
+    if (available < 1) {
+        return 0;
+    }
+    record.type = in[0];
+    record.valid = false;
+    record.payload = in + 1;
+    record.length = 0;
+    if (record.type == PAD_RECORD) {
+        record.valid = true;
+        return 1;
+    }
+
+    if (available < 2 || available < 2 + static_cast<size_t>(in[1])) {
+        return 0;
+    }
+    record.payload = in + 2;
+    record.length = in[1];
+
+    switch (record.type) {
+        case HEADER_RECORD: {
+            LogHeader header;
+            if (record.length != sizeof(header)) {
+                break;
+            }
+            memcpy(&header, record.payload, sizeof(header));
+            record.valid = memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == LogFormat::VERSION;
+            reset();
+            break;
+        }
+        case STATUS_RECORD:
+            record.valid = record.length == LogFormat::STATUS_SIZE;
+            break;
+        case EVENT_RECORD:
+            record.valid = record.length == LogFormat::EVENT_SIZE;
+            break;
+        case GPS_RECORD:
+            record.valid = record.length == LogFormat::GPS_SIZE;
+            break;
+        case COMMIT_RECORD:
+            record.valid = record.length == sizeof(LogCommit);
+            break;
+        case IMU_KEY_RECORD:
+        case IMU_RECORD: {
+            int32_t values[6] = {};
+            auto &s = record.imu;
+            record.valid = decodeChannel(imuChannel, record.type == IMU_KEY_RECORD, record.payload, record.length,
+                s.time, s.faults, values, 6);
+            for (auto i = 0; i < 3; i++) {
+                s.acc[i] = values[i] / LogFormat::ACC_SCALE;
+                s.gyro[i] = values[i + 3] / LogFormat::GYRO_SCALE;
+            }
+            break;
+        }
+        case BARO_KEY_RECORD:
+        case BARO_RECORD: {
+            int32_t values[2] = {};
+            auto &s = record.baro;
+            record.valid = decodeChannel(baroChannel, record.type == BARO_KEY_RECORD, record.payload, record.length,
+                s.time, s.faults, values, 2);
+            s.altitude = values[0] / LogFormat::ALTITUDE_SCALE;
+            s.temperature = static_cast<uint8_t>(values[1]);
+            break;
+        }
+    }
+
+    return 2 + record.length;
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Record types of the flight log
+ *
+ * A log is a sequence of records, each a type byte, a payload length byte and the payload. Records never straddle a
+ * flash block: the rest of a block that can't take the next record is filled with PAD_RECORD bytes, the erased flash
+ * pattern. The first record of a log is a HEADER_RECORD carrying the format version and a random id for the log.
+ *
+ * The last COMMIT_SIZE bytes of every block are a COMMIT_RECORD, written with the block: the block's number in the
+ * log and a CRC of everything before it, seeded with the log's id. A block that checks out was written whole, belongs
+ * to that log and sits where it should, so after a power loss everything up to the first one that doesn't can be
+ * kept, see logSealed().
+ *
+ * IMU and baro samples are quantized and stored as the difference from the previous sample of the same channel,
+ * zigzagged and packed into as few bits each as the largest of them needs. Faults and the sample period are only
+ * stored when they change, which is rarely. A keyframe record holds the sample whole, as varints. Every block starts
+ * with keyframes, so any block decodes without the ones before it.
+ *
+ * Status packets, events and GPS fixes are stored as they are, they are packed and little endian on both the ESP32
+ * and the host.
+ *
+ */
+enum LogRecordType : uint8_t {
+    HEADER_RECORD = 0,      ///< LogHeader
+    STATUS_RECORD = 1,      ///< StatusPacket
+    EVENT_RECORD = 2,       ///< Event
+    GPS_RECORD = 3,         ///< GPSFix
+    IMU_KEY_RECORD = 4,     ///< LogIMUSample, whole
+    IMU_RECORD = 5,         ///< LogIMUSample, delta from the previous one
+    BARO_KEY_RECORD = 6,    ///< LogBaroSample, whole
+    BARO_RECORD = 7,        ///< LogBaroSample, delta from the previous one
+    COMMIT_RECORD = 8,      ///< LogCommit, ends every block
+    PAD_RECORD = 0xFF,      ///< rest of the block is padding
+};
+
+/**
+ * @brief what the format looks like, change the version with it
+ *
+ */
+struct LogFormat {
+    static constexpr uint8_t VERSION = 4;           // 1 raw structs, 2 no commits, 3 varint deltas
+    static constexpr size_t BLOCK_SIZE = 4096;      // flash sector
+    static constexpr size_t COMMIT_SIZE = 10;       // COMMIT_RECORD with its LogCommit
+    static constexpr size_t BLOCK_DATA = BLOCK_SIZE - COMMIT_SIZE; // room for other records
+    static constexpr size_t MAX_RECORD_SIZE = 2 + 0xFF;
+
+    // payloads stored as they are, host tools read them at fixed offsets
+    static constexpr size_t STATUS_SIZE = 142;      // StatusPacket
+    static constexpr size_t EVENT_SIZE = 20;        // Event
+    static constexpr size_t GPS_SIZE = 50;          // GPSFix
+
+    static constexpr float ACC_SCALE = 100;         // counts per m/s^2
+    static constexpr float GYRO_SCALE = 1000;       // counts per rad/s
+    static constexpr float ALTITUDE_SCALE = 100;    // counts per m
+};
+
+struct __attribute__((packed)) LogHeader {
+    char magic[4];          ///< "LDRC"
+    uint8_t version;        ///< LogFormat::VERSION
+    uint8_t blockShift;     ///< log2 of LogFormat::BLOCK_SIZE
+    uint32_t id;            ///< random, tells this log's blocks from others'
+};
+
+struct __attribute__((packed)) LogCommit {
+    uint32_t sequence;      ///< block number in the log, from 0
+    uint32_t crc;           ///< logCRC() of the block up to here, seeded with LogHeader::id
+};
+
+struct LogIMUSample {
+    uint64_t time;          ///< timestampUS() of the frame
+    float acc[3];           ///< m/s^2
+    float gyro[3];          ///< rad/s
+    uint8_t faults;
+};
+
+struct LogBaroSample {
+    uint64_t time;          ///< timestampUS() the pressure was sampled
+    float altitude;         ///< m
+    uint8_t temperature;
+    uint8_t faults;
+};
+
+/**
+ * @brief the previous sample of a delta encoded channel, the encoder and decoder keep the same one
+ *
+ */
+struct LogChannel {
+    static constexpr size_t MAX_VALUES = 6;
+
+    bool valid;             ///< false until a keyframe
+    uint64_t time;
+    int64_t period;         ///< time since the sample before
+    uint8_t faults;
+    int32_t values[MAX_VALUES]; ///< quantized
+};
+
+/**
+ * @brief Turns samples into records
+ *
+ * Keeps the previous sample of each channel. Call keyframe() at the start of every block.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class LogEncoder {
+    public:
+        LogEncoder();
+
+        /**
+         * @brief make the next sample of every channel a keyframe
+         *
+         */
+        void keyframe();
+
+        /**
+         * @brief encode a record
+         *
+         * @param out at least LogFormat::MAX_RECORD_SIZE bytes
+         * @return size_t bytes written
+         */
+        size_t header(uint32_t id, uint8_t *out);
+        size_t imu(const LogIMUSample &sample, uint8_t *out);
+        size_t baro(const LogBaroSample &sample, uint8_t *out);
+
+        /**
+         * @brief a record with the payload copied as is
+         *
+         * @param length at most 255
+         */
+        static size_t raw(LogRecordType type, const void *payload, size_t length, uint8_t *out);
+
+    private:
+        LogChannel imuChannel;
+        LogChannel baroChannel;
+};
+
+/**
+ * @brief Turns records back into samples
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class LogDecoder {
+    public:
+        struct Record {
+            uint8_t type;           ///< LogRecordType
+            bool valid;             ///< false for deltas with no keyframe before them, unknown types and bad payloads
+            const uint8_t *payload; ///< points into the decoded bytes
+            size_t length;
+            LogIMUSample imu;       ///< for IMU_KEY_RECORD and IMU_RECORD
+            LogBaroSample baro;     ///< for BARO_KEY_RECORD and BARO_RECORD
+        };
+
+        LogDecoder();
+
+        /**
+         * @brief forget the previous samples, e.g. after skipping corrupt data
+         *
+         */
+        void reset();
+
+        /**
+         * @brief decode the record at the start of in
+         *
+         * A PAD_RECORD is a single byte.
+         *
+         * @param in bytes to decode
+         * @param available bytes in in
+         * @param record filled in
+         * @return size_t bytes the record takes, 0 if it is truncated
+         */
+        size_t next(const uint8_t *in, size_t available, Record &record);
+
+    private:
+        LogChannel imuChannel;
+        LogChannel baroChannel;
+};
+
+// helpers shared by the encoder, decoder and host tools
+
+inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/**
+ * @brief write v 7 bits at a time, low first, high bit set on all but the last byte
+ *
+ * @return size_t bytes written, at most 10
+ */
+size_t putVarint(uint8_t *out, uint64_t v);
+
+/**
+ * @brief read a varint
+ *
+ * @return size_t bytes read, 0 if it runs past available or is too long
+ */
+size_t getVarint(const uint8_t *in, size_t available, uint64_t &v);
+
+/**
+ * @brief CRC-32, the zlib one
+ *
+ * @param crc result so far, 0 to start
+ */
+uint32_t logCRC(uint32_t crc, const uint8_t *data, size_t length);
+
+/**
+ * @brief write the commit record at the end of a block
+ *
+ * @param block LogFormat::BLOCK_SIZE bytes, padded
+ * @param id LogHeader::id of the log
+ * @param sequence block number in the log
+ */
+void logSeal(uint8_t *block, uint32_t id, uint32_t sequence);
+
+/**
+ * @brief was a block written whole, as block sequence of log id
+ *
+ */
+bool logSealed(const uint8_t *block, uint32_t id, uint32_t sequence);
+
+/**
+ * @brief get the id of the log a block starts
+ *
+ * @return bool false if the block doesn't start with a header of this version
+ */
+bool logId(const uint8_t *block, uint32_t &id);
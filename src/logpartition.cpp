@@ -0,0 +1,31 @@
+#include "logpartition.h"
+
+static_assert(sizeof(FlightEntry) == 32, "entries must tile a sector");
+
+LogPartition::LogPartition(size_t partitionSize) : size(partitionSize) {
+}
+
+size_t LogPartition::dataSize() const {
+    return size > HEADER_SIZE ? size - HEADER_SIZE : 0;
+}
+
+size_t LogPartition::entryOffset(uint32_t ordinal) const {
+    return (ordinal % MAX_ENTRIES) * sizeof(FlightEntry);
+}
+
+size_t LogPartition::dataOffset(uint64_t position) const {
+    return HEADER_SIZE + position % dataSize();
+}
+
+size_t LogPartition::contiguous(uint64_t position) const {
+    return dataSize() - position % dataSize();
+}
+
+bool LogPartition::intact(const FlightEntry &entry, uint64_t head) const {
+    const auto end = entry.end == ERASED ? head : entry.end;
+    return entry.start <= end && end <= head && head - entry.start <= dataSize();
+}
+
+bool LogPartition::valid(const FlightEntry &entry) {
+    return entry.magic == ENTRY_MAGIC && entry.ordinal != 0 && entry.start != ERASED;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief one flight in the raw log partition's header ring
+ *
+ * Written when the flight starts with end left erased, end is programmed in place when it closes. Flash can turn
+ * ones into zeros without an erase, so that needs no erase either.
+ *
+ */
+struct __attribute__((packed)) FlightEntry {
+    uint32_t magic;         ///< LogPartition::ENTRY_MAGIC
+    uint32_t ordinal;       ///< counts up from 1 with every flight
+    uint32_t epoch;         ///< GPS epoch at arming, 0 if there was no fix
+    uint32_t reserved;      ///< left erased
+    uint64_t start;         ///< position of the first block
+    uint64_t end;           ///< position after the last block, all ones until the flight is closed
+};
+
+/**
+ * @brief Layout of the raw flight log partition
+ *
+ * The first HEADER_SECTORS sectors are a ring of FlightEntry, a flight's entry goes in slot ordinal % MAX_ENTRIES. The
+ * sector an entry starts is erased first, which forgets the flights that were there MAX_ENTRIES ago.
+ *
+ * The rest is a ring of sectors holding the flights' log streams back to back. Positions are bytes written since the
+ * partition was new, so they never wrap, and position p is stored at dataOffset(p). A flight is intact while less
+ * than the size of the ring has been written since it started.
+ *
+ * Plain C++ so partition images can be read on the host.
+ *
+ */
+class LogPartition {
+    public:
+        static constexpr char LABEL[] = "flightlog";
+        static constexpr uint8_t SUBTYPE = 0x40;
+        static constexpr size_t SECTOR_SIZE = 4096;
+        static constexpr size_t HEADER_SECTORS = 2;
+        static constexpr size_t HEADER_SIZE = HEADER_SECTORS * SECTOR_SIZE;
+        static constexpr size_t ENTRIES_PER_SECTOR = SECTOR_SIZE / sizeof(FlightEntry);
+        static constexpr size_t MAX_ENTRIES = HEADER_SECTORS * ENTRIES_PER_SECTOR;
+        static constexpr uint32_t ENTRY_MAGIC = 0x544C4746; // "FGLT"
+        static constexpr uint64_t ERASED = ~0ull;
+
+        /**
+         * @param partitionSize whole partition, a multiple of SECTOR_SIZE
+         */
+        explicit LogPartition(size_t partitionSize);
+
+        /**
+         * @brief bytes in the data ring
+         *
+         */
+        size_t dataSize() const;
+
+        /**
+         * @brief partition offset of the entry for a flight
+         *
+         */
+        size_t entryOffset(uint32_t ordinal) const;
+
+        /**
+         * @brief partition offset of a position
+         *
+         */
+        size_t dataOffset(uint64_t position) const;
+
+        /**
+         * @brief bytes from a position to the end of the data ring, i.e. how much can be read or written in one go
+         *
+         */
+        size_t contiguous(uint64_t position) const;
+
+        /**
+         * @brief has a flight not been overwritten
+         *
+         * @param head position of the next write
+         */
+        bool intact(const FlightEntry &entry, uint64_t head) const;
+
+        /**
+         * @brief does an entry hold a flight
+         *
+         */
+        static bool valid(const FlightEntry &entry);
+
+    private:
+        size_t size;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief a flight log as storage knows it
+ *
+ */
+struct LogFlight {
+    uint32_t ordinal;       ///< counts up with every flight
+    uint32_t epoch;         ///< GPS epoch at arming, 0 if there was no fix
+    uint32_t bytes;
+    bool open;              ///< still being written
+};
+
+/**
+ * @brief Where DataLogger puts flight logs
+ *
+ * A flight is opened, written whole blocks at a time and closed. Between writes the logger task gives storage a
+ * chance to do slow housekeeping, but never in flight. Flights can be listed and read back while logging.
+ *
+ * Implementations are not thread safe, DataLogger serializes all calls.
+ *
+ */
+class LogStorage {
+    public:
+        virtual ~LogStorage() {}
+
+        /**
+         * @brief find existing flights and get ready to log
+         *
+         * @return false if this storage can't be used
+         */
+        virtual bool begin() = 0;
+
+        /**
+         * @brief start a new flight
+         *
+         * @param epoch GPS epoch, 0 if unknown
+         */
+        virtual bool open(uint32_t epoch) = 0;
+
+        /**
+         * @brief append to the open flight
+         *
+         * @param length a whole number of blocks
+         * @param flying a flight is in progress, a write that would have to wait for housekeeping is dropped instead
+         * @return size_t bytes written
+         */
+        virtual size_t write(const uint8_t *data, size_t length, bool flying) = 0;
+
+        /**
+         * @brief finish the open flight, if any
+         *
+         */
+        virtual void close() = 0;
+
+        /**
+         * @brief do a slice of housekeeping
+         *
+         * @param flying a flight is in progress, only what can't wait should be done
+         * @param armed a session is open, flying or not, nothing that could lose what it logs should be done
+         * @return true if there is more to do
+         */
+        virtual bool maintain(bool flying, bool armed) = 0;
+
+        /**
+         * @brief list flights, oldest first
+         *
+         * @return size_t number of flights filled in
+         */
+        virtual size_t flights(LogFlight *out, size_t max) = 0;
+
+        /**
+         * @brief read part of a flight
+         *
+         * @return size_t bytes read, 0 past the end or if there is no such flight
+         */
+        virtual size_t read(uint32_t ordinal, size_t offset, uint8_t *out, size_t length) = 0;
+
+        /**
+         * @brief log what this storage has cost
+         *
+         */
+        virtual void logStats() = 0;
+};
@@ -1,50 +1,127 @@
 #include "mag-subsystem.h"
 #include "pins.h"
-#include <Wire.h>
 #include "log.h"
+#include "eventmanager.h"
+#include "statusmanager.h"
 
 MagSubsystemClass MagSubsystem;
 
-MagSubsystemClass::MagSubsystemClass() : DataProvider<threeFloats>(rwLock) {
+static constexpr uint8_t REG_STATUS =       0x27; // followed by OUT_X_L..OUT_Z_H
+static constexpr uint8_t AUTO_INCREMENT =   0x80;
+static constexpr uint8_t STATUS_ZYXDA =     0x08;
+static constexpr float LSB_PER_GAUSS =      6842; // 4 gauss range
+static constexpr float UT_PER_GAUSS =       100;
+
+// the rail is just inside full scale, before calibration
+static constexpr SensorHealth::Limits LIMITS = {500000, 50, 32700 / LSB_PER_GAUSS * UT_PER_GAUSS, 0};
+
+// preferences key
+static constexpr char CalibrationKey[] =    "calibration";
+
+MagSubsystemClass::MagSubsystemClass() : DataProvider<threeFloats>(rwLock), device(NULL), health(LIMITS), learning(true), unsaved(false),
+    lastSave(0) {
     name = "magenetometer subystem";
+    static BaseSubsystem* deps[] = {&EventManager, &StatusManager, &LogWriter, NULL};
+    static SubsystemManagerClass::Spec spec(this, deps);
+    SubsystemManager.addSubsystem(&spec);
 };
 
 MagSubsystemClass::~MagSubsystemClass() {
 }
 
 BaseSubsystem::Status MagSubsystemClass::setup() {
-    Wire.begin(I2C_SDA, I2C_SCL);
     setStatus(BaseSubsystem::FAULT);
 
-    if (!sensor.begin_I2C()) {
+    preferences.begin("ldrc_mag", false);
+    loadCalibration();
+
+    // the field changes in flight only from our own currents, learn on the ground
+    EventManager.subscribe([](const Event &event, void *p) {
+        auto self = static_cast<MagSubsystemClass*>(p);
+        self->rwLock.Lock();
+        self->learning = event.eventType == Event::DISARM_EVENT;
+        self->rwLock.UnLock();
+    }, Event::ARM_EVENT | Event::DISARM_EVENT, this);
+
+    I2CBus.begin(I2C_SDA, I2C_SCL);
+    device = I2CBus.addDevice("LIS3MDL", LIS3MDL_I2CADDR_DEFAULT, 400000, I2CBusClass::NORMAL_PRIORITY);
+    if (device == NULL || !I2CBus.acquire(device)) {
+        goto out;
+    }
+    if (!sensor.begin_I2C(LIS3MDL_I2CADDR_DEFAULT, &I2CBus.wire())) {
         Log.errorln("Failed to find LIS3MDL chip");
         goto out;
     }
     sensor.setPerformanceMode(LIS3MDL_HIGHMODE);
     sensor.setOperationMode(LIS3MDL_CONTINUOUSMODE);
-    sensor.setDataRate(LIS3MDL_DATARATE_155_HZ); //uhh sure?
+    sensor.setDataRate(LIS3MDL_DATARATE_155_HZ);
     sensor.setRange(LIS3MDL_RANGE_4_GAUSS);
     setStatus(BaseSubsystem::READY);
 
 out:
+    if (device != NULL) {
+        I2CBus.release(device);
+    }
     return getStatus();
 }
 
+void MagSubsystemClass::loadCalibration() {
+    MagCalibrator::Calibration cal;
+    if (preferences.getBytes(CalibrationKey, &cal, sizeof(cal)) == sizeof(cal)) {
+        calibrator.setCalibration(cal);
+        Log.noticeln("mag calibration loaded, offset %F %F %F", cal.offset[0], cal.offset[1], cal.offset[2]);
+    } else {
+        Log.noticeln("no mag calibration yet");
+    }
+}
+
+void MagSubsystemClass::saveCalibration() {
+    const auto &cal = calibrator.calibration();
+    preferences.putBytes(CalibrationKey, &cal, sizeof(cal));
+    Log.noticeln("mag calibration saved, offset %F %F %F", cal.offset[0], cal.offset[1], cal.offset[2]);
+}
+
 BaseSubsystem::Status MagSubsystemClass::tick() {
-    static sensors_event_t event;
+    uint8_t buf[7];
+    const auto read = I2CBus.readRegisters(device, REG_STATUS | AUTO_INCREMENT, buf, sizeof(buf));
+    const auto now = timestampUS();
+    const auto fresh = read && (buf[0] & STATUS_ZYXDA);
+
+    health.check(now);
+    if (health.healthChanged()) {
+        StatusManager.setBoolStatusFlag(health.healthy(), Packet::MAG_STATUS);
+    }
+    if (!fresh) {
+        return getStatus();
+    }
 
-    sensor.getEvent(&event);
+    float raw[3];
+    for (auto axis = 0; axis < 3; axis++) {
+        const int16_t counts = buf[1 + 2 * axis] | buf[2 + 2 * axis] << 8;
+        raw[axis] = counts / LSB_PER_GAUSS * UT_PER_GAUSS;
+    }
 
     rwLock.Lock();
-    data.x = event.magnetic.x;
-    data.y = event.magnetic.y;
-    data.z = event.magnetic.z;
+    health.update(now, raw, 3);
+    data.faults = health.faults();
+    if (learning && health.healthy() && calibrator.add(raw)) {
+        unsaved = true;
+    }
+    const auto save = learning && unsaved && millis() - lastSave > saveIntervalMS;
+    float field[3];
+    calibrator.apply(raw, field);
+    data.x = field[0];
+    data.y = field[1];
+    data.z = field[2];
+    data.time = now;
     rwLock.UnLock();
 
+    if (save) {
+        lastSave = millis();
+        unsaved = false;
+        saveCalibration();
+    }
+
     callCallbacks();
     return getStatus();
 }
-
-int MagSubsystemClass::period() const {
-    return 100; //FIXME: for now
-}
\ No newline at end of file
@@ -3,23 +3,49 @@
 #include <subsystem.h>
 #include <Adafruit_LIS3MDL.h>
 #include <Adafruit_Sensor.h>
+#include <Preferences.h>
+#include "i2cbus.h"
+#include "magcalibrator.h"
+#include "timebase.h"
+#include "sensorhealth.h"
 
 struct threeFloats {
     float x;
     float y;
     float z;
+    uint64_t time; // timestampUS() of the read
+    uint8_t faults; // SensorHealth::Fault of the stream, 0 if healthy
 };
 
+/**
+ * @brief LIS3MDL magnetometer, calibrated online
+ *
+ * Ticked faster than the 155Hz output rate, each tick reads the status register and the field in one burst and only
+ * publishes when the data ready bit is set. Hard and soft iron are learned while disarmed and saved to flash now and
+ * then, so a board comes up calibrated.
+ *
+ */
 class MagSubsystemClass : public TickableSubsystem, public DataProvider<threeFloats> {
 public:
     MagSubsystemClass();
     virtual ~MagSubsystemClass();
     BaseSubsystem::Status setup();
     BaseSubsystem::Status tick();
-    int period() const;
 
 private:
+    static constexpr uint32_t saveIntervalMS = 60 * 1000; // flash wear
+
+    void loadCalibration();
+    void saveCalibration();
+
     Adafruit_LIS3MDL sensor;
+    I2CBusClass::Device device;
+    Preferences preferences;
+    MagCalibrator calibrator;
+    SensorHealth health;
+    bool learning;
+    bool unsaved;
+    uint32_t lastSave;
 };
 
-extern MagSubsystemClass MagSubsystem;
\ No newline at end of file
+extern MagSubsystemClass MagSubsystem;
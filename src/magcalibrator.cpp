@@ -0,0 +1,221 @@
+#include "magcalibrator.h"
+#include <math.h>
+
+// eigenvalues and vectors of a symmetric 3x3 by cyclic Jacobi rotations, a[] is destroyed, columns of v are vectors
+static void jacobiEigen(float a[3][3], float e[3], float v[3][3]) {
+    for (auto i = 0; i < 3; i++) {
+        for (auto j = 0; j < 3; j++) {
+            v[i][j] = i == j ? 1 : 0;
+        }
+    }
+    for (auto sweep = 0; sweep < 10; sweep++) {
+        const auto off = fabsf(a[0][1]) + fabsf(a[0][2]) + fabsf(a[1][2]);
+        if (off < 1e-9f) {
+            break;
+        }
+        for (auto p = 0; p < 2; p++) {
+            for (auto q = p + 1; q < 3; q++) {
+                if (fabsf(a[p][q]) < 1e-12f) {
+                    continue;
+                }
+                const auto theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                const auto t = (theta >= 0 ? 1 : -1) / (fabsf(theta) + sqrtf(theta * theta + 1));
+                const auto c = 1 / sqrtf(t * t + 1);
+                const auto s = t * c;
+                for (auto k = 0; k < 3; k++) {
+                    const auto akp = a[k][p];
+                    const auto akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (auto k = 0; k < 3; k++) {
+                    const auto apk = a[p][k];
+                    const auto aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (auto k = 0; k < 3; k++) {
+                    const auto vkp = v[k][p];
+                    const auto vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (auto i = 0; i < 3; i++) {
+        e[i] = a[i][i];
+    }
+}
+
+MagCalibrator::MagCalibrator() : cal{{0, 0, 0}, {1, 0, 0, 0, 1, 0, 0, 0, 1}} {
+    reset();
+}
+
+void MagCalibrator::reset() {
+    // start from a centred 0.5 gauss sphere, with little confidence
+    for (auto i = 0; i < N; i++) {
+        theta[i] = 0;
+        for (auto j = 0; j < N; j++) {
+            P[i][j] = i == j ? 10.0f : 0;
+        }
+    }
+    theta[0] = -1;
+    theta[1] = -1;
+    theta[8] = 0.25f;
+    haveLast = false;
+    taken = 0;
+}
+
+bool MagCalibrator::add(const float raw[3]) {
+    // only take samples once the field has turned, so time spent still doesn't dominate
+    const auto norm = sqrtf(raw[0] * raw[0] + raw[1] * raw[1] + raw[2] * raw[2]);
+    if (norm <= 0) {
+        return false;
+    }
+    if (haveLast) {
+        const auto cosTurn = (raw[0] * last[0] + raw[1] * last[1] + raw[2] * last[2]) / norm;
+        if (cosTurn > minTurnCos) {
+            return false;
+        }
+    }
+    for (auto i = 0; i < 3; i++) {
+        last[i] = raw[i] / norm;
+    }
+    haveLast = true;
+
+    const auto x = raw[0] * unitScale;
+    const auto y = raw[1] * unitScale;
+    const auto z = raw[2] * unitScale;
+    const float phi[N] = {y * y, z * z, x * y, x * z, y * z, x, y, z, 1};
+
+    // x^2 = theta . phi, standard RLS update
+    float Pphi[N];
+    auto denom = forgetting;
+    auto predicted = 0.0f;
+    for (auto i = 0; i < N; i++) {
+        Pphi[i] = 0;
+        for (auto j = 0; j < N; j++) {
+            Pphi[i] += P[i][j] * phi[j];
+        }
+        denom += phi[i] * Pphi[i];
+        predicted += theta[i] * phi[i];
+    }
+    const auto err = x * x - predicted;
+    for (auto i = 0; i < N; i++) {
+        theta[i] += Pphi[i] / denom * err;
+    }
+    for (auto i = 0; i < N; i++) {
+        for (auto j = 0; j < N; j++) {
+            P[i][j] = (P[i][j] - Pphi[i] * Pphi[j] / denom) / forgetting;
+        }
+    }
+
+    taken++;
+    if (taken < minSamples || taken % solveEvery != 0) {
+        return false;
+    }
+    return solve();
+}
+
+bool MagCalibrator::solve() {
+    // v^T M v + b . v + g = 0
+    const float M[3][3] = {
+        {1,                 -theta[2] / 2,  -theta[3] / 2},
+        {-theta[2] / 2,     -theta[0],      -theta[4] / 2},
+        {-theta[3] / 2,     -theta[4] / 2,  -theta[1]},
+    };
+    const float b[3] = {-theta[5], -theta[6], -theta[7]};
+    const auto g = -theta[8];
+
+    // centre c = -M^-1 b / 2, by Cramer's rule
+    const auto det = M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+        - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+        + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+    if (fabsf(det) < 1e-9f) {
+        return false;
+    }
+    float c[3];
+    for (auto col = 0; col < 3; col++) {
+        float m[3][3];
+        for (auto i = 0; i < 3; i++) {
+            for (auto j = 0; j < 3; j++) {
+                m[i][j] = j == col ? -b[i] / 2 : M[i][j];
+            }
+        }
+        c[col] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+            - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+            + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+    }
+
+    // (v - c)^T M (v - c) = r
+    auto r = -g;
+    for (auto i = 0; i < 3; i++) {
+        for (auto j = 0; j < 3; j++) {
+            r += c[i] * M[i][j] * c[j];
+        }
+    }
+    if (r <= 0) {
+        return false;
+    }
+
+    float a[3][3];
+    for (auto i = 0; i < 3; i++) {
+        for (auto j = 0; j < 3; j++) {
+            a[i][j] = M[i][j] / r;
+        }
+    }
+    float e[3];
+    float v[3][3];
+    jacobiEigen(a, e, v);
+
+    // eigenvalues are 1/radius^2 along each principal axis
+    float radius[3];
+    for (auto i = 0; i < 3; i++) {
+        if (e[i] <= 0) {
+            return false;
+        }
+        radius[i] = 1 / sqrtf(e[i]);
+        if (radius[i] < minRadius || radius[i] > maxRadius) {
+            return false;
+        }
+    }
+    const auto longest = fmaxf(radius[0], fmaxf(radius[1], radius[2]));
+    const auto shortest = fminf(radius[0], fminf(radius[1], radius[2]));
+    if (longest > maxAxisRatio * shortest) {
+        return false;
+    }
+
+    // symmetric square root, so the correction doesn't rotate the frame, scaled to keep the mean field strength
+    const auto meanRadius = cbrtf(radius[0] * radius[1] * radius[2]);
+    for (auto i = 0; i < 3; i++) {
+        for (auto j = 0; j < 3; j++) {
+            auto w = 0.0f;
+            for (auto k = 0; k < 3; k++) {
+                w += v[i][k] * meanRadius / radius[k] * v[j][k];
+            }
+            cal.softIron[i * 3 + j] = w;
+        }
+        cal.offset[i] = c[i] / unitScale;
+    }
+    return true;
+}
+
+void MagCalibrator::apply(const float raw[3], float out[3]) const {
+    const float centred[3] = {raw[0] - cal.offset[0], raw[1] - cal.offset[1], raw[2] - cal.offset[2]};
+    for (auto i = 0; i < 3; i++) {
+        out[i] = cal.softIron[i * 3] * centred[0] + cal.softIron[i * 3 + 1] * centred[1] + cal.softIron[i * 3 + 2] * centred[2];
+    }
+}
+
+const MagCalibrator::Calibration &MagCalibrator::calibration() const {
+    return cal;
+}
+
+void MagCalibrator::setCalibration(const Calibration &calibration) {
+    cal = calibration;
+}
+
+uint32_t MagCalibrator::samples() const {
+    return taken;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Online hard and soft iron calibration of a magnetometer
+ *
+ * A perfect magnetometer turned every way traces a sphere centred on zero. Nearby iron moves the centre (hard iron)
+ * and squashes the sphere into a tilted ellipsoid (soft iron). The general ellipsoid is fit by recursive least squares,
+ * a fixed amount of work per sample, and samples are only taken when the field has turned since the last one so sitting
+ * still doesn't swamp the fit. Every so often the fit is turned into an offset and a symmetric correction matrix, which
+ * are only adopted if they look like a plausible Earth field.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class MagCalibrator {
+    public:
+        struct Calibration {
+            float offset[3];    ///< hard iron, uT
+            float softIron[9];  ///< row major, applied after removing offset
+        };
+
+        MagCalibrator();
+
+        /**
+         * @brief forget the fit, the current calibration is kept
+         *
+         */
+        void reset();
+
+        /**
+         * @brief feed a raw sample
+         *
+         * @param raw field in uT
+         * @return true the calibration was updated
+         */
+        bool add(const float raw[3]);
+
+        /**
+         * @brief correct a raw sample
+         *
+         * @param raw field in uT
+         * @param out calibrated field in uT
+         */
+        void apply(const float raw[3], float out[3]) const;
+
+        const Calibration &calibration() const;
+        void setCalibration(const Calibration &calibration);
+
+        /**
+         * @brief samples taken into the fit since reset
+         *
+         */
+        uint32_t samples() const;
+
+    private:
+        static constexpr int N = 9; // y^2 z^2 xy xz yz x y z 1
+        static constexpr float unitScale = 0.01f; // fit in gauss to keep the terms near 1
+        static constexpr float forgetting = 0.999f; // per sample taken, about 1000 directions of memory
+        static constexpr float minTurnCos = 0.996f; // ~5 degrees between samples taken
+        static constexpr uint32_t minSamples = 100;
+        static constexpr uint32_t solveEvery = 25;
+        static constexpr float minRadius = 0.1f; // gauss, plausible Earth field range with margin
+        static constexpr float maxRadius = 1.0f;
+        static constexpr float maxAxisRatio = 2.0f;
+
+        bool solve();
+
+        float theta[N];
+        float P[N][N];
+        float last[3];
+        bool haveLast;
+        uint32_t taken;
+
+        Calibration cal;
+};
@@ -9,9 +9,13 @@
 #include "sound-subystem.h"
 #include "pyrosubsystem.h"
 #include "bmi088-subsystem.h"
+#include "highg-subsystem.h"
+#include "imufusion.h"
 #include "eventmanager.h"
 #include "websubsystem.h"
 #include "ticker.h"
+#include "i2cbus.h"
+#include "datalogger.h"
 
 #include <ArduinoJson.h>
 
@@ -35,18 +39,22 @@ class StatusSpew : public TickableSubsystem {
             j->set(pkt);
         }, &json);
         serializeJsonPretty(json, LogWriter);
+        I2CBus.logStats();
+        DataLogger.logStats();
         return getStatus();
     }
 } statusSpew;
 
 
-static TickableSubsystem *SPITickers[] = {&BMI088Subsystem, NULL};
+static TickableSubsystem *SPITickers[] = {&HighGSubsystem, &BMI088Subsystem, NULL};
 static Ticker SPITicker(SPITickers, 10, "SPI Ticker", 2);
 
+// the baro and mag publish only when they have new data, so they tick faster than they convert
+static TickableSubsystem *i2cTickers[] = {&BaroSubystem, &MagSubsystem, NULL};
+static Ticker i2cTicker(i2cTickers, 5, "I2C Ticker", 2);
+
 static TickableSubsystem *slowerTickers[] = {
   &GPSSubsystem, 
-  &BaroSubystem, 
-  &MagSubsystem,
   &PyroManager, 
   &StatusManager,
   &WebSubsystem,
@@ -64,30 +72,33 @@ static void subsystemGlue() {
   BaroSubystem.registerCallback([](const BarometerData& d, void* args){
     StatusManager.setBarometerData(d);
   }, NULL);
-  BMI088Subsystem.registerCallback([](const SixFloats& f, void* args){
-    StatusManager.setIMUData(f);
+  IMUFusion.registerCallback([](const IMUBatch& batch, void* args){
+    StatusManager.setIMUData(batch.latest());
   }, NULL);
   EventManager.subscribe([](const Event &ev, void* arg) {
     switch(ev.eventType) {
+      // the SPI ticker stays at 10ms: the BMI088 FIFOs fill in ~90ms and a slower drain drops frames
       case Event::START_EVENT:
-      SPITicker.setPeriod(100);
+      i2cTicker.setPeriod(100);
       slowerTicker.setPeriod(1000);
       break;
 
       case Event::ARM_EVENT:
       // full speed
       SPITicker.setPeriod(10);
+      i2cTicker.setPeriod(5);
       slowerTicker.setPeriod(100);
       break;
 
       case Event::DISARM_EVENT:
       // Slow down, but still able to function
-      SPITicker.setPeriod(100); 
+      i2cTicker.setPeriod(100);
       slowerTicker.setPeriod(1000);
       break;
 
       case Event::LANDING_EVENT:
       SPITicker.lowPowerMode();
+      i2cTicker.lowPowerMode();
       slowerTicker.lowPowerMode();
       break;
     }
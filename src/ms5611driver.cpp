@@ -0,0 +1,194 @@
+#include "ms5611driver.h"
+
+static constexpr uint8_t CMD_RESET =        0x1E;
+static constexpr uint8_t CMD_CONVERT_D1 =   0x40; // + 2 * OSR
+static constexpr uint8_t CMD_CONVERT_D2 =   0x50; // + 2 * OSR
+static constexpr uint8_t CMD_ADC_READ =     0x00;
+static constexpr uint8_t CMD_PROM_READ =    0xA0; // + 2 * word
+
+constexpr uint16_t MS5611Driver::conversionUS[];
+
+MS5611Driver::MS5611Driver() :
+    device(NULL), osr(OSR_4096), convertingOSR(OSR_4096), state(IDLE), startedUS(0),
+    temperatureInterval(10), sinceTemperature(0), prom{}, d1(0), d2(0), lastPressure(0), lastTemperature(0), lastPressureUS(0) {
+}
+
+bool MS5611Driver::command(uint8_t cmd) {
+    return I2CBus.write(device, &cmd, 1);
+}
+
+bool MS5611Driver::readADC(uint32_t &value) {
+    if (!command(CMD_ADC_READ)) {
+        return false;
+    }
+    uint8_t buf[3];
+    if (!I2CBus.read(device, buf, sizeof(buf))) {
+        return false;
+    }
+    value = static_cast<uint32_t>(buf[0]) << 16 | static_cast<uint32_t>(buf[1]) << 8 | buf[2];
+    // 0 means the conversion was read before it finished
+    return value != 0;
+}
+
+bool MS5611Driver::checkCRC(const uint16_t prom[8]) {
+    // CRC4 from AN520, over the PROM with the CRC nibble zeroed
+    uint16_t words[8];
+    for (auto i = 0; i < 8; i++) {
+        words[i] = prom[i];
+    }
+    const uint8_t expected = words[7] & 0x0F;
+    words[7] &= 0xFF00;
+
+    uint16_t remainder = 0;
+    for (auto cnt = 0; cnt < 16; cnt++) {
+        if (cnt % 2 == 1) {
+            remainder ^= words[cnt >> 1] & 0x00FF;
+        } else {
+            remainder ^= words[cnt >> 1] >> 8;
+        }
+        for (auto bit = 8; bit > 0; bit--) {
+            if (remainder & 0x8000) {
+                remainder = (remainder << 1) ^ 0x3000;
+            } else {
+                remainder = remainder << 1;
+            }
+        }
+    }
+    return ((remainder >> 12) & 0x0F) == expected;
+}
+
+bool MS5611Driver::begin(I2CBusClass::Device newDevice) {
+    device = newDevice;
+    if (device == NULL) {
+        return false;
+    }
+    if (!command(CMD_RESET)) {
+        return false;
+    }
+    delay(3);
+
+    // the PROM doesn't auto-increment, each word is its own command and read
+    uint8_t buf[8][2];
+    I2CBusClass::Read reads[8];
+    for (auto i = 0; i < 8; i++) {
+        reads[i] = {static_cast<uint8_t>(CMD_PROM_READ + 2 * i), buf[i], sizeof(buf[i])};
+    }
+    if (!I2CBus.readBatch(device, reads, 8)) {
+        return false;
+    }
+    for (auto i = 0; i < 8; i++) {
+        prom[i] = buf[i][0] << 8 | buf[i][1];
+    }
+    state = IDLE;
+    return checkCRC(prom);
+}
+
+void MS5611Driver::setOversampling(OSR newOSR) {
+    osr = newOSR;
+}
+
+MS5611Driver::OSR MS5611Driver::getOversampling() const {
+    return osr;
+}
+
+void MS5611Driver::setTemperatureInterval(uint8_t every) {
+    temperatureInterval = every > 0 ? every : 1;
+}
+
+bool MS5611Driver::startConversion(State next, uint64_t nowUS) {
+    const uint8_t base = next == CONVERTING_TEMPERATURE ? CMD_CONVERT_D2 : CMD_CONVERT_D1;
+    if (!command(base + 2 * osr)) {
+        state = IDLE;
+        return false;
+    }
+    convertingOSR = osr;
+    state = next;
+    startedUS = nowUS;
+    return true;
+}
+
+MS5611Driver::Result MS5611Driver::poll(uint64_t nowUS) {
+    if (state != IDLE && nowUS - startedUS < conversionUS[convertingOSR]) {
+        return BUSY;
+    }
+    // read the finished conversion and start the next without giving up the bus in between
+    if (!I2CBus.acquire(device)) {
+        return BUSY;
+    }
+    const auto result = advance(nowUS);
+    I2CBus.release(device);
+    return result;
+}
+
+MS5611Driver::Result MS5611Driver::advance(uint64_t nowUS) {
+    uint32_t value;
+
+    switch (state) {
+        case IDLE:
+            // need a temperature before the first pressure can be compensated
+            return startConversion(CONVERTING_TEMPERATURE, nowUS) ? BUSY : ERROR;
+
+        case CONVERTING_TEMPERATURE:
+            if (!readADC(value)) {
+                state = IDLE;
+                return ERROR;
+            }
+            d2 = value;
+            sinceTemperature = 0;
+            return startConversion(CONVERTING_PRESSURE, nowUS) ? NEW_TEMPERATURE : ERROR;
+
+        case CONVERTING_PRESSURE:
+            if (!readADC(value)) {
+                state = IDLE;
+                return ERROR;
+            }
+            d1 = value;
+            lastPressureUS = startedUS + conversionUS[convertingOSR] / 2;
+            compensate();
+            sinceTemperature++;
+            if (!startConversion(sinceTemperature >= temperatureInterval ? CONVERTING_TEMPERATURE : CONVERTING_PRESSURE, nowUS)) {
+                return ERROR;
+            }
+            return NEW_PRESSURE;
+    }
+    return ERROR;
+}
+
+void MS5611Driver::compensate() {
+    // first and second order compensation from the datasheet
+    const int64_t dT = static_cast<int64_t>(d2) - (static_cast<int64_t>(prom[5]) << 8);
+    int64_t temp = 2000 + ((dT * prom[6]) >> 23);
+    int64_t off = (static_cast<int64_t>(prom[2]) << 16) + ((prom[4] * dT) >> 7);
+    int64_t sens = (static_cast<int64_t>(prom[1]) << 15) + ((prom[3] * dT) >> 8);
+
+    if (temp < 2000) {
+        const int64_t t2 = (dT * dT) >> 31;
+        const int64_t cold = (temp - 2000) * (temp - 2000);
+        int64_t off2 = 5 * cold / 2;
+        int64_t sens2 = 5 * cold / 4;
+        if (temp < -1500) {
+            const int64_t veryCold = (temp + 1500) * (temp + 1500);
+            off2 += 7 * veryCold;
+            sens2 += 11 * veryCold / 2;
+        }
+        temp -= t2;
+        off -= off2;
+        sens -= sens2;
+    }
+
+    const int64_t p = (((d1 * sens) >> 21) - off) >> 15; // 0.01 hPa
+    lastPressure = p / 100.0f;
+    lastTemperature = temp / 100.0f;
+}
+
+float MS5611Driver::pressure() const {
+    return lastPressure;
+}
+
+float MS5611Driver::temperature() const {
+    return lastTemperature;
+}
+
+uint64_t MS5611Driver::pressureTime() const {
+    return lastPressureUS;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include "i2cbus.h"
+
+/**
+ * @brief Split phase MS5611 driver
+ *
+ * The MS5611 needs a pressure (D1) and a temperature (D2) ADC conversion per reading, each taking up to 9ms. Instead
+ * of waiting for them, poll() starts a conversion and returns, and on a later call reads the result and starts the
+ * next one. The I2C bus is only held for the few bytes of each read and command. Temperature changes slowly, so it is only
+ * converted every few pressure readings.
+ *
+ */
+class MS5611Driver {
+    public:
+        enum OSR : uint8_t {
+            OSR_256,
+            OSR_512,
+            OSR_1024,
+            OSR_2048,
+            OSR_4096
+        };
+
+        enum Result {
+            BUSY,               ///< conversion still running, or nothing new
+            NEW_PRESSURE,       ///< pressure() and temperature() updated
+            NEW_TEMPERATURE,    ///< temperature conversion read, pressure comes next
+            ERROR               ///< bus error, the state machine restarts
+        };
+
+        MS5611Driver();
+
+        /**
+         * @brief reset the sensor and read its calibration
+         *
+         * @param device the sensor on I2CBus
+         * @return true found, calibration CRC good
+         */
+        bool begin(I2CBusClass::Device device);
+
+        /**
+         * @brief oversampling for conversions started from now on
+         *
+         */
+        void setOversampling(OSR osr);
+        OSR getOversampling() const;
+
+        /**
+         * @brief convert temperature once every this many pressure readings
+         *
+         */
+        void setTemperatureInterval(uint8_t every);
+
+        /**
+         * @brief advance the conversion state machine, call as often as you like
+         *
+         * @param nowUS timestampUS()
+         * @return Result what happened
+         */
+        Result poll(uint64_t nowUS);
+
+        float pressure() const; // hPa
+        float temperature() const; // C
+
+        /**
+         * @brief when the last pressure was sampled, the middle of its conversion
+         *
+         * @return uint64_t timestampUS()
+         */
+        uint64_t pressureTime() const;
+
+    private:
+        static constexpr uint16_t conversionUS[] = {600, 1170, 2280, 4540, 9040}; // max, per OSR
+
+        enum State : uint8_t {
+            IDLE,
+            CONVERTING_PRESSURE,
+            CONVERTING_TEMPERATURE
+        };
+
+        bool command(uint8_t cmd);
+        bool readADC(uint32_t &value);
+        bool startConversion(State next, uint64_t nowUS);
+        Result advance(uint64_t nowUS);
+        void compensate();
+        static bool checkCRC(const uint16_t prom[8]);
+
+        I2CBusClass::Device device;
+        OSR osr;
+        OSR convertingOSR;
+        State state;
+        uint64_t startedUS;
+        uint8_t temperatureInterval;
+        uint8_t sinceTemperature;
+
+        uint16_t prom[8];
+        uint32_t d1;
+        uint32_t d2;
+        float lastPressure;
+        float lastTemperature;
+        uint64_t lastPressureUS;
+};
@@ -62,6 +62,12 @@ bool convertToJson(const GPSFix& src, JsonVariant dst) {
     dst["lat"] = GPSFix::degToDouble(src.latitude);
     dst["lng"] = GPSFix::degToDouble(src.longitude);
     dst["alt"] = src.altitude / 1000.0;
+    dst["hAcc"] = src.hAcc / 1000.0;
+    dst["vAcc"] = src.vAcc / 1000.0;
+    dst["velN"] = src.velN / 1000.0;
+    dst["velE"] = src.velE / 1000.0;
+    dst["velD"] = src.velD / 1000.0;
+    dst["sAcc"] = src.sAcc / 1000.0;
     dst["time"] = src.epoch;
     const char* fixType;
     // 0=no fix, 1=dead reckoning, 2=2D, 3=3D, 4=GNSS, 5=Time fix
@@ -28,11 +28,14 @@ struct __attribute__((packed)) Packet
         RELAY_MESSAGE = 6,
         LOST_ROCKET_MESSAGE = 7
     };
+    // set while the part is healthy
     enum Status : uint16_t
     {
         GPS_STATUS = (1 << 0),
         IMU_STATUS = (1 << 1),
         FLASH_STATUS = (1 << 2),
+        MAG_STATUS = (1 << 3),
+        HIGH_G_STATUS = (1 << 4),
         RADIO_STATUS = (1 << 6),
         BATTERY_STATUS = (1 << 7),
         BAROMETER_STATUS = (1 << 10),
@@ -77,6 +80,13 @@ struct __attribute__((packed)) GPSFix
     uint32_t epoch;
     uint8_t fixType;
     uint8_t sats;
+    uint32_t hAcc; // horizontal accuracy estimate, mm
+    uint32_t vAcc; // vertical accuracy estimate, mm
+    int32_t velN; // NED velocity, mm/s
+    int32_t velE;
+    int32_t velD;
+    uint32_t sAcc; // speed accuracy estimate, mm/s
+    uint64_t time; // timestampUS() when the fix was read off the bus
 
     static double degToDouble(int32_t deg);
 };
@@ -126,7 +136,7 @@ struct __attribute__((packed)) MemoryStats {
 bool convertToJson(const MemoryStats& src, JsonVariant dst);
 
 
-// 110 bytes
+// 142 bytes
 struct __attribute__((packed)) StatusPacket
 {
     uint32_t timestamp; // millis() when this was generated
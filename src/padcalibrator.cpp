@@ -0,0 +1,73 @@
+#include "padcalibrator.h"
+#include <math.h>
+
+static constexpr float RAD_TO_DEGREES = 57.29578f;
+
+// the board's long axis is Y (gyro Y is roll)
+static constexpr int longAxis = 1;
+
+PadCalibrator::PadCalibrator() : baro(baroWindow), gps(gpsWindow), acc{RunningStats(accWindow), RunningStats(accWindow), RunningStats(accWindow)} {
+}
+
+void PadCalibrator::reset() {
+    baro.reset();
+    gps.reset();
+    for (auto &axis : acc) {
+        axis.reset();
+    }
+}
+
+void PadCalibrator::addBaro(float altitude) {
+    baro.add(altitude);
+}
+
+void PadCalibrator::addGPS(float altitude) {
+    gps.add(altitude);
+}
+
+void PadCalibrator::addAcc(const float sample[3]) {
+    for (auto i = 0; i < 3; i++) {
+        acc[i].add(sample[i]);
+    }
+}
+
+bool PadCalibrator::haveBaro() const {
+    return baro.count() == baroWindow;
+}
+
+bool PadCalibrator::haveGPS() const {
+    return gps.count() == gpsWindow;
+}
+
+bool PadCalibrator::haveAcc() const {
+    return acc[0].count() == accWindow;
+}
+
+float PadCalibrator::baroAltitude() const {
+    return baro.mean();
+}
+
+float PadCalibrator::gpsAltitude() const {
+    return gps.mean();
+}
+
+bool PadCalibrator::still() const {
+    for (const auto &axis : acc) {
+        if (axis.stddev() > maxStillAccSD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float PadCalibrator::tiltDegrees() const {
+    const auto x = acc[0].mean();
+    const auto y = acc[1].mean();
+    const auto z = acc[2].mean();
+    const auto norm = sqrtf(x * x + y * y + z * z);
+    if (norm == 0) {
+        return 90;
+    }
+    // either end of the axis may be up depending on how the board is mounted
+    return acosf(fabsf(acc[longAxis].mean()) / norm) * RAD_TO_DEGREES;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "runningstats.h"
+
+/**
+ * @brief Ground reference statistics gathered while sitting on the pad
+ *
+ * Keeps running mean and variance of baro altitude, GPS altitude and the accelerometer gravity vector, so arming
+ * takes its ground levels from a few seconds of data rather than from whatever sample happened to be last, and can
+ * tell whether the rocket is still and pointing up.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class PadCalibrator {
+    public:
+        PadCalibrator();
+
+        void reset();
+
+        /**
+         * @brief feed a baro altitude
+         *
+         * @param altitude m
+         */
+        void addBaro(float altitude);
+
+        /**
+         * @brief feed a GPS altitude from a 3D fix
+         *
+         * @param altitude m
+         */
+        void addGPS(float altitude);
+
+        /**
+         * @brief feed an accelerometer sample
+         *
+         * @param acc specific force in m/s^2, body frame
+         */
+        void addAcc(const float acc[3]);
+
+        bool haveBaro() const;
+        bool haveGPS() const;
+        bool haveAcc() const;
+
+        float baroAltitude() const;
+        float gpsAltitude() const;
+
+        /**
+         * @brief is the accelerometer quiet enough to call the rocket still
+         *
+         */
+        bool still() const;
+
+        /**
+         * @brief angle between the long axis and vertical
+         *
+         * @return float degrees
+         */
+        float tiltDegrees() const;
+
+    private:
+        static constexpr uint32_t baroWindow = 50; // 5s at 10Hz
+        static constexpr uint32_t gpsWindow = 50; // 5s at 10Hz
+        static constexpr uint32_t accWindow = 640; // ~2s of IMU frames as thinned out while disarmed
+        static constexpr float maxStillAccSD = 0.5f; // m/s^2, per axis
+
+        RunningStats baro;
+        RunningStats gps;
+        RunningStats acc[3];
+};
@@ -0,0 +1,259 @@
+#include "partitionlogstorage.h"
+#include "timebase.h"
+#include "log.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+PartitionLogStorage::PartitionLogStorage() : partition(nullptr), layout(0), current{}, isOpen(false), head(0),
+    erasedUntil(0), keepFrom(0), nextOrdinal(1), erases(0), inlineErases(0), droppedWrites(0), maxEraseMicros(0) {
+}
+
+bool PartitionLogStorage::begin() {
+    FlightEntry latest;
+    bool found = false;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        static_cast<esp_partition_subtype_t>(LogPartition::SUBTYPE), LogPartition::LABEL);
+    if (partition == nullptr) {
+        return false;
+    }
+    layout = LogPartition(partition->size);
+
+    for (uint32_t slot = 0; slot < LogPartition::MAX_ENTRIES; slot++) {
+        FlightEntry entry;
+        if (readEntry(slot, entry) && LogPartition::valid(entry) && (!found || entry.ordinal > latest.ordinal)) {
+            latest = entry;
+            found = true;
+        }
+    }
+
+    if (found) {
+        nextOrdinal = latest.ordinal + 1;
+        keepFrom = latest.start;
+        if (latest.end == LogPartition::ERASED) {
+            // power went while it was logging, keep what was written whole and seal it
+            latest.end = findEnd(latest.start);
+            esp_partition_write(partition, layout.entryOffset(latest.ordinal) + offsetof(FlightEntry, end),
+                &latest.end, sizeof(latest.end));
+            Log.noticeln("datalogger: recovered flight %lu left open, %luKB", (unsigned long)latest.ordinal,
+                (unsigned long)((latest.end - latest.start) / 1024));
+        }
+        head = latest.end;
+    }
+    // pick up what was erased ahead before the reboot, so the flights it took stay forgotten
+    erasedUntil = head;
+    while (erasedUntil < head + ERASE_AHEAD &&
+        erasedUntil + LogPartition::SECTOR_SIZE <= keepFrom + layout.dataSize() &&
+        blank(layout.dataOffset(erasedUntil), LogPartition::SECTOR_SIZE)) {
+        erasedUntil += LogPartition::SECTOR_SIZE;
+    }
+
+    Log.noticeln("datalogger: logging to the %luKB flightlog partition, next flight %lu",
+        (unsigned long)(layout.dataSize() / 1024), (unsigned long)nextOrdinal);
+    return true;
+}
+
+bool PartitionLogStorage::open(uint32_t epoch) {
+    close();
+
+    current.magic = LogPartition::ENTRY_MAGIC;
+    current.ordinal = nextOrdinal++;
+    current.epoch = epoch;
+    current.reserved = ~0u;
+    current.start = head;
+    current.end = LogPartition::ERASED;
+
+    // moving into the next sector of the ring forgets the flights it held a lap ago
+    const auto slot = current.ordinal % LogPartition::MAX_ENTRIES;
+    const auto offset = layout.entryOffset(current.ordinal);
+    const auto sector = offset / LogPartition::SECTOR_SIZE * LogPartition::SECTOR_SIZE;
+    if ((slot % LogPartition::ENTRIES_PER_SECTOR == 0 && !blank(sector, LogPartition::SECTOR_SIZE)) ||
+        !blank(offset, sizeof(current))) {
+        esp_partition_erase_range(partition, sector, LogPartition::SECTOR_SIZE);
+    }
+    if (esp_partition_write(partition, offset, &current, sizeof(current)) != ESP_OK) {
+        Log.errorln("datalogger: could not write flight entry");
+        return false;
+    }
+
+    isOpen = true;
+    keepFrom = current.start;
+    Log.noticeln("datalogger: logging flight %lu", (unsigned long)current.ordinal);
+    return true;
+}
+
+size_t PartitionLogStorage::write(const uint8_t *data, size_t length, bool flying) {
+    size_t done = 0;
+    if (!isOpen) {
+        return 0;
+    }
+    // a flight can't overwrite its own start
+    if (head + length - current.start > layout.dataSize()) {
+        return 0;
+    }
+
+    // an erase takes tens of ms, in flight that would back up the buffers and lose more than this write
+    if (flying && erasedUntil < head + length) {
+        droppedWrites++;
+        return 0;
+    }
+    while (erasedUntil < head + length) {
+        inlineErases++;
+        eraseNext();
+    }
+    while (done < length) {
+        auto n = length - done;
+        if (n > layout.contiguous(head)) {
+            n = layout.contiguous(head);
+        }
+        if (esp_partition_write(partition, layout.dataOffset(head), data + done, n) != ESP_OK) {
+            break;
+        }
+        head += n;
+        done += n;
+    }
+    return done;
+}
+
+void PartitionLogStorage::close() {
+    if (!isOpen) {
+        return;
+    }
+    current.end = head;
+    esp_partition_write(partition, layout.entryOffset(current.ordinal) + offsetof(FlightEntry, end),
+        &current.end, sizeof(current.end));
+    isOpen = false;
+}
+
+bool PartitionLogStorage::maintain(bool flying, bool) {
+    if (flying || erasedUntil >= head + ERASE_AHEAD ||
+        erasedUntil + LogPartition::SECTOR_SIZE > keepFrom + layout.dataSize()) {
+        return false;
+    }
+    eraseNext();
+    return true;
+}
+
+size_t PartitionLogStorage::flights(LogFlight *out, size_t max) {
+    size_t count = 0;
+    for (uint32_t slot = 0; slot < LogPartition::MAX_ENTRIES && count < max; slot++) {
+        FlightEntry entry;
+        if (!readEntry(slot, entry) || !LogPartition::valid(entry) || !layout.intact(entry, erasedUntil)) {
+            continue;
+        }
+        LogFlight flight;
+        flight.ordinal = entry.ordinal;
+        flight.epoch = entry.epoch;
+        flight.bytes = (entry.end == LogPartition::ERASED ? head : entry.end) - entry.start;
+        flight.open = isOpen && entry.ordinal == current.ordinal;
+
+        auto i = count++;
+        for (; i > 0 && out[i - 1].ordinal > flight.ordinal; i--) {
+            out[i] = out[i - 1];
+        }
+        out[i] = flight;
+    }
+    return count;
+}
+
+size_t PartitionLogStorage::read(uint32_t ordinal, size_t offset, uint8_t *out, size_t length) {
+    FlightEntry entry;
+    if (!findEntry(ordinal, entry)) {
+        return 0;
+    }
+    const auto end = entry.end == LogPartition::ERASED ? head : entry.end;
+    const auto position = entry.start + offset;
+    if (position >= end) {
+        return 0;
+    }
+    if (length > end - position) {
+        length = end - position;
+    }
+    if (length > layout.contiguous(position)) {
+        length = layout.contiguous(position);
+    }
+    if (esp_partition_read(partition, layout.dataOffset(position), out, length) != ESP_OK) {
+        return 0;
+    }
+    return length;
+}
+
+void PartitionLogStorage::logStats() {
+    Log.noticeln("datalogger: partition at %luKB, %luKB erased ahead, %lu erases max %luus, %lu while logging, "
+        "%lu writes dropped in flight", (unsigned long)(head / 1024), (unsigned long)((erasedUntil - head) / 1024),
+        erases, maxEraseMicros, inlineErases, droppedWrites);
+}
+
+bool PartitionLogStorage::readEntry(uint32_t slot, FlightEntry &entry) {
+    return esp_partition_read(partition, slot * sizeof(entry), &entry, sizeof(entry)) == ESP_OK;
+}
+
+/**
+ * @brief find a flight that hasn't been overwritten, or erased ahead of being overwritten
+ *
+ */
+bool PartitionLogStorage::findEntry(uint32_t ordinal, FlightEntry &entry) {
+    return readEntry(ordinal % LogPartition::MAX_ENTRIES, entry) && LogPartition::valid(entry) &&
+        entry.ordinal == ordinal && layout.intact(entry, erasedUntil);
+}
+
+/**
+ * @brief find the end of the sealed blocks of a flight
+ *
+ * Stops at the first block that was cut short, never written or is left over from an older flight, none of which
+ * carry the right commit.
+ */
+uint64_t PartitionLogStorage::findEnd(uint64_t start) {
+    uint32_t id = 0;
+    auto position = start;
+    auto block = static_cast<uint8_t*>(malloc(LogPartition::SECTOR_SIZE));
+    if (block == nullptr) {
+        goto out;
+    }
+    for (uint32_t sequence = 0; position - start < layout.dataSize(); sequence++) {
+        if (esp_partition_read(partition, layout.dataOffset(position), block, LogPartition::SECTOR_SIZE) != ESP_OK ||
+            (sequence == 0 && !logId(block, id)) || !logSealed(block, id, sequence)) {
+            break;
+        }
+        position += LogPartition::SECTOR_SIZE;
+    }
+
+out:
+    free(block);
+    return position;
+}
+
+bool PartitionLogStorage::blank(size_t offset, size_t length) {
+    uint8_t chunk[256];
+    for (size_t done = 0; done < length; done += sizeof(chunk)) {
+        const auto n = length - done < sizeof(chunk) ? length - done : sizeof(chunk);
+        if (esp_partition_read(partition, offset + done, chunk, n) != ESP_OK) {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (chunk[i] != 0xFF) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief erase the sector at erasedUntil, unless it already is
+ *
+ */
+void PartitionLogStorage::eraseNext() {
+    const auto offset = layout.dataOffset(erasedUntil);
+    if (!blank(offset, LogPartition::SECTOR_SIZE)) {
+        const auto startUS = timestampUS();
+        esp_partition_erase_range(partition, offset, LogPartition::SECTOR_SIZE);
+        const auto micros = static_cast<uint32_t>(timestampUS() - startUS);
+        erases++;
+        if (micros > maxEraseMicros) {
+            maxEraseMicros = micros;
+        }
+    }
+    erasedUntil += LogPartition::SECTOR_SIZE;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "logstorage.h"
+#include "logpartition.h"
+#include "logformat.h"
+#include <esp_partition.h>
+
+/**
+ * @brief Flight logs written straight to the flightlog partition, no filesystem
+ *
+ * Blocks go to sequential sectors of the partition's data ring with esp_partition_write, so an append costs the same
+ * every time: no metadata commits, no allocation. Erasing is what is slow, so while disarmed or on the pad the
+ * sectors ahead of the write position are erased, up to a minute of flight at full rate. Nothing is erased in flight:
+ * a flight that outruns the erased sectors has its writes dropped, which is counted. On the ground a write erases
+ * what it needs inline.
+ *
+ * Flights are tracked in the partition's header ring, see LogPartition. A flight left open by a power loss is found
+ * at boot and closed after its last sealed block. Whatever was half written after that is erased before it is
+ * written over, like any other sector that isn't blank.
+ *
+ */
+class PartitionLogStorage : public LogStorage {
+    public:
+        PartitionLogStorage();
+
+        bool begin();
+        bool open(uint32_t epoch);
+        size_t write(const uint8_t *data, size_t length, bool flying);
+        void close();
+        bool maintain(bool flying, bool armed);
+        size_t flights(LogFlight *out, size_t max);
+        size_t read(uint32_t ordinal, size_t offset, uint8_t *out, size_t length);
+        void logStats();
+
+    private:
+        static constexpr size_t ERASE_AHEAD = 1024 * 1024;
+
+        const esp_partition_t *partition;
+        LogPartition layout;
+        FlightEntry current;
+        bool isOpen;
+        uint64_t head;              // position of the next write
+        uint64_t erasedUntil;       // from head up to here is erased, flights from a lap before it are gone
+        uint64_t keepFrom;          // start of the newest flight, erasing ahead stops short of it
+        uint32_t nextOrdinal;
+
+        uint32_t erases;
+        uint32_t inlineErases;      // erases a write had to wait for, on the ground
+        uint32_t droppedWrites;     // in flight, for want of erased sectors
+        uint32_t maxEraseMicros;
+
+        bool readEntry(uint32_t slot, FlightEntry &entry);
+        bool findEntry(uint32_t ordinal, FlightEntry &entry);
+        uint64_t findEnd(uint64_t start);
+        bool blank(size_t offset, size_t length);
+        void eraseNext();
+};
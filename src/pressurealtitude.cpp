@@ -0,0 +1,128 @@
+#include "pressurealtitude.h"
+#include <math.h>
+
+// ISA constants
+static constexpr double P0 = 1013.25;           // hPa, sea level
+static constexpr double T0 = 288.15;            // K, sea level
+static constexpr double L0 = 0.0065;            // K/m, troposphere lapse rate
+static constexpr double T11 = 216.65;           // K, 11-20km
+static constexpr double L20 = -0.001;           // K/m, 20-32km lapse rate (warming)
+static constexpr double RgM = 8.31446 / (9.80665 * 0.0289644); // R/(g*M) in K/m
+
+// constexpr math, only used to build the table at compile time
+static constexpr double ceLog(double x) {
+    // x = m * 2^k, then ln(m) = 2*atanh((m-1)/(m+1)) which converges quickly for m near 1
+    double k = 0;
+    while (x > 1.5) {
+        x /= 2;
+        k++;
+    }
+    while (x < 0.75) {
+        x *= 2;
+        k--;
+    }
+    const double y = (x - 1) / (x + 1);
+    const double y2 = y * y;
+    double term = y;
+    double sum = 0;
+    for (int n = 1; n < 40; n += 2) {
+        sum += term / n;
+        term *= y2;
+    }
+    return 2 * sum + k * 0.6931471805599453;
+}
+
+static constexpr double ceExp(double x) {
+    // exp(x) = exp(x/2^k)^(2^k)
+    int k = 0;
+    while (x > 0.5 || x < -0.5) {
+        x /= 2;
+        k++;
+    }
+    double term = 1;
+    double sum = 1;
+    for (int n = 1; n < 20; n++) {
+        term *= x / n;
+        sum += term;
+    }
+    for (int i = 0; i < k; i++) {
+        sum *= sum;
+    }
+    return sum;
+}
+
+static constexpr double cePow(double a, double b) {
+    return ceExp(b * ceLog(a));
+}
+
+// layer base pressures derived from the layers below, so the layers join without a step
+static constexpr double P11 = P0 * cePow(T11 / T0, 1 / (RgM * L0)); // hPa at 11km
+static constexpr double P20 = P11 * ceExp(-9000 / (RgM * T11)); // hPa at 20km
+
+static constexpr double isaAltitude(double hPa) {
+    if (hPa >= P11) {
+        return T0 / L0 * (1 - cePow(hPa / P0, RgM * L0));
+    }
+    if (hPa >= P20) {
+        return 11000 + RgM * T11 * ceLog(P11 / hPa);
+    }
+    return 20000 + T11 / L20 * (1 - cePow(hPa / P20, RgM * L20));
+}
+
+// p = m * 2^e with m in [0.5, 1). Octaves e = 4 (8-16 hPa, ~32 km) to 11 (1024-2048 hPa, below sea level).
+static constexpr int minExponent = 4;
+static constexpr int maxExponent = 11;
+static constexpr int octaves = maxExponent - minExponent + 1;
+static constexpr int segments = 128; // per octave
+static constexpr float minhPa = 1 << (minExponent - 1);
+static constexpr float maxhPa = 1 << maxExponent;
+
+struct AltitudeTable {
+    // the last point of an octave is the first of the next, so the octaves share endpoints
+    float altitude[octaves * segments + 1];
+
+    constexpr AltitudeTable() : altitude{} {
+        for (int o = 0; o < octaves; o++) {
+            const double scale = static_cast<double>(1 << (minExponent + o));
+            for (int i = 0; i < segments; i++) {
+                const double m = 0.5 + 0.5 * i / segments;
+                altitude[o * segments + i] = isaAltitude(m * scale);
+            }
+        }
+        altitude[octaves * segments] = isaAltitude(maxhPa);
+    }
+};
+
+static constexpr AltitudeTable table;
+
+float PressureAltitude::standard(float hPa) {
+    if (hPa < minhPa) {
+        hPa = minhPa;
+    } else if (hPa >= maxhPa) {
+        hPa = maxhPa * 0.99999f;
+    }
+
+    int e;
+    const auto m = frexpf(hPa, &e);
+    const auto pos = (m - 0.5f) * (2 * segments);
+    const int i = pos;
+    const auto index = (e - minExponent) * segments + i;
+    const auto lo = table.altitude[index];
+    const auto hi = table.altitude[index + 1];
+    return lo + (pos - i) * (hi - lo);
+}
+
+float PressureAltitude::altitude(float hPa, float qnhhPa) {
+    // as an altimeter does: shift the standard atmosphere so that QNH reads zero
+    return standard(hPa) - standard(qnhhPa);
+}
+
+float PressureAltitude::exact(float hPa) {
+    if (hPa >= P11) {
+        return T0 / L0 * (1 - pow(hPa / P0, RgM * L0));
+    }
+    if (hPa >= P20) {
+        return 11000 + RgM * T11 * log(P11 / hPa);
+    }
+    return 20000 + T11 / L20 * (1 - pow(hPa / P20, RgM * L20));
+}
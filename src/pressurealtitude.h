@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Pressure to altitude in the International Standard Atmosphere, 0-32 km
+ *
+ * The ISA has a lapse rate layer to 11 km, an isothermal layer to 20 km and a warming layer above, so a single
+ * powf() is only right in the first one. Altitude is very nearly linear in log pressure, so the table is segmented
+ * by octave of pressure, picked with frexpf(), and linearly spaced within each octave. The table is computed at
+ * compile time and a conversion is a frexpf(), a multiply and an interpolation. Worst case error against the exact
+ * ISA is a few cm.
+ *
+ */
+class PressureAltitude {
+    public:
+        static constexpr float standardhPa = 1013.25f;
+
+        /**
+         * @brief ISA pressure altitude, from the table
+         *
+         * @param hPa static pressure
+         * @return float geopotential altitude above standard sea level, m
+         */
+        static float standard(float hPa);
+
+        /**
+         * @brief altitude above sea level for a given altimeter setting
+         *
+         * @param hPa static pressure
+         * @param qnhhPa sea level pressure (QNH)
+         * @return float m
+         */
+        static float altitude(float hPa, float qnhhPa = standardhPa);
+
+        /**
+         * @brief ISA pressure altitude computed directly, slow, for checking the table
+         *
+         * @param hPa static pressure
+         * @return float m
+         */
+        static float exact(float hPa);
+};
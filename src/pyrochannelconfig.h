@@ -55,6 +55,14 @@ struct __attribute__((packed)) PyroChannelConfig {
      *
      */
     uint16_t airStartLockoutVelocity;
+
+    /**
+     * @brief confidence in percent a predicted apogee needs to schedule a DROUGE_CHANNEL at it; 0 to disable
+     *
+     * When disabled or never confident enough, the channel fires on the detected apogee as before.
+     *
+     */
+    uint8_t apogeePredictConfidence;
 };
 
 bool convertToJson(const PyroChannelConfig &src, JsonVariant dst);
@@ -20,6 +20,7 @@ static constexpr char BURNOUT_NUM_STR[] =       "burnoutNum";
 static constexpr char AIRSTART_ALT_STR[]  =     "airstartAlt";
 static constexpr char AIRSTART_ANGL_STR[] =     "airstartAngle";
 static constexpr char AIRSTART_VEL_STR[] =      "airstartVel";
+static constexpr char PREDICT_CONF_STR[] =      "predictConf";
 
 static constexpr char DISABLED_CHAN_STR[] =     "disabled";
 static constexpr char DROGUE_CHAN_STR[] =       "drogue";
@@ -82,6 +83,7 @@ bool convertToJson(const PyroChannelConfig &src, JsonVariant dst) {
     dst[AIRSTART_ALT_STR] = src.airStartLockoutAltitude;
     dst[AIRSTART_ANGL_STR] = src.airStartLockoutAngle;
     dst[AIRSTART_VEL_STR] = src.airStartLockoutVelocity;
+    dst[PREDICT_CONF_STR] = src.apogeePredictConfidence;
     return true;
 }
 
@@ -107,11 +109,14 @@ void convertFromJson(JsonVariantConst src, PyroChannelConfig &dst) {
     if (src[AIRSTART_VEL_STR].is<int>()) {
         dst.airStartLockoutVelocity = src[AIRSTART_VEL_STR].as<decltype(dst.airStartLockoutVelocity)>();
     }
+    if (src[PREDICT_CONF_STR].is<int>()) {
+        dst.apogeePredictConfidence = src[PREDICT_CONF_STR].as<decltype(dst.apogeePredictConfidence)>();
+    }
 }
 
 PyroManagerClass::PyroManagerClass() : pyroChannels{&ChannelOne, &ChannelTwo, /* &ChannelThree, */ NULL},
     numPyroChannels(0), liftOffDetected(false), apogeeDetected(false), pyroArmed(false),
-    indicators(numLED, LED_DATA, LED_CLK, DOTSTAR_BGR) {
+    indicators(numLED, LED_DATA, LED_CLK, DOTSTAR_BGR), scheduleTimer(nullptr) {
     name = "pyroManager";
     static BaseSubsystem* deps[] = {&EventManager, &StatusManager, &ConfigManager, &LogWriter, NULL};
     static SubsystemManagerClass::Spec spec(this, deps);
@@ -131,7 +136,23 @@ PyroManagerClass::~PyroManagerClass() {
 
 BaseSubsystem::Status PyroManagerClass::setup() {
     // TODO: consider if pyromanager should care about lowpower
-    auto eventMask = Event::ARM_EVENT | Event::DISARM_EVENT | Event::LIFTOFF_EVENT | Event::BURNOUT_EVENT | Event::BURNOUT_EVENT | Event::LANDING_EVENT;
+    auto eventMask = Event::ARM_EVENT | Event::DISARM_EVENT | Event::LIFTOFF_EVENT | Event::BURNOUT_EVENT |
+        Event::AIRSTART_EVENT | Event::APOGEE_PREDICTED_EVENT | Event::APOGEE_EVENT | Event::LANDING_EVENT;
+
+    // the slower ticker runs at 100ms, which is too coarse to hit a predicted apogee, so schedules get their own timer
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = [](void *p) {
+        auto self = static_cast<PyroManagerClass*>(p);
+        self->tickSchedule();
+        self->armScheduleTimer();
+    };
+    timerArgs.arg = this;
+    timerArgs.name = "pyroSchedule";
+    if (esp_timer_create(&timerArgs, &scheduleTimer) != ESP_OK) {
+        Log.errorln("couldn't create pyro schedule timer");
+        setStatus(FAULT);
+        return getStatus();
+    }
 
     rwLock.Lock();
 
@@ -152,9 +173,18 @@ BaseSubsystem::Status PyroManagerClass::setup() {
                 break;
 
             case Event::BURNOUT_EVENT:
+                self->onBoostPhase();
                 self->onBurnout(event);
                 break;
 
+            case Event::AIRSTART_EVENT:
+                self->onBoostPhase();
+                break;
+
+            case Event::APOGEE_PREDICTED_EVENT:
+                self->onApogeePredicted(event);
+                break;
+
             case Event::APOGEE_EVENT:
                 self->onApogee();
                 break;
@@ -248,6 +278,42 @@ void PyroManagerClass::tickFiringDelay() {
     }
 }
 
+void PyroManagerClass::tickSchedule() {
+    if (armed() && liftedOff()) {
+        forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
+            if (chan->scheduleExpired()) {
+                chan->scheduledMS = 0;
+                // no delay means the prediction is the deployment time, don't wait for the next tick to fire
+                if (chan->config.delaySeconds == 0) {
+                    chan->startFiring();
+                } else {
+                    chan->startFiringDelay();
+                }
+            }
+        }, NULL);
+    }
+}
+
+void PyroManagerClass::armScheduleTimer() {
+    esp_timer_stop(scheduleTimer); // not running is fine
+    if (!armed() || !liftedOff()) {
+        return; // tickSchedule() won't clear anything, don't spin on it
+    }
+
+    uint32_t earliest = 0;
+    forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
+        auto earliest = static_cast<uint32_t*>(ctx);
+        if (chan->scheduledMS != 0 && (*earliest == 0 || static_cast<int32_t>(chan->scheduledMS - *earliest) < 0)) {
+            *earliest = chan->scheduledMS;
+        }
+    }, &earliest);
+    if (earliest == 0) {
+        return;
+    }
+    const auto untilMS = static_cast<int32_t>(earliest - millis());
+    esp_timer_start_once(scheduleTimer, untilMS > 0 ? static_cast<uint64_t>(untilMS) * 1000 : 0);
+}
+
 void PyroManagerClass::tickContinuityChanges() {
     forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
         chan->checkContinuity();
@@ -277,10 +343,15 @@ bool PyroManagerClass::armed() const {
 
 void PyroManagerClass::onArmed() {
     rwLock.Lock();
+    forEachChanNoLock([](PyroChannel *chan, size_t i, PyroManagerClass *self, void *p) {
+        chan->deployed = false;
+        chan->scheduledMS = 0;
+    }, NULL);
     pyroArmed = true;
     indicators.clear();
     indicators.show();
     rwLock.UnLock();
+    esp_timer_stop(scheduleTimer);
 }
 
 void PyroManagerClass::onDisarmed() {
@@ -315,6 +386,16 @@ void PyroManagerClass::onLiftOff() {
     rwLock.UnLock();
 }
 
+void PyroManagerClass::onBoostPhase() {
+    // a prediction made before another motor lit (or burnt out) was for a trajectory the rocket isn't on anymore
+    forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
+        if (chan->config.channelType == PyroChannelConfig::DROUGE_CHANNEL) {
+            chan->scheduledMS = 0;
+        }
+    }, NULL);
+    esp_timer_stop(scheduleTimer);
+}
+
 void PyroManagerClass::onBurnout(const Event &event) {
     if (liftedOff() == false || armed() == false) {
         return;
@@ -363,15 +444,39 @@ void PyroManagerClass::onBurnout(const Event &event) {
     }, (void*)&event.args.intArgs.eventArg1);
 }
 
+void PyroManagerClass::onApogeePredicted(const Event &event) {
+    if (liftedOff() == false || armed() == false || postApogee()) {
+        return;
+    }
+    forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
+        auto event = static_cast<const Event*>(ctx);
+        const auto gate = chan->config.apogeePredictConfidence;
+        if (chan->config.channelType != PyroChannelConfig::DROUGE_CHANNEL || gate == 0) {
+            return;
+        }
+        if (chan->deployed || chan->delayStartMS != 0 || event->args.intArgs.eventArg2 < gate) {
+            return;
+        }
+        // later predictions are better, so keep moving the schedule until it is reached
+        chan->scheduleFiring(event->args.intArgs.eventArg1);
+    }, (void*)&event);
+    armScheduleTimer();
+}
+
 void PyroManagerClass::onApogee() {
     if (liftedOff() == false || armed() == false) {
         return;
     }
     forEachChanLock([](PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx) {
         if (chan->config.channelType == PyroChannelConfig::DROUGE_CHANNEL) {
-            chan->firingStartMS = millis();
+            // a predicted schedule that hasn't come due yet is late, go now
+            chan->scheduledMS = 0;
+            if (!chan->deployed && chan->delayStartMS == 0) {
+                chan->startFiringDelay();
+            }
         }
     }, NULL);
+    esp_timer_stop(scheduleTimer);
     rwLock.Lock();
     apogeeDetected = true;
     rwLock.UnLock();
@@ -381,10 +486,10 @@ void PyroManagerClass::onLanding() {
     onDisarmed();
 }
 
-PyroChannelConfig::PyroChannelConfig() : channelType(PyroChannelConfig::DISABLED_CHANNEL), delaySeconds(0), mainAlt(0), burnoutNumber(0), airStartLockoutAltitude(0), airStartLockoutAngle(0), airStartLockoutVelocity(0) {
+PyroChannelConfig::PyroChannelConfig() : channelType(PyroChannelConfig::DISABLED_CHANNEL), delaySeconds(0), mainAlt(0), burnoutNumber(0), airStartLockoutAltitude(0), airStartLockoutAngle(0), airStartLockoutVelocity(0), apogeePredictConfidence(0) {
 }
 
-PyroManagerClass::PyroChannel::PyroChannel(uint8_t FetChannel, uint8_t contChannel) : fetChannel(FetChannel), contChannel(contChannel), continuity(false), firing(false), firingStartMS(0), delayStartMS(0) {
+PyroManagerClass::PyroChannel::PyroChannel(uint8_t FetChannel, uint8_t contChannel) : fetChannel(FetChannel), contChannel(contChannel), continuity(false), firing(false), firingStartMS(0), delayStartMS(0), scheduledMS(0), deployed(false) {
 }
 
 PyroManagerClass::PyroChannel::~PyroChannel() {
@@ -403,6 +508,7 @@ void PyroManagerClass::PyroChannel::startFiring() {
     digitalWrite(fetChannel, HIGH);
     delayStartMS = 0;
     firing = true;
+    deployed = true;
     firingStartMS = millis();
     Log.noticeln("firing channel %d (%s)", chanNum, chanTypeToString(config.channelType));
     PyroManager.event.eventType = Event::PYRO_FIRE_EVENT;
@@ -414,6 +520,14 @@ inline void PyroManagerClass::PyroChannel::startFiringDelay() {
     delayStartMS = millis();
 }
 
+inline void PyroManagerClass::PyroChannel::scheduleFiring(uint32_t atMS) {
+    scheduledMS = atMS;
+}
+
+inline bool PyroManagerClass::PyroChannel::scheduleExpired() const {
+    return (scheduledMS != 0 && static_cast<int32_t>(millis() - scheduledMS) >= 0);
+}
+
 inline bool PyroManagerClass::PyroChannel::firingDelayExpired() const {
     return (delayStartMS != 0 && (delayStartMS + config.delaySeconds*10000 < millis()));
 }
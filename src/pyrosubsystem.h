@@ -9,6 +9,7 @@
 #include "packet.h"
 #include "pyrochannelconfig.h"
 #include <Adafruit_DotStar.h>
+#include <esp_timer.h>
 
 // TODO: create failsafe support
 
@@ -52,6 +53,8 @@ class PyroManagerClass : public TickableSubsystem {
                 void stopFiring();
                 void startFiring();
                 void startFiringDelay();
+                void scheduleFiring(uint32_t atMS);
+                bool scheduleExpired() const;
                 bool firingDelayExpired() const;
                 bool firingDurationExpired() const;
                 bool checkContinuity();
@@ -68,6 +71,8 @@ class PyroManagerClass : public TickableSubsystem {
                 bool firing; // if currently firing
                 uint32_t firingStartMS; // millis() when firing state entered
                 uint32_t delayStartMS; // millis() when firing delay state entered
+                uint32_t scheduledMS; // millis() to enter firing delay state at, 0 if not scheduled
+                bool deployed; // has started firing since arming
         };
 
     private:
@@ -85,6 +90,8 @@ class PyroManagerClass : public TickableSubsystem {
 
         Event event;
 
+        esp_timer_handle_t scheduleTimer; // one-shot, fires when the earliest scheduled channel comes due
+
         void forEachChanNoLock(void(*fn)(PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx), void *ctx);
         void forEachChanLock(void(*fn)(PyroChannel* chan, size_t i, PyroManagerClass *self, void *ctx), void *ctx);
 
@@ -96,10 +103,14 @@ class PyroManagerClass : public TickableSubsystem {
         void onDisarmed();
         void onLiftOff();
         void onBurnout(const Event &event);
+        void onBoostPhase();
+        void onApogeePredicted(const Event &event);
         void onApogee();
         void onLanding();
 
         void tickContinuityChanges();
+        void tickSchedule();
+        void armScheduleTimer();
         void tickFiringDelay();
         void tickFiringDuration();
         void tickAltitudeTrigger();
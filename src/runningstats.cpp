@@ -0,0 +1,39 @@
+#include "runningstats.h"
+#include <math.h>
+
+RunningStats::RunningStats(uint32_t window) : window(window) {
+    reset();
+}
+
+void RunningStats::reset() {
+    n = 0;
+    avg = 0;
+    var = 0;
+}
+
+void RunningStats::add(float x) {
+    if (n < window) {
+        n++;
+    }
+    const auto alpha = 1.0f / n;
+    const auto diff = x - avg;
+    const auto incr = alpha * diff;
+    avg += incr;
+    var = (1 - alpha) * (var + diff * incr);
+}
+
+float RunningStats::mean() const {
+    return avg;
+}
+
+float RunningStats::variance() const {
+    return var;
+}
+
+float RunningStats::stddev() const {
+    return sqrtf(var);
+}
+
+uint32_t RunningStats::count() const {
+    return n;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief O(1) running mean and variance over a sliding exponential window
+ *
+ * Until the window has filled the samples are weighted equally, so the first few samples give a plain average rather
+ * than being dominated by the first one. After that older samples fade out with the given time constant.
+ *
+ */
+class RunningStats {
+    public:
+        /**
+         * @brief Construct a new Running Stats
+         *
+         * @param window number of samples in the exponential window
+         */
+        explicit RunningStats(uint32_t window);
+
+        void reset();
+        void add(float x);
+
+        float mean() const;
+        float variance() const;
+        float stddev() const;
+
+        /**
+         * @brief samples seen since reset, saturates at the window size
+         *
+         */
+        uint32_t count() const;
+
+    private:
+        uint32_t window;
+        uint32_t n;
+        float avg;
+        float var;
+};
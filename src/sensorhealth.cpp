@@ -0,0 +1,101 @@
+#include "sensorhealth.h"
+#include <math.h>
+
+SensorHealth::SensorHealth(const Limits &limits) : limits(limits), latched(0), goodRun(0), repeats(0),
+    innovationRejects(0), lastTime(0), last{}, meanIntervalUS(0), faulted(0), reported(false), reportedHealthy(false) {
+}
+
+void SensorHealth::record(uint8_t sampleFaults) {
+    if (sampleFaults) {
+        latched |= sampleFaults;
+        goodRun = 0;
+        faulted++;
+    } else if (latched && ++goodRun >= recoverSamples) {
+        latched = 0;
+    }
+}
+
+uint8_t SensorHealth::update(uint64_t time, const float *values, size_t count) {
+    uint8_t sampleFaults = 0;
+    auto same = lastTime != 0;
+
+    if (count > MAX_VALUES) {
+        count = MAX_VALUES;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const auto v = values[i];
+        if (!isfinite(v)) {
+            sampleFaults |= INVALID;
+        } else if (limits.rail > 0 && fabsf(v) >= limits.rail) {
+            sampleFaults |= SATURATED;
+        }
+        same = same && v == last[i];
+        last[i] = v;
+    }
+    repeats = same ? repeats + 1 : 0;
+    if (limits.maxRepeats > 0 && repeats >= limits.maxRepeats) {
+        sampleFaults |= STUCK;
+    }
+
+    if (lastTime != 0 && time > lastTime) {
+        const float interval = time - lastTime;
+        meanIntervalUS = meanIntervalUS == 0 ? interval : meanIntervalUS + rateAlpha * (interval - meanIntervalUS);
+    }
+    lastTime = time;
+
+    // a sample arriving is the end of staleness, whatever else is wrong with it
+    latched &= ~STALE;
+    record(sampleFaults);
+    return sampleFaults;
+}
+
+bool SensorHealth::check(uint64_t now) {
+    if (lastTime == 0 || (now > lastTime && now - lastTime > limits.maxGapUS)) {
+        latched |= STALE;
+        goodRun = 0;
+    }
+    return healthy();
+}
+
+bool SensorHealth::innovation(float residual) {
+    if (limits.maxInnovation <= 0 || fabsf(residual) <= limits.maxInnovation) {
+        innovationRejects = 0;
+        latched &= ~INNOVATION;
+        return true;
+    }
+    if (innovationRejects >= maxInnovationRejects) {
+        // the estimator has wandered off, let the sensor pull it back until they agree again
+        latched &= ~INNOVATION;
+        return true;
+    }
+    innovationRejects++;
+    latched |= INNOVATION;
+    faulted++;
+    return false;
+}
+
+uint8_t SensorHealth::faults() const {
+    return latched;
+}
+
+bool SensorHealth::healthy() const {
+    return latched == 0;
+}
+
+bool SensorHealth::healthChanged() {
+    const auto now = healthy();
+    if (reported && now == reportedHealthy) {
+        return false;
+    }
+    reported = true;
+    reportedHealthy = now;
+    return true;
+}
+
+float SensorHealth::rateHz() const {
+    return meanIntervalUS > 0 ? 1e6f / meanIntervalUS : 0;
+}
+
+uint32_t SensorHealth::faultCount() const {
+    return faulted;
+}
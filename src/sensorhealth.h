@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Health of one sensor stream
+ *
+ * Every sample is checked as it arrives: NaN or infinite values, values on the rail of the sensor's range, and runs
+ * of exactly repeated samples, which a live sensor's noise never produces. The stream is stale when samples stop
+ * coming. Consumers can also check the difference between a sample and what the estimator expected.
+ *
+ * A fault is reported on the very sample that shows it, so a consumer can drop the sensor right away, and is held
+ * until a run of good samples has come in. Constant work per sample.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class SensorHealth {
+    public:
+        enum Fault : uint8_t {
+            STALE =         (1 << 0), ///< no sample for too long
+            STUCK =         (1 << 1), ///< identical samples for too long
+            SATURATED =     (1 << 2), ///< a value at the end of the range
+            INVALID =       (1 << 3), ///< NaN or infinite
+            INNOVATION =    (1 << 4)  ///< too far from the estimate
+        };
+
+        struct Limits {
+            uint32_t maxGapUS;      ///< longer without a sample is STALE
+            uint16_t maxRepeats;    ///< this many identical samples in a row is STUCK, 0 never
+            float rail;             ///< a value this big or bigger is SATURATED, 0 never
+            float maxInnovation;    ///< a residual bigger than this is INNOVATION, 0 never
+        };
+
+        static constexpr size_t MAX_VALUES = 6;
+
+        explicit SensorHealth(const Limits &limits);
+
+        /**
+         * @brief check a sample
+         *
+         * @param time timestampUS() of the sample
+         * @param values up to MAX_VALUES channels
+         * @param count number of values
+         * @return uint8_t faults of this sample, 0 if good
+         */
+        uint8_t update(uint64_t time, const float *values, size_t count);
+
+        /**
+         * @brief check for a stale stream, call periodically
+         *
+         * @param now timestampUS()
+         * @return true healthy
+         */
+        bool check(uint64_t now);
+
+        /**
+         * @brief check a sample against the estimate
+         *
+         * @param residual sample minus estimate
+         * @return true use the sample
+         */
+        bool innovation(float residual);
+
+        /**
+         * @brief faults seen recently, cleared after a run of good samples
+         *
+         */
+        uint8_t faults() const;
+        bool healthy() const;
+
+        /**
+         * @brief did healthy() change since this was last called, true the first time
+         *
+         */
+        bool healthChanged();
+
+        /**
+         * @brief average sample rate
+         *
+         */
+        float rateHz() const;
+
+        /**
+         * @brief samples that had a fault
+         *
+         */
+        uint32_t faultCount() const;
+
+    private:
+        static constexpr uint16_t recoverSamples = 10; // good samples in a row before a fault clears
+        static constexpr uint16_t maxInnovationRejects = 20; // then the estimate is more likely wrong than the sensor
+        static constexpr float rateAlpha = 0.05f;
+
+        void record(uint8_t sampleFaults);
+
+        Limits limits;
+        uint8_t latched;
+        uint16_t goodRun;
+        uint16_t repeats;
+        uint16_t innovationRejects;
+        uint64_t lastTime;
+        float last[MAX_VALUES];
+        float meanIntervalUS;
+        uint32_t faulted;
+        bool reported;
+        bool reportedHealthy;
+};
@@ -0,0 +1,107 @@
+#include "spibus.h"
+#include "log.h"
+
+SPIBusClass SPIBus;
+
+static constexpr uint8_t SPI_READ = 0x80;
+
+SPIBusClass::SPIBusClass() : initialized(false) {
+}
+
+bool SPIBusClass::begin(int sck, int miso, int mosi) {
+    if (initialized) {
+        return true;
+    }
+
+    spi_bus_config_t config = {};
+    config.mosi_io_num = mosi;
+    config.miso_io_num = miso;
+    config.sclk_io_num = sck;
+    config.quadwp_io_num = -1;
+    config.quadhd_io_num = -1;
+    config.max_transfer_sz = maxTransferBytes;
+
+    const auto rc = spi_bus_initialize(host, &config, SPI_DMA_CH_AUTO);
+    if (rc != ESP_OK) {
+        Log.errorln("spi bus init failed: %d", rc);
+        return false;
+    }
+    initialized = true;
+    return true;
+}
+
+SPIBusClass::Device SPIBusClass::addDevice(int cs, int clockHz, uint8_t mode, int queueDepth) {
+    spi_device_interface_config_t config = {};
+    config.mode = mode;
+    config.clock_speed_hz = clockHz;
+    config.spics_io_num = cs;
+    config.queue_size = queueDepth;
+    config.flags = SPI_DEVICE_HALFDUPLEX;
+    config.post_cb = postTransfer;
+
+    Device device = NULL;
+    const auto rc = spi_bus_add_device(host, &config, &device);
+    if (rc != ESP_OK) {
+        Log.errorln("spi add device cs %d failed: %d", cs, rc);
+        return NULL;
+    }
+    return device;
+}
+
+void IRAM_ATTR SPIBusClass::postTransfer(spi_transaction_t *trans) {
+    auto transaction = static_cast<SPITransaction*>(trans->user);
+    if (transaction != nullptr && transaction->onComplete != nullptr) {
+        transaction->onComplete(transaction, transaction->arg);
+    }
+}
+
+bool SPIBusClass::queue(Device device, SPITransaction &transaction) {
+    auto &ext = transaction.ext;
+    ext = {};
+    ext.base.flags = SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY;
+    ext.base.addr = transaction.address;
+    ext.address_bits = 8;
+    ext.dummy_bits = transaction.dummyBits;
+    ext.base.user = &transaction;
+    if (transaction.tx != nullptr) {
+        ext.base.tx_buffer = transaction.tx;
+        ext.base.length = transaction.length * 8;
+    }
+    if (transaction.rx != nullptr) {
+        ext.base.rx_buffer = transaction.rx;
+        ext.base.rxlength = transaction.length * 8;
+    }
+    return spi_device_queue_trans(device, &ext.base, 0) == ESP_OK;
+}
+
+SPITransaction *SPIBusClass::wait(Device device, TickType_t timeout) {
+    spi_transaction_t *done = nullptr;
+    if (spi_device_get_trans_result(device, &done, timeout) != ESP_OK) {
+        return nullptr;
+    }
+    return static_cast<SPITransaction*>(done->user);
+}
+
+bool SPIBusClass::transfer(Device device, SPITransaction &transaction) {
+    if (!queue(device, transaction)) {
+        return false;
+    }
+    return wait(device) == &transaction;
+}
+
+bool SPIBusClass::writeRegister(Device device, uint8_t reg, uint8_t value) {
+    SPITransaction transaction = {};
+    transaction.address = reg;
+    transaction.tx = &value;
+    transaction.length = 1;
+    return transfer(device, transaction);
+}
+
+bool SPIBusClass::readRegisters(Device device, uint8_t reg, uint8_t *buf, size_t len, uint8_t dummyBits) {
+    SPITransaction transaction = {};
+    transaction.address = reg | SPI_READ;
+    transaction.dummyBits = dummyBits;
+    transaction.rx = buf;
+    transaction.length = len;
+    return transfer(device, transaction);
+}
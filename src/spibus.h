@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/spi_master.h>
+
+/**
+ * @brief one transfer on the bus
+ *
+ * Half duplex: an 8 bit register address, optional dummy bits, then either tx or rx data. Buffers are handed to DMA
+ * and must stay valid until the transaction completes, and should be word aligned in internal RAM.
+ *
+ */
+struct SPITransaction {
+    uint8_t address;        ///< register address, including the read bit
+    uint8_t dummyBits;      ///< clocks between address and data
+    const uint8_t *tx;      ///< data to write, or NULL
+    uint8_t *rx;            ///< where to read to, or NULL
+    size_t length;          ///< bytes of tx or rx
+
+    /**
+     * @brief called from the SPI interrupt when the transfer is done, may be NULL
+     *
+     * @note interrupt context, e.g. give a task notification
+     */
+    void (*onComplete)(SPITransaction *transaction, void *arg);
+    void *arg;
+
+    spi_transaction_ext_t ext; // for the driver
+};
+
+/**
+ * @brief DMA backed shared SPI bus
+ *
+ * Each chip select is a device with its own transaction queue. Transactions are queued and run by the driver from
+ * interrupts, so the caller sleeps (or does other work) rather than spinning while the bus clocks. Several devices
+ * can have transactions queued at once, the driver runs them one after the other.
+ *
+ */
+class SPIBusClass {
+    public:
+        typedef spi_device_handle_t Device;
+
+        SPIBusClass();
+
+        /**
+         * @brief set up the bus, safe to call more than once
+         *
+         * @return true bus is ready
+         */
+        bool begin(int sck, int miso, int mosi);
+
+        /**
+         * @brief add a chip select to the bus
+         *
+         * @param cs chip select pin
+         * @param clockHz SPI clock
+         * @param mode SPI mode 0-3
+         * @param queueDepth how many transactions may be in flight for this device
+         * @return Device handle, NULL on failure
+         */
+        Device addDevice(int cs, int clockHz, uint8_t mode, int queueDepth = 4);
+
+        /**
+         * @brief start a transaction without waiting for it
+         *
+         * @return true queued, complete it with wait()
+         */
+        bool queue(Device device, SPITransaction &transaction);
+
+        /**
+         * @brief sleep until the oldest queued transaction on the device is done
+         *
+         * @param device
+         * @param timeout ticks to wait
+         * @return SPITransaction* the completed transaction, NULL on timeout
+         */
+        SPITransaction *wait(Device device, TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief queue a transaction and wait for it
+         *
+         * @return true success
+         */
+        bool transfer(Device device, SPITransaction &transaction);
+
+        /**
+         * @brief convenience register write
+         *
+         */
+        bool writeRegister(Device device, uint8_t reg, uint8_t value);
+
+        /**
+         * @brief convenience register read
+         *
+         * @param dummyBits clocks between address and data
+         */
+        bool readRegisters(Device device, uint8_t reg, uint8_t *buf, size_t len, uint8_t dummyBits = 0);
+
+    private:
+        static constexpr spi_host_device_t host = SPI2_HOST;
+        static constexpr int maxTransferBytes = 2048;
+
+        static void IRAM_ATTR postTransfer(spi_transaction_t *trans);
+
+        bool initialized;
+};
+
+extern SPIBusClass SPIBus;
@@ -0,0 +1,84 @@
+#include "stagingdetector.h"
+
+StagingDetector::StagingDetector() {
+    reset();
+}
+
+void StagingDetector::reset() {
+    isThrusting = false;
+    burnoutCount = 0;
+    lastBurnout = 0;
+    lastIgnition = 0;
+    axial = G; // sitting on the pad
+    jerk = 0;
+    candidateSince = 0;
+    edgeTime = 0;
+    edgeJerk = 0;
+}
+
+void StagingDetector::update(uint32_t time, float dt, float axialAcc) {
+    if (dt <= 0) {
+        return;
+    }
+
+    const auto prior = axial;
+    axial += (axialAcc - axial) * dt / (dt + smoothingMS / 1000.0f);
+    jerk = (axial - prior) / dt;
+
+    // remember the steepest recent edge in the direction of the next change, burnout falls and ignition rises
+    const auto towardChange = isThrusting ? -jerk : jerk;
+    if (time - edgeTime > edgeWindowMS || towardChange > edgeJerk) {
+        edgeTime = time;
+        edgeJerk = towardChange;
+    }
+
+    bool crossed;
+    uint32_t dwell;
+    if (isThrusting) {
+        crossed = axial < coastThresh;
+        dwell = burnoutDwellMS;
+    } else {
+        crossed = axial > (burnoutCount == 0 ? padThrustThresh : airThrustThresh);
+        dwell = ignitionDwellMS;
+    }
+
+    if (!crossed) {
+        candidateSince = 0;
+        return;
+    }
+    if (candidateSince == 0) {
+        candidateSince = time;
+    }
+    if (time - candidateSince < dwell) {
+        return;
+    }
+
+    // confirmed
+    const auto when = edgeJerk > 0 ? edgeTime : candidateSince;
+    if (isThrusting) {
+        burnoutCount++;
+        lastBurnout = when;
+    } else {
+        lastIgnition = when;
+    }
+    isThrusting = !isThrusting;
+    candidateSince = 0;
+    edgeTime = time;
+    edgeJerk = 0;
+}
+
+bool StagingDetector::thrusting() const {
+    return isThrusting;
+}
+
+uint8_t StagingDetector::burnouts() const {
+    return burnoutCount;
+}
+
+uint32_t StagingDetector::burnoutTime() const {
+    return lastBurnout;
+}
+
+uint32_t StagingDetector::ignitionTime() const {
+    return lastIgnition;
+}
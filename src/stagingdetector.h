@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Detects motor ignition and burnout at IMU rate
+ *
+ * Works on the specific force along the rocket's long axis: positive while a motor pushes harder than drag, negative
+ * while coasting. It is lightly smoothed and differentiated into jerk. A burn ends when the axial force falls below the
+ * coast threshold, and starts when it rises above the thrust threshold for long enough that a separation shock won't
+ * count. Events are timestamped at the steepest jerk inside the change, which is as close to the physical event as
+ * the samples allow.
+ *
+ * Plain C++ so it can be run over replayed or simulated flights on the host.
+ *
+ */
+class StagingDetector {
+    public:
+        StagingDetector();
+
+        /**
+         * @brief forget everything and wait for the first ignition, call on arming
+         *
+         */
+        void reset();
+
+        /**
+         * @brief feed an IMU sample
+         *
+         * @param time ms timestamp of the sample
+         * @param dt seconds since the previous sample, samples come faster than ms resolution
+         * @param axialAcc specific force along the long axis in m/s^2, positive toward the nose
+         */
+        void update(uint32_t time, float dt, float axialAcc);
+
+        /**
+         * @brief is a motor burning
+         *
+         */
+        bool thrusting() const;
+
+        /**
+         * @brief number of burnouts since reset
+         *
+         */
+        uint8_t burnouts() const;
+
+        /**
+         * @brief ms timestamp of the last burnout, 0 if none
+         *
+         */
+        uint32_t burnoutTime() const;
+
+        /**
+         * @brief ms timestamp of the last ignition, 0 if none
+         *
+         */
+        uint32_t ignitionTime() const;
+
+    private:
+        static constexpr float G = 9.8f;
+        static constexpr float padThrustThresh = 2 * G; // first ignition, the pad adds 1G to the axial reading
+        static constexpr float airThrustThresh = G / 2; // later ignitions, nothing but thrust and drag in flight
+        static constexpr float coastThresh = G / 4; // below this we are coasting
+        static constexpr uint32_t burnoutDwellMS = 10; // how long below coastThresh before burnout
+        static constexpr uint32_t ignitionDwellMS = 30; // longer than a separation charge shock
+        static constexpr float smoothingMS = 5; // time constant of the axial smoothing
+        static constexpr uint32_t edgeWindowMS = 50; // how far back the steepest jerk is remembered
+
+        bool isThrusting;
+        uint8_t burnoutCount;
+        uint32_t lastBurnout;
+        uint32_t lastIgnition;
+
+        float axial; // smoothed
+        float jerk; // m/s^3
+
+        uint32_t candidateSince; // when the current crossing started, 0 if none
+        uint32_t edgeTime; // time of the steepest jerk toward the next change
+        float edgeJerk;
+};
@@ -2,7 +2,7 @@
 #include "eventmanager.h"
 #include "gps-subsystem.h"
 #include "baro-subsystem.h"
-#include "bmi088-subsystem.h"
+#include "imufusion.h"
 #include "mag-subsystem.h"
 #include "log.h"
 #include "pyrosubsystem.h"
@@ -10,12 +10,25 @@
 
 StateManagerClass StateManager;
 
-StateManagerClass::StateManagerClass() : state(Packet::INIT), vel(TimeStep(0.1)), acc(TimeStep(0.1)), burnoutCount(0) {
+// only the innovation check, the baro subsystem watches the stream itself
+static constexpr SensorHealth::Limits BARO_INNOVATION_LIMITS = {0, 0, 0, 100}; // m
+
+// the state machine has its own copy of the states so it can build on the host, keep them in step
+static_assert(FlightStateMachine::DISARMED == static_cast<int>(Packet::DISARMED), "state mismatch");
+static_assert(FlightStateMachine::TOUCHDOWN == static_cast<int>(Packet::TOUCHDOWN), "state mismatch");
+static_assert(FlightStateMachine::POWER_FAIL == static_cast<int>(Packet::POWER_FAIL), "state mismatch");
+static_assert(FlightStateMachine::UNKNOWN == static_cast<int>(Packet::UNKNOWN), "state mismatch");
+
+StateManagerClass::StateManagerClass() : last_gps(0), latencies{}, vertVel(0), vertAcc(0), snapshot{}, last_acc(0), gps_gnd_alt(0), baro_gnd_alt(0), burnoutCount(0), fusedAGL(0), baroInnovation(BARO_INNOVATION_LIMITS), newestSampleUS(0), lastIMUFrameUS(0), baroTrust(1), committedPrediction{}, lastPredictionPublished(0) {
       name = "state manager";
       strncpy(armingError, "", sizeof(armingError));
+      queue = xQueueCreateStatic(QUEUE_DEPTH,
+            sizeof(SensorSample),
+            queueStorage,
+            &staticQueue);
 
       //FIXME: more deps
-      static BaseSubsystem* deps[] = {&BaroSubystem, &GPSSubsystem, &BMI088Subsystem, &EventManager, &LogWriter, NULL};
+      static BaseSubsystem* deps[] = {&BaroSubystem, &GPSSubsystem, &IMUFusion, &EventManager, &LogWriter, NULL};
       static SubsystemManagerClass::Spec spec(this, deps);
       SubsystemManager.addSubsystem(&spec);
 }
@@ -24,65 +37,208 @@ StateManagerClass::~StateManagerClass() {
 }
 
 BaseSubsystem::Status StateManagerClass::setup() {
-      state = Packet::DISARMED;
+      machine.reset(FlightStateMachine::DISARMED, millis());
+
+      // the callbacks only queue samples with their acquisition time, all estimation happens in taskFunction()
 
       // GPS
       GPSSubsystem.registerCallback([](const GPSFix& fix, void *arg) {
             auto self = static_cast<StateManagerClass*>(arg);
-            self->rwLock.Lock();
-
-            if (fix.fixType == 3) { // must have 3d fix
-                  self->last_gps = self->filtGPSalt(fix.altitude);
-            }
-            self->detect();
-
-            self->rwLock.UnLock();
+            SensorSample sample;
+            sample.sampleType = SensorSample::GPS_SAMPLE;
+            sample.timeUS = fix.time;
+            sample.time = sample.timeUS / 1000;
+            sample.gps.altitude = fix.altitude;
+            sample.gps.vAcc = fix.vAcc;
+            sample.gps.fixType = fix.fixType;
+            self->queueSample(sample);
       }, this);
 
       // Barometer
       BaroSubystem.registerCallback([](const BarometerData& baro, void *arg) {
             auto self = static_cast<StateManagerClass*>(arg);
-            self->rwLock.Lock();
+            if (baro.faults) {
+                  self->rejectSample();
+                  return;
+            }
+            SensorSample sample;
+            sample.sampleType = SensorSample::BARO_SAMPLE;
+            sample.timeUS = baro.time;
+            sample.time = sample.timeUS / 1000;
+            sample.altitude = baro.altitude;
+            self->queueSample(sample);
+      }, this);
 
-            const auto filteredValue = self->filtBaroAlt(baro.altitude);
-            self->baroReadings.push(filteredValue);
+      // IMU, a batch of frames per tick
+      IMUFusion.registerCallback([](const IMUBatch& batch, void *arg) {
+            auto self = static_cast<StateManagerClass*>(arg);
+            if (batch.count == 0) {
+                  return;
+            }
+            if (batch.faults & IMU_REJECT_FAULTS) {
+                  self->rejectSample();
+                  return;
+            }
+            // slow ticks while disarmed deliver more frames than the queue can take, so thin them out
+            const size_t stride = (batch.count + MAX_IMU_FRAMES_PER_BATCH - 1) / MAX_IMU_FRAMES_PER_BATCH;
+            SensorSample sample;
+            sample.sampleType = SensorSample::IMU_SAMPLE;
+            // always include the newest frame
+            for (size_t i = (batch.count - 1) % stride; i < batch.count; i += stride) {
+                  const auto &frame = batch.frames[i];
+                  sample.timeUS = batch.time - (batch.count - 1 - i) * batch.periodUS;
+                  sample.time = sample.timeUS / 1000;
+                  for (auto axis = 0; axis < 3; axis++) {
+                        sample.imu.acc[axis] = frame.acc[axis];
+                        sample.imu.gyro[axis] = frame.gyro[axis];
+                  }
+                  // dt runs from the last frame queued, so time in dropped or thinned out frames is still integrated
+                  auto gapUS = sample.timeUS - self->lastIMUFrameUS;
+                  if (self->lastIMUFrameUS == 0 || sample.timeUS <= self->lastIMUFrameUS || gapUS > MAX_IMU_GAP_US) {
+                        gapUS = stride * batch.periodUS;
+                  }
+                  self->lastIMUFrameUS = sample.timeUS;
+                  sample.imu.dt = gapUS / 1000000.0f;
+                  self->queueSample(sample);
+            }
+      }, this);
 
-            const auto vel = self->vel.step(filteredValue);
-            const auto acc = self->acc.step(vel);
-            self->vertVel = vel;
-            self->vertAcc = acc;
+      setStatus(BaseSubsystem::READY);
+      return getStatus();
+}
 
-            self->detect();
+int StateManagerClass::taskPriority() const {
+      // above the tickers that produce the samples, so detection is not starved by them
+      return 5;
+}
 
-            self->rwLock.UnLock();
-      }, this);
+int StateManagerClass::core() {
+      return 1;
+}
 
-      // IMU
-      BMI088Subsystem.registerCallback([](const SixFloats& data, void *arg) {
-            auto self = static_cast<StateManagerClass*>(arg);
-            self->rwLock.Lock();
+void StateManagerClass::queueSample(const SensorSample &sample) {
+      if (xQueueSend(queue, &sample, 0) != pdPASS) {
+            rwLock.Lock();
+            latencies.droppedSamples++;
+            rwLock.UnLock();
+      }
+}
 
-            // YOLO fuck it, let's just see if we're accelerating overall
-            self->last_acc = self->filtAcc(Vec3f(data.x, data.y, data.z).norm());
+void StateManagerClass::rejectSample() {
+      rwLock.Lock();
+      latencies.rejectedSamples++;
+      rwLock.UnLock();
+}
 
-            // we don't call detect() here b/c this is sampled every 10ms and barometer
-            // is every 100ms
+void StateManagerClass::taskFunction(void *parameter) {
+      static SensorSample sample; // only used from this thread
+      auto lastWakeTime = xTaskGetTickCount();
 
-            self->rwLock.UnLock();
-      }, this);
+      while(1) {
+            rwLock.Lock();
 
-      setStatus(BaseSubsystem::READY);
-      return getStatus();
+            const auto now = millis();
+            while (xQueueReceive(queue, &sample, 0) == pdPASS) {
+                  const uint32_t waited = now - sample.time;
+                  if (waited > latencies.maxSampleMS) {
+                        latencies.maxSampleMS = waited;
+                  }
+                  if (sample.timeUS > newestSampleUS) {
+                        newestSampleUS = sample.timeUS;
+                  }
+                  processSample(sample);
+            }
+            detect();
+
+            rwLock.UnLock();
+
+            vTaskDelayUntil(&lastWakeTime, DETECT_PERIOD_MS);
+      }
 }
 
-BaseSubsystem::Status StateManagerClass::start() {
-      setStatus(BaseSubsystem::RUNNING);
-      return getStatus();
+float StateManagerClass::slope(const CircularBuffer<Reading<float>, BARO_HISTORY> &history) {
+      // newest reading against the newest one at least baroBaselineMS older, or the oldest we have
+      const auto newest = history.last();
+      for (int i = history.size() - 2; i >= 0; i--) {
+            const auto older = history[i];
+            const auto elapsed = newest.time - older.time;
+            if (elapsed >= baroBaselineMS || i == 0) {
+                  return elapsed > 0 ? (newest.value - older.value) * 1000.0f / elapsed : 0;
+            }
+      }
+      return 0;
+}
+
+bool StateManagerClass::onPad() const {
+      // calibrate until armed, the rocket may be handled between arming and liftoff but not before
+      return machine.state() == FlightStateMachine::INIT || machine.state() == FlightStateMachine::DISARMED;
+}
+
+void StateManagerClass::processSample(const SensorSample &sample) {
+      switch (sample.sampleType) {
+            case SensorSample::GPS_SAMPLE:
+                  if (sample.gps.fixType == 3) { // must have 3d fix
+                        last_gps = filtGPSalt(sample.gps.altitude);
+                        if (onPad()) {
+                              padCalibrator.addGPS(sample.gps.altitude / 1000.0f);
+                        }
+                        // raw rather than median filtered, the filter delay would cost more than the noise
+                        altitudeFusion.setGPS(sample.time, (sample.gps.altitude - gps_gnd_alt) / 1000.0f, sample.gps.vAcc / 1000.0f);
+                  } else {
+                        altitudeFusion.clearGPS();
+                  }
+                  break;
+
+            case SensorSample::BARO_SAMPLE: {
+                  if (deadReckoning.running() && !baroInnovation.innovation(sample.altitude - baro_gnd_alt - deadReckoning.altitude())) {
+                        latencies.rejectedSamples++;
+                        break;
+                  }
+                  const auto filteredValue = filtBaroAlt(sample.altitude);
+                  if (onPad()) {
+                        padCalibrator.addBaro(sample.altitude);
+                  }
+                  const auto dt = baroReadings.isEmpty() ? 0 : (sample.time - baroReadings.last().time) / 1000.0f;
+                  baroReadings.push(Reading<float>(filteredValue, sample.time));
+
+                  // the baro rate changes with flight phase, so differentiate over time rather than samples
+                  vertVel = slope(baroReadings);
+                  velReadings.push(Reading<float>(vertVel, sample.time));
+                  vertAcc = slope(velReadings);
+
+                  // lean on the GPS as the baro loses resolution up high
+                  fusedAGL = altitudeFusion.update(sample.time, filteredValue - baro_gnd_alt, filteredValue, vertVel);
+
+                  // keep dead reckoning from drifting while the baro can be trusted
+                  deadReckoning.correct(fusedAGL, vertVel, baroTrust * dt / (baroCorrectionTau + dt));
+                  break;
+            }
+
+            case SensorSample::IMU_SAMPLE: {
+                  const auto &imu = sample.imu;
+                  // YOLO fuck it, let's just see if we're accelerating overall
+                  last_acc = filtAcc(Vec3f(imu.acc[0], imu.acc[1], imu.acc[2]).norm());
+
+                  // staging happens faster than the median above can follow, so it gets the raw samples
+                  stagingDetector.update(sample.time, imu.dt, deadReckoning.axialAcceleration(imu.acc));
+
+                  if (onPad()) {
+                        padCalibrator.addAcc(imu.acc);
+                  }
+
+                  if (deadReckoning.running()) {
+                        deadReckoning.update(imu.dt, imu.acc, imu.gyro);
+                  } else {
+                        deadReckoning.calibrate(imu.dt, imu.acc);
+                  }
+                  break;
+            }
+      }
 }
 
 Packet::State StateManagerClass::getState() const {
       rwLock.RLock();
-      auto rc = state;
+      auto rc = static_cast<Packet::State>(machine.state());
       rwLock.RUnlock();
       return rc;
 }
@@ -92,7 +248,9 @@ bool StateManagerClass::canArm() {
 
       rwLock.RLock();
 
-      if (state != Packet::DISARMED) {
+      armingError[0] = '\0';
+
+      if (machine.state() != FlightStateMachine::DISARMED) {
             strncpy(armingError, "refusing to arm b/c not DISARMED", sizeof(armingError));
             Log.errorln(armingError);
             goto out;
@@ -108,6 +266,10 @@ bool StateManagerClass::canArm() {
             }
 
       }, this);
+      if (armingError[0] != '\0') {
+            Log.errorln(armingError);
+            goto out;
+      }
 
       if (!PyroManager.allConfiguredChannelsContinuity()) {
             strncpy(armingError, "not all configured channels have continuity", sizeof(armingError));
@@ -115,14 +277,30 @@ bool StateManagerClass::canArm() {
             goto out;
       }
 
-      // TODO: pointing up
+      if (!padCalibrator.haveBaro() || !padCalibrator.haveAcc()) {
+            strncpy(armingError, "refusing to arm b/c pad calibration not settled", sizeof(armingError));
+            Log.errorln(armingError);
+            goto out;
+      }
+
+      if (padCalibrator.tiltDegrees() > maxArmTiltDegrees) {
+            snprintf(armingError, sizeof(armingError), "refusing to arm b/c tilted %d degrees",
+                  static_cast<int>(padCalibrator.tiltDegrees()));
+            Log.errorln(armingError);
+            goto out;
+      }
+
+      if (!padCalibrator.still()) {
+            strncpy(armingError, "refusing to arm b/c moving", sizeof(armingError));
+            Log.errorln(armingError);
+            goto out;
+      }
 
-      // TODO: not moving
+      rc = true;
 
 out:
-      return rc;
       rwLock.RUnlock();
-
+      return rc;
 }
 
 const char * StateManagerClass::armError() const {
@@ -138,13 +316,20 @@ bool StateManagerClass::arm() {
       if (canArm()) {
             rwLock.Lock();
 
-            // establish ground levels
-            gps_gnd_alt = last_gps;
-            baro_gnd_alt = baroReadings.last().value;
+            // establish ground levels from the averaged pad data
+            gps_gnd_alt = padCalibrator.haveGPS() ? roundf(padCalibrator.gpsAltitude() * 1000) : last_gps; // mm
+            baro_gnd_alt = roundf(padCalibrator.baroAltitude());
+            Log.noticeln("ground levels baro %d m gps %d mm", baro_gnd_alt, gps_gnd_alt);
+            altitudeFusion.clearGPS(); // fixes so far are relative to the old ground level
+            stagingDetector.reset();
+            burnoutCount = 0;
+            fusedAGL = 0;
+            snapshot.maxAGL = 0;
+            snapshot.maxAGLTime = millis();
 
             rc = true;
             Log.noticeln("arming");
-            state = Packet::ARMED;
+            machine.reset(FlightStateMachine::ARMED, millis());
             EventManager.publishEvent(Event::ARM_EVENT);
 
             rwLock.UnLock();
@@ -155,18 +340,17 @@ bool StateManagerClass::arm() {
 void StateManagerClass::disarm() {
       rwLock.Lock();
       // can only disarm if armed
-      if (state == Packet::ARMED) {
+      if (machine.state() == FlightStateMachine::ARMED) {
             Log.noticeln("disarmed");
-            state = Packet::DISARMED;
+            machine.reset(FlightStateMachine::DISARMED, millis());
       }
       rwLock.UnLock();
       EventManager.publishEvent(Event::DISARM_EVENT);
 }
 
 int StateManagerClass::getAGL() const {
-      // TODO: Kalman with GPS- Baro going to stop giving you good data over about 50k
       rwLock.RLock();
-      const int rc = roundf(baroReadings.last().value - baro_gnd_alt);
+      const int rc = roundf(snapshot.agl);
       rwLock.RUnlock();
       return rc;
 }
@@ -178,219 +362,202 @@ int StateManagerClass::getVertVel() const {
       return rc;
 }
 
-void StateManagerClass::detect() {
-      switch (state) {
-            case Packet::ARMED:
-                  detectLiftoff();
-                  break;
-            case Packet::BOOST:
-                  detectCoast();
-                  break;
-            case Packet::COAST:
-                  if (!detectBoost()) {
-                       detectApogee();
-                  }
-                  break;
-            case Packet::APOGEE:
-                  if (!detectUnderChute()) {
-                        detectLawnDart();
-                  }
-                  break;
-            case Packet::LAWN_DART:
-                  if (!detectUnderChute()) {
-                        detectTouchdown();
-                  }
-                  break;
-            case Packet::UNDER_CHUTE:
-                  detectTouchdown();
-                  break;
-            case Packet::TOUCHDOWN:
-                  if (!detectLost()) {
-                        detectPowerFail();
-                  }
-                  break;
-            case Packet::LOST:
-                  detectPowerFail();
-                  break;
-            case Packet::POWER_FAIL:
-                  // TODO: ???
-                  break;
-      }
-}
-
-bool StateManagerClass::detectLiftoff() {
-      bool rc = false;
-      // liftoff detection:
-      //    "going up" trigger
-      //       for last 100ms, we have been:
-      //       going up according to baro and accelerometers
-      //
-      //   GPS and barometer agree that we've ascended at least 100' and we're "going up"
-
-      const auto currentBaro = baroReadings.last().value;
-      const auto priorBaro = baroReadings.first().value;
-      const auto now = millis();
-      if (currentBaro > priorBaro && last_acc > boostThresh) { // we are going up
-            if (!goingUp) {
-                  firstGoingUp = now;
-                  Log.noticeln("boost Detector: we are now going up");
-            }
-            goingUp = true;
-      } else { // we are not going up
-            if (goingUp) {
-                  Log.noticeln("boost Detector: we are no longer going up");
-            }
-            goingUp = false;
-      }
-      const auto gpsSaysUp = gps_gnd_alt + liftOffAltThresh < last_gps;
-      const auto baroSaysUp = baro_gnd_alt + liftOffAltThresh < currentBaro;
-      const auto ago100ms = firstGoingUp + 100 < now;
-      if (goingUp && ago100ms && gpsSaysUp && baroSaysUp) {
-            state = Packet::BOOST;
-            Log.noticeln("liftoff!");
-            EventManager.publishEvent(Event::LIFTOFF_EVENT);
-            rc = true;
-      }
+StateManagerClass::EventLatencies StateManagerClass::getEventLatencies() const {
+      rwLock.RLock();
+      const auto rc = latencies;
+      rwLock.RUnlock();
       return rc;
 }
 
-bool StateManagerClass::detectCoast() {
-      bool rc = false;
-      if (last_acc < coastThresh && vertVel > vertVelThresh) {
-            burnoutCount++;
-            state = Packet::COAST;
-            Log.noticeln("Burnout number %d", burnoutCount);
-            Event ev;
-            ev.eventType = Event::BURNOUT_EVENT;
-            ev.args.intArgs.eventArg1 = burnoutCount;
-            EventManager.publishEvent(ev);
-            rc = true;
+size_t StateManagerClass::getTransitionTrace(FlightStateMachine::TraceEntry *entries, size_t maxEntries) const {
+      rwLock.RLock();
+      const auto len = machine.traceLength();
+      const auto skip = len > maxEntries ? len - maxEntries : 0;
+      for (size_t i = skip; i < len; i++) {
+            entries[i - skip] = machine.trace(i);
       }
-      return rc;
+      rwLock.RUnlock();
+      return len - skip;
 }
 
-bool StateManagerClass::detectBoost() {
-      bool rc = false;
+void StateManagerClass::detect() {
+      updateSnapshot(millis());
 
-      if ((last_acc > boostThresh) && (vertVel > vertVelThresh)) {
-            state = Packet::BOOST;
-            Log.noticeln("boost");
-            EventManager.publishEvent(Event::AIRSTART_EVENT);
-            rc = true;
+      const auto transition = machine.step(snapshot);
+      if (transition) {
+            onTransition(*transition);
       }
 
-      return rc;
+      if (machine.state() == FlightStateMachine::COAST) {
+            updatePrediction();
+      }
 }
 
-bool StateManagerClass::detectApogee() {
-      const auto now = millis();
-
-      bool rc = false;
+void StateManagerClass::updatePrediction() {
+      // In coast the accelerometer only measures drag, so the deceleration is gravity plus drag. That is much less
+      // noisy than differentiating the baro twice.
+      const auto decel = G + last_acc;
+      const auto prediction = predictor.update(snapshot.time, snapshot.vertVel, -decel);
 
-      const auto currentReading = baroReadings.last();
-      if (maxAlt.value > currentReading.value) {
-            maxAlt = currentReading;
+      if (!prediction.valid || snapshot.machLockout || prediction.confidence < minPublishConfidence) {
+            return;
       }
-
-      if (vertVel > machLockoutTrigger) {
-            Log.noticeln("Mach lockout started");
-            lockOutActive = true;
-            lockOutStarted = now;
-            goto out;
+      if (snapshot.time - lastPredictionPublished < predictionPublishMS) {
+            return;
       }
-      // If you're below lockout thresh and have been for over 1 second, then disable lockout
-      if (lockOutActive && vertVel < machLockoutRelease && (now - lockOutStarted) > 1000 ) {
-            Log.noticeln("Mach lockout ended");
-            lockOutActive = false;
+      lastPredictionPublished = snapshot.time;
+      if (!committedPrediction.valid) {
+            committedPrediction = prediction;
+            Log.noticeln("apogee predicted in %ld ms (%d%%)",
+                  static_cast<int32_t>(prediction.apogeeTime - snapshot.time), prediction.confidence);
       }
 
-      if (!lockOutActive &&  currentReading.value < maxAlt.value && now - maxAlt.time > 1000) {
-            state = Packet::APOGEE;
-            Log.noticeln("apogee!!!");
-            Event ev;
-            ev.eventType = Event::APOGEE_EVENT;
-            ev.args.intArgs.eventArg1 = maxAlt.value;
-            EventManager.publishEvent(ev);
-            rc = true;
-      }
-
-out:
-      return rc;
+      Event ev;
+      ev.eventType = Event::APOGEE_PREDICTED_EVENT;
+      ev.args.intArgs.eventArg1 = prediction.apogeeTime;
+      ev.args.intArgs.eventArg2 = prediction.confidence;
+      EventManager.publishEvent(ev);
 }
 
-bool StateManagerClass::detectUnderChute() {
-      bool rc = false;
-
-      if (vertVel < chuteVelThresh && abs(vertAcc) < chuteAccThresh) {
-            rc = true;
-            // There is no event for under CHUTE
-            state = Packet::UNDER_CHUTE;
-            Log.noticeln("chute detected");
+void StateManagerClass::updateSnapshot(unsigned long now) {
+      // nothing is going up before the first baro sample
+      const auto current = baroReadings.isEmpty() ? Reading<float>(0, now) : baroReadings.last();
+      const auto prior = baroReadings.isEmpty() ? current : baroReadings.first();
+
+      snapshot.time = now;
+      snapshot.gpsAGL = (last_gps - gps_gnd_alt) / 1000.0f; // gps altitude is in mm
+      snapshot.vertAcc = vertAcc;
+      if (deadReckoning.running()) {
+            // lean on the accelerometer while the baro is untrusted and hand back to the baro gradually
+            snapshot.agl = baroTrust * fusedAGL + (1 - baroTrust) * deadReckoning.altitude();
+            snapshot.vertVel = baroTrust * vertVel + (1 - baroTrust) * deadReckoning.velocity();
+      } else {
+            snapshot.agl = fusedAGL;
+            snapshot.vertVel = vertVel;
+      }
+      snapshot.accMag = last_acc;
+      snapshot.thrusting = stagingDetector.thrusting();
+      snapshot.batteryVolts = StatusManager.getMinimalPacket().batteryVoltage / 10.0f;
+
+      // "going up" according to baro and accelerometers
+      if (current.value > prior.value && last_acc > goingUpThresh) {
+            if (snapshot.goingUpSince == 0) {
+                  snapshot.goingUpSince = current.time;
+                  Log.noticeln("boost Detector: we are now going up");
+            }
+      } else if (snapshot.goingUpSince != 0) {
+            snapshot.goingUpSince = 0;
+            Log.noticeln("boost Detector: we are no longer going up");
       }
 
-      return rc;
-}
+      if (snapshot.agl > snapshot.maxAGL) {
+            snapshot.maxAGL = snapshot.agl;
+            snapshot.maxAGLTime = current.time;
+      }
 
-bool StateManagerClass::detectLawnDart() {
-      bool rc = false;
-      if (vertVel > chuteVelThresh && abs(vertAcc) > chuteAccThresh) {
-            rc = true;
-            state = Packet::LAWN_DART;
-            Log.noticeln("Lawn dart!");
-            EventManager.publishEvent(Event::LAWN_DART_EVENT);
+      // transonic baro can't be trusted to say when we are transonic, so use the accelerometer when we have it
+      const auto lockoutVel = deadReckoning.running() ? deadReckoning.velocity() : vertVel;
+      if (!snapshot.machLockout && lockoutVel > machLockoutTrigger) {
+            Log.noticeln("Mach lockout started");
+            snapshot.machLockout = true;
+      }
+      if (snapshot.machLockout && lockoutVel < machLockoutRelease) {
+            Log.noticeln("Mach lockout ended");
+            snapshot.machLockout = false;
       }
 
-      return rc;
+      if (snapshot.machLockout) {
+            baroTrust = 0;
+      } else if (baroTrust < 1) {
+            baroTrust = fminf(1, baroTrust + DETECT_PERIOD_MS / baroBlendMS);
+      }
 }
 
-bool StateManagerClass::detectTouchdown() {
-      bool rc = false;
-
-      if (vertVel < 1 && vertAcc < 1 && last_acc < G) {
-            rc = true;
-            state = Packet::TOUCHDOWN;
-
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-            landed_time = tv.tv_sec;
+void StateManagerClass::onTransition(const FlightStateMachine::Transition &transition) {
+      Event ev;
+
+      latencies.decisionUS = timestampUS() - newestSampleUS;
+      Log.noticeln("state %d -> %d (%lu us after the newest sample)", transition.from, transition.to, latencies.decisionUS);
+
+      switch (transition.signal) {
+            case FlightStateMachine::LIFTOFF_SIGNAL:
+                  // apogee detection tracks up from here
+                  snapshot.maxAGL = snapshot.agl;
+                  snapshot.maxAGLTime = snapshot.time;
+                  latencies.liftoffMS = snapshot.time - snapshot.goingUpSince;
+                  deadReckoning.start(snapshot.agl, snapshot.vertVel);
+                  predictor.reset();
+                  committedPrediction = ApogeePredictor::Prediction{false, 0, 0};
+                  Log.noticeln("liftoff! (%lu ms after first going up)", latencies.liftoffMS);
+                  ev.eventType = Event::LIFTOFF_EVENT;
+                  ev.args.intArgs.eventArg1 = latencies.liftoffMS;
+                  EventManager.publishEvent(ev);
+                  break;
 
-            Log.noticeln("touchdown at %d", landed_time);
+            case FlightStateMachine::BURNOUT_SIGNAL:
+                  burnoutCount++;
+                  latencies.burnoutMS = snapshot.time - stagingDetector.burnoutTime();
+                  Log.noticeln("Burnout number %d (%lu ms after burnout)", burnoutCount, latencies.burnoutMS);
+                  ev.eventType = Event::BURNOUT_EVENT;
+                  ev.args.intArgs.eventArg1 = burnoutCount;
+                  EventManager.publishEvent(ev);
+                  break;
 
-            EventManager.publishEvent(Event::LANDING_EVENT);
-      }
+            case FlightStateMachine::AIRSTART_SIGNAL:
+                  latencies.airstartMS = snapshot.time - stagingDetector.ignitionTime();
+                  Log.noticeln("boost (%lu ms after ignition)", latencies.airstartMS);
+                  predictor.reset();
+                  committedPrediction = ApogeePredictor::Prediction{false, 0, 0};
+                  EventManager.publishEvent(Event::AIRSTART_EVENT);
+                  break;
 
-      return rc;
-}
+            case FlightStateMachine::APOGEE_SIGNAL:
+                  latencies.apogeeMS = snapshot.time - snapshot.maxAGLTime;
+                  Log.noticeln("apogee!!! (%lu ms after max altitude)", latencies.apogeeMS);
+                  if (committedPrediction.valid) {
+                        latencies.apogeePredictionErrorMS = committedPrediction.apogeeTime - snapshot.maxAGLTime;
+                        latencies.apogeeSavedMS = snapshot.time - committedPrediction.apogeeTime;
+                        Log.noticeln("apogee prediction error %ld ms, %ld ms earlier than detection",
+                              latencies.apogeePredictionErrorMS, latencies.apogeeSavedMS);
+                  }
+                  ev.eventType = Event::APOGEE_EVENT;
+                  ev.args.intArgs.eventArg1 = snapshot.maxAGL;
+                  ev.args.intArgs.eventArg2 = latencies.apogeeMS;
+                  ev.args.intArgs.eventArg3 = latencies.apogeePredictionErrorMS;
+                  EventManager.publishEvent(ev);
+                  break;
 
-bool StateManagerClass::detectPowerFail() {
-      bool rc = false;
+            case FlightStateMachine::LAWN_DART_SIGNAL:
+                  Log.noticeln("Lawn dart!");
+                  EventManager.publishEvent(Event::LAWN_DART_EVENT);
+                  break;
 
-      // FIXME: read the condition
-      // The actual measurement is in statusmanager
-      // but that seems kinda meh
-      // but is power fail actually a state?
-      // couldn't status manager just throw out the powerfail event??
-      if (false) {
-            rc = true;
-            state = Packet::POWER_FAIL;
-            EventManager.publishEvent(Event::LOW_BATTERY_EVENT);
-            // FIXME: include batt voltage in event
-      }
+            case FlightStateMachine::LANDING_SIGNAL: {
+                  struct timeval tv;
+                  gettimeofday(&tv, NULL);
+                  Log.noticeln("touchdown at %d", tv.tv_sec);
+                  deadReckoning.stop();
+                  EventManager.publishEvent(Event::LANDING_EVENT);
+                  break;
+            }
 
-      return rc;
-}
+            case FlightStateMachine::LOST_ROCKET_SIGNAL:
+                  Log.noticeln("lost rocket!");
+                  EventManager.publishEvent(Event::LOST_ROCKET_EVENT);
+                  break;
 
-bool StateManagerClass::detectLost() {
-      bool rc = false;
-      struct timeval tv;
+            case FlightStateMachine::LOW_BATTERY_SIGNAL:
+                  Log.noticeln("power fail at %d.%dV", (int)snapshot.batteryVolts, (int)(snapshot.batteryVolts * 10) % 10);
+                  ev.eventType = Event::LOW_BATTERY_EVENT;
+                  ev.args.intArgs.eventArg1 = roundf(snapshot.batteryVolts * 10);
+                  EventManager.publishEvent(ev);
+                  break;
 
-      gettimeofday(&tv, NULL);
-      if (tv.tv_sec - landed_time > lostThreshold) {
-            state = Packet::LOST;
-            Log.noticeln("lost rocket!");
-            rc = true;
-            EventManager.publishEvent(Event::LOST_ROCKET_EVENT);
+            case FlightStateMachine::NO_SIGNAL:
+                  if (transition.to == FlightStateMachine::UNDER_CHUTE) {
+                        // There is no event for under CHUTE
+                        Log.noticeln("chute detected");
+                  }
+                  break;
       }
-
-      return rc;
-}
\ No newline at end of file
+}
@@ -2,20 +2,31 @@
 
 #include <subsystem.h>
 #include "packet.h"
+#include "flightstatemachine.h"
+#include "apogeepredictor.h"
+#include "deadreckoning.h"
+#include "altitudefusion.h"
+#include "stagingdetector.h"
+#include "padcalibrator.h"
+#include "timebase.h"
+#include "sensorhealth.h"
 #include <Filters.h>
 #include <Filters/MedianFilter.hpp>
 #include <CircularBuffer.hpp>
-#include <Differentiator.h>
 
-// TODO: Battery measurement or kick out battery failing state
-// TODO: pointing up
-
-class StateManagerClass : public BaseSubsystem {
+/**
+ * @brief StateManager estimates the flight state of the vehicle
+ *
+ * Sensor callbacks only queue their data, stamped with when it was acquired. A dedicated high priority task drains
+ * the queue and runs estimation and state detection at a fixed rate, so detection timing does not
+ * depend on whichever ticker happened to deliver the data.
+ *
+ */
+class StateManagerClass : public ThreadedSubsystem {
     public:
         StateManagerClass();
         virtual ~StateManagerClass();
         Status setup();
-        Status start();
 
         /**
          * @brief Get current State
@@ -69,24 +80,70 @@ class StateManagerClass : public BaseSubsystem {
          */
         int getVertVel() const;
 
+        /**
+         * @brief latencies measured from the physical event to publishing the flight event
+         *
+         */
+        struct EventLatencies {
+            uint32_t liftoffMS; ///< from first going up to LIFTOFF_EVENT
+            uint32_t burnoutMS; ///< from the burnout edge to BURNOUT_EVENT
+            uint32_t airstartMS; ///< from the ignition edge to AIRSTART_EVENT
+            uint32_t apogeeMS; ///< from max altitude reading to APOGEE_EVENT
+            int32_t apogeePredictionErrorMS; ///< predicted minus measured apogee time
+            int32_t apogeeSavedMS; ///< how much earlier the prediction could commit than APOGEE_EVENT
+            uint32_t maxSampleMS; ///< worst case time from acquiring a sample to processing it
+            uint32_t droppedSamples; ///< samples dropped because the queue was full
+            uint32_t decisionUS; ///< from acquiring the newest sample to the last state change
+            uint32_t rejectedSamples; ///< samples dropped for a sensor fault or too far from the estimate
+        };
+
+        /**
+         * @brief Get the measured event latencies
+         *
+         * @return EventLatencies
+         */
+        EventLatencies getEventLatencies() const;
+
+        /**
+         * @brief copy out the most recent state transitions
+         *
+         * @param entries where to copy to, oldest first
+         * @param maxEntries size of entries
+         * @return size_t number of entries copied
+         */
+        size_t getTransitionTrace(FlightStateMachine::TraceEntry *entries, size_t maxEntries) const;
+
+    protected:
+        virtual int taskPriority() const;
+        virtual int core();
+        virtual void taskFunction(void *parameter);
+
     private:
+        static constexpr auto DETECT_PERIOD_MS = 10; // fixed estimation/detection rate
+        static constexpr size_t QUEUE_DEPTH = 64;
+        static constexpr size_t MAX_IMU_FRAMES_PER_BATCH = 32; // larger batches are decimated to leave queue room
+        static constexpr uint64_t MAX_IMU_GAP_US = 250000; // a longer gap between frames isn't integrated over
+        // IMU batches with these are dropped. SATURATED ones are kept: the gyro is fine and clipped acceleration is
+        // closer than none through a boost the high-g can't cover.
+        static constexpr uint8_t IMU_REJECT_FAULTS = SensorHealth::INVALID | SensorHealth::STUCK | SensorHealth::STALE;
+
         static constexpr auto FT_PER_METER = 0.3048f;
         static constexpr auto G = 9.8f;
 
-        static constexpr int liftOffAltThresh = 100 * FT_PER_METER; // threshold to detect liftoff
-        static constexpr auto boostThresh = 2 * G; // threshold to establish boost/liftoff
-        static constexpr auto vertVelThresh = 100 * FT_PER_METER; // threshold to stablish boost
-
-        static constexpr auto chuteVelThresh = 200 * FT_PER_METER; // threshold of under chute/lawn dart
-        static constexpr auto chuteAccThresh = 3.0f; // threshold of under chute/lawn dart
-
+        static constexpr auto goingUpThresh = 2 * G; // acceleration that counts as going up
 
         static constexpr auto machLockoutTrigger = 800 * FT_PER_METER; // mach lockout trigger
         static constexpr auto machLockoutRelease = 100 * FT_PER_METER; // mach lockout lower threshold
+        static constexpr auto baroBlendMS = 1000.0f; // time to hand back from dead reckoning to baro after lockout
+        static constexpr auto baroCorrectionTau = 2.0f; // s, time constant of the pull of dead reckoning toward baro
 
-        static constexpr auto coastThresh = G/4; // 1/4 G is thresh to declare coast
+        static constexpr size_t BARO_HISTORY = 64; // readings kept, > baroBaselineMS at the fastest baro rate
+        static constexpr uint32_t baroBaselineMS = 100; // differentiate over at least this long, whatever the baro rate
 
-        static constexpr auto lostThreshold = 2*3600; // how long before your rocket is "lost"
+        static constexpr auto maxArmTiltDegrees = 20.0f; // how far off vertical we allow arming
+
+        static constexpr uint8_t minPublishConfidence = 50; // don't bother pyro with worse predictions
+        static constexpr uint32_t predictionPublishMS = 250; // rate limit on APOGEE_PREDICTED_EVENT
 
         char armingError[80];
 
@@ -96,59 +153,105 @@ class StateManagerClass : public BaseSubsystem {
         template <typename T>
         struct Reading {
             Reading<T>(T _value) : value(_value), time(millis()) {}
+            Reading<T>(T _value, unsigned long _time) : value(_value), time(_time) {}
             Reading<T>(){}
             T value;
             unsigned long time;
         };
 
-        CircularBuffer<Reading<float>, 10> baroReadings;
+        /**
+         * @brief a timestamped sensor sample, queued from the sensor callbacks
+         *
+         */
+        struct SensorSample {
+            enum SampleType : uint8_t {
+                BARO_SAMPLE,
+                IMU_SAMPLE,
+                GPS_SAMPLE
+            } sampleType;
+            uint64_t timeUS; // timestampUS() when the sensor acquired it
+            unsigned long time; // the same in ms, compares with millis()
+            union {
+                float altitude; // BARO_SAMPLE
+                struct {
+                    float acc[3]; // m/s^2
+                    float gyro[3]; // rad/s
+                    float dt; // s since the previous queued IMU sample
+                } imu; // IMU_SAMPLE
+                struct {
+                    int32_t altitude; // mm
+                    uint32_t vAcc; // mm
+                    uint8_t fixType;
+                } gps; // GPS_SAMPLE
+            };
+        };
+
+        uint8_t queueStorage[QUEUE_DEPTH * sizeof(SensorSample)];
+        QueueHandle_t queue;
+        StaticQueue_t staticQueue;
+
+        EventLatencies latencies;
+
+        CircularBuffer<Reading<float>, BARO_HISTORY> baroReadings;
+        CircularBuffer<Reading<float>, BARO_HISTORY> velReadings;
 
         MedianFilter<10, int> filtGPSalt;
         MedianFilter<10, float> filtBaroAlt;
         MedianFilter<100, float> filtAcc;
 
         // barometric vertical velocity
-        Differentiator vel;
         float vertVel;
 
         // barometric vertical acceleration
-        Differentiator acc;
         float vertAcc;
 
-        Packet::State state;
+        FlightStateMachine machine;
+        FlightSnapshot snapshot;
 
         // last magnitude of acc from imu
         float last_acc;
 
-        // used in liftoff detection
-        unsigned long firstGoingUp;
-        bool goingUp;
-
         // measured ground altitude for calculated AGL
         int gps_gnd_alt;
         int baro_gnd_alt;
+        PadCalibrator padCalibrator; // fed while disarmed
 
         // used in coast detection
         uint8_t burnoutCount;
+        StagingDetector stagingDetector;
+
+        // baro and GPS weighted by their expected error, used for AGL
+        AltitudeFusion altitudeFusion;
+        float fusedAGL;
+
+        // baro against dead reckoning, a bad baro is dropped rather than dragging the estimate along
+        SensorHealth baroInnovation;
+
+        // acquisition time of the newest sample processed, for decision latency
+        uint64_t newestSampleUS;
+
+        // acquisition time of the last IMU frame queued, only used from the IMU callback
+        uint64_t lastIMUFrameUS;
+
+        // accelerometer only estimate, used while the baro is untrusted
+        DeadReckoning deadReckoning;
+        float baroTrust; // 0 use dead reckoning, 1 use baro
 
         // used in apogee detection
-        bool lockOutActive;
-        long lockOutStarted;
-        Reading<float> maxAlt;
+        ApogeePredictor predictor;
+        ApogeePredictor::Prediction committedPrediction; // first prediction published to pyro
+        uint32_t lastPredictionPublished;
 
-        // used for lost rocket detection
-        int32_t landed_time;
+        void queueSample(const SensorSample &sample);
+        void rejectSample();
+        void processSample(const SensorSample &sample);
+        static float slope(const CircularBuffer<Reading<float>, BARO_HISTORY> &history);
+        bool onPad() const;
 
         void detect();
-        bool detectLiftoff();
-        bool detectBoost();
-        bool detectCoast();
-        bool detectApogee();
-        bool detectUnderChute();
-        bool detectLawnDart();
-        bool detectTouchdown();
-        bool detectPowerFail();
-        bool detectLost();
+        void updateSnapshot(unsigned long now);
+        void updatePrediction();
+        void onTransition(const FlightStateMachine::Transition &transition);
 };
 
 extern StateManagerClass StateManager;
\ No newline at end of file
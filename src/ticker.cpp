@@ -18,7 +18,10 @@ BaseSubsystem::Status Ticker::setup() {
     if (subsystems != nullptr) {
         newStatus = READY;
         for (auto i = 0; subsystems[i] != nullptr; i++) {
-            subsystems[i]->setup();
+            // registered subsystems were already set up by the manager as our deps
+            if (subsystems[i]->getStatus() == INIT) {
+                subsystems[i]->setup();
+            }
         }
     }
 
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_timer.h>
+
+/**
+ * @brief microseconds since boot, the timebase every sensor sample is stamped in
+ *
+ * 64 bits so it never wraps, and the same clock on both cores. millis() counts on the same clock, so a timestamp
+ * divided by 1000 compares directly with it.
+ *
+ */
+inline uint64_t timestampUS() {
+    return esp_timer_get_time();
+}
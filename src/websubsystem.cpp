@@ -3,6 +3,7 @@
 #include "configmanager.h"
 #include "wifisubsystem.h"
 #include "statusmanager.h"
+#include "datalogger.h"
 #include "log.h"
 //#include "radio.h"
 //#include "fileLogging.h"
@@ -112,6 +113,42 @@ BaseSubsystem::Status WebSubsystemClass::setup() {
         request->send(response);
     });
 
+    server.on("/flights", HTTP_GET, [](AsyncWebServerRequest *request) {
+        static JsonDocument json(&allocator);
+        static LogFlight flights[64];
+
+        json.clear();
+        auto response = beginJSON(request);
+        const auto count = DataLogger.listFlights(flights, sizeof(flights) / sizeof(flights[0]));
+        auto arr = json.to<JsonArray>();
+        for (size_t i = 0; i < count; i++) {
+            auto flight = arr.add<JsonObject>();
+            flight["flight"] = flights[i].ordinal;
+            flight["epoch"] = flights[i].epoch;
+            flight["bytes"] = flights[i].bytes;
+            flight["open"] = flights[i].open;
+        }
+        serializeJsonPretty(json, *response);
+        request->send(response);
+    });
+
+    // raw log of one flight, e.g. /flightlog?flight=12
+    server.on("/flightlog", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (!request->hasParam("flight")) {
+            request->send(400, "text/plain", "flight missing");
+            return;
+        }
+        const uint32_t ordinal = request->getParam("flight")->value().toInt();
+        auto response = request->beginChunkedResponse("application/octet-stream",
+            [ordinal](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return DataLogger.readFlight(ordinal, index, buffer, maxLen);
+            });
+        char disposition[48];
+        snprintf(disposition, sizeof(disposition), "attachment; filename=\"flight-%05lu.log\"", (unsigned long)ordinal);
+        response->addHeader("Content-Disposition", disposition);
+        request->send(response);
+    });
+
     server.on("/reboot", HTTP_POST, [](AsyncWebServerRequest *request) {
         Log.noticeln("rebooting on request");
         ESP.restart();
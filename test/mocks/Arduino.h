@@ -0,0 +1,10 @@
+#pragma once
+
+// just enough of the Arduino core to compile driver wrappers on the host for the native tests
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#define IRAM_ATTR
@@ -0,0 +1,14 @@
+#pragma once
+
+// swallows log output, a test that includes a source file that logs defines Log
+
+class Logging {
+    public:
+        template<class... Args> void noticeln(Args...) {}
+        template<class... Args> void errorln(Args...) {}
+        template<class... Args> void warningln(Args...) {}
+        template<class... Args> void infoln(Args...) {}
+        template<class... Args> void traceln(Args...) {}
+};
+
+extern Logging Log;
@@ -0,0 +1,68 @@
+#pragma once
+
+// the part of the ESP-IDF SPI master driver API SPIBus uses, the native tests implement the functions
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+
+typedef enum { SPI1_HOST, SPI2_HOST, SPI3_HOST } spi_host_device_t;
+
+#define SPI_DMA_CH_AUTO 3
+#define SPI_DEVICE_HALFDUPLEX (1 << 4)
+#define SPI_TRANS_VARIABLE_ADDR (1 << 6)
+#define SPI_TRANS_VARIABLE_DUMMY (1 << 7)
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+} spi_bus_config_t;
+
+struct spi_transaction_t;
+typedef void (*transaction_cb_t)(spi_transaction_t *trans);
+
+typedef struct {
+    uint8_t command_bits;
+    uint8_t address_bits;
+    uint8_t dummy_bits;
+    uint8_t mode;
+    int clock_speed_hz;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+    transaction_cb_t pre_cb;
+    transaction_cb_t post_cb;
+} spi_device_interface_config_t;
+
+struct spi_transaction_t {
+    uint32_t flags;
+    uint16_t cmd;
+    uint64_t addr;
+    size_t length;      // bits
+    size_t rxlength;    // bits
+    void *user;
+    const void *tx_buffer;
+    void *rx_buffer;
+};
+
+typedef struct {
+    spi_transaction_t base;
+    uint8_t command_bits;
+    uint8_t address_bits;
+    uint8_t dummy_bits;
+} spi_transaction_ext_t;
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+    spi_device_handle_t *handle);
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t ticks);
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans, TickType_t ticks);
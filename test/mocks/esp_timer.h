@@ -0,0 +1,7 @@
+#pragma once
+
+// esp_timer_get_time, the native tests implement it
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
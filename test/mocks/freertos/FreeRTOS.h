@@ -0,0 +1,18 @@
+#pragma once
+
+// only the FreeRTOS types the headers under test name, nothing runs on them on the host
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef struct { int opaque; } StaticTask_t;
+typedef struct { int opaque; } StaticQueue_t;
+typedef struct { int opaque; } StaticSemaphore_t;
+
+#define portMAX_DELAY ((TickType_t)0xffffffff)
@@ -0,0 +1,109 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "altitudefusion.h"
+
+/**
+ * @brief the baro error bands and how baro and GPS are weighted through them, and the age of the GPS fix
+ *
+ * With a fresh fix the baro weight is gpsVar / (gpsVar + baroVar), so the baro sigma the fusion used can be read back
+ * out of the weight for a GPS sigma the test picks.
+ *
+ */
+static constexpr float GPS_SIGMA = 10.0f;   // m, a fair vertical accuracy in flight
+static constexpr float BARO_AGL = 1000.0f;  // m, what the baro says
+static constexpr float GPS_AGL = 1100.0f;   // m, what the GPS says
+
+// the baro sigma the last update used, from its weight
+static float baroSigma(const AltitudeFusion &fusion) {
+    const auto w = fusion.baroWeight();
+    return GPS_SIGMA * sqrtf((1 - w) / w);
+}
+
+static float fuseAt(AltitudeFusion &fusion, float altitude) {
+    fusion.setGPS(1000, GPS_AGL, GPS_SIGMA);
+    return fusion.update(1000, BARO_AGL, altitude, 0);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_baro_bands() {
+    // sea level and below, the band edges, between them, and beyond the last
+    const struct {
+        float altitude;
+        float sigma;
+    } expected[] = {
+        {-200, 1}, {0, 1}, {4500, 2}, {9000, 3}, {12000, 9}, {15000, 15}, {20000, 60}, {22500, 155}, {25000, 250},
+        {30000, 1000}, {40000, 1000},
+    };
+    AltitudeFusion fusion;
+    for (const auto &e : expected) {
+        fuseAt(fusion, e.altitude);
+        printf("%6.0f m: baro sigma %7.2f m, weight %.4f\n", e.altitude, baroSigma(fusion), fusion.baroWeight());
+        TEST_ASSERT_FLOAT_WITHIN(e.sigma * 0.01f, e.sigma, baroSigma(fusion));
+    }
+}
+
+void test_weighting_by_altitude() {
+    AltitudeFusion fusion;
+    // low down the baro is ten times better than the GPS
+    auto agl = fuseAt(fusion, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f / 101, fusion.baroWeight());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, BARO_AGL, agl);
+
+    // at 15km the baro is worse, the GPS gets most of the say
+    agl = fuseAt(fusion, 15000);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f / 325, fusion.baroWeight());
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, BARO_AGL * 100 / 325 + GPS_AGL * 225 / 325, agl);
+
+    // at 25km the baro is next to useless
+    agl = fuseAt(fusion, 25000);
+    TEST_ASSERT_TRUE(fusion.baroWeight() < 0.002f);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, GPS_AGL, agl);
+}
+
+void test_gps_age() {
+    AltitudeFusion fusion;
+    fusion.setGPS(1000, GPS_AGL, GPS_SIGMA);
+    // carried forward at the vertical velocity, and trusted less
+    TEST_ASSERT_EQUAL_FLOAT(GPS_AGL + 100, fusion.update(2000, GPS_AGL + 100, 25000, 100));
+    const auto fresh = fusion.update(1000, BARO_AGL, 15000, 0);
+    const auto freshWeight = fusion.baroWeight();
+    fusion.update(2000, BARO_AGL, 15000, 0);
+    TEST_ASSERT_TRUE(fusion.baroWeight() > freshWeight);
+    TEST_ASSERT_TRUE(fresh > BARO_AGL);
+
+    // too old, baro only
+    TEST_ASSERT_EQUAL_FLOAT(BARO_AGL, fusion.update(3001, BARO_AGL, 15000, 0));
+    TEST_ASSERT_EQUAL_FLOAT(1, fusion.baroWeight());
+
+    // no GPS at all
+    fusion.clearGPS();
+    TEST_ASSERT_EQUAL_FLOAT(BARO_AGL, fusion.update(1000, BARO_AGL, 15000, 0));
+}
+
+void test_fix_after_sample() {
+    AltitudeFusion fusion;
+    // the fix is stamped a few ms after the baro sample, it counts as fresh rather than wrapping to ancient
+    fusion.setGPS(1005, GPS_AGL, GPS_SIGMA);
+    fusion.update(1000, BARO_AGL, 15000, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f / 325, fusion.baroWeight());
+
+    // and across millis() wrapping, a fix 500ms old is still used
+    fusion.setGPS(0xFFFFFF00, GPS_AGL, GPS_SIGMA);
+    fusion.update(0xFFFFFF00 + 500, BARO_AGL, 15000, 0);
+    TEST_ASSERT_TRUE(fusion.baroWeight() < 1);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_baro_bands);
+    RUN_TEST(test_weighting_by_altitude);
+    RUN_TEST(test_gps_age);
+    RUN_TEST(test_fix_after_sample);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "apogeepredictor.h"
+
+/**
+ * @brief simulated coasts with different drag and sensor noise, to check how close and how early apogee is predicted
+ *
+ * Each coast starts at burnout and is integrated in 1ms steps with gravity plus quadratic drag. The predictor is fed
+ * every 10ms like StateManager does in COAST: velocity from the baro with its noise, and deceleration from the
+ * accelerometer with its own. The first prediction StateManager would commit, valid and at least 50% confident, is
+ * compared against the true apogee time, and against when the 1000ms dwell would declare apogee.
+ *
+ */
+static constexpr float G = 9.8f;
+static constexpr uint32_t STEP_MS = 10;
+static constexpr uint32_t BURNOUT_MS = 3000;
+static constexpr uint8_t MIN_CONFIDENCE = 50; // StateManager's minPublishConfidence
+static constexpr uint32_t APOGEE_DWELL_MS = 1000; // the state machine's apogeeDwellMS
+
+struct Coast {
+    const char *name;
+    float burnoutVel;   // m/s
+    float k;            // drag, 1/m: deceleration is G + k * v^2
+    float velNoise;     // m/s, peak
+    float accNoise;     // m/s^2, peak
+    int32_t maxErrorMS; // predicted minus true apogee time, either way
+};
+
+static const Coast coasts[] = {
+    {"vacuum, quiet", 150, 0, 0.2f, 0.1f, 30},
+    {"light drag", 200, 0.0002f, 0.5f, 0.3f, 60},
+    {"draggy", 250, 0.001f, 1.0f, 0.5f, 100},
+    {"very draggy, noisy", 300, 0.003f, 2.0f, 1.5f, 200},
+    {"slow, noisy", 60, 0.0005f, 2.0f, 1.5f, 300},
+};
+
+// the prediction has to beat the dwell by most of it, or it isn't worth having
+static constexpr int32_t MIN_SAVED_MS = 700;
+
+static uint32_t seed;
+
+// deterministic noise in -1..1
+static float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int32_t>(seed) / 2147483648.0f;
+}
+
+struct Result {
+    bool committed;
+    uint32_t committedAt;   // ms, when the prediction would be committed
+    uint32_t predicted;     // ms, the committed apogee time
+    uint32_t apogee;        // ms, the true apogee time
+};
+
+static Result fly(const Coast &coast) {
+    ApogeePredictor predictor;
+    Result result = {false, 0, 0, 0};
+    auto vel = coast.burnoutVel;
+    uint32_t ms = BURNOUT_MS;
+    while (vel > 0) {
+        // 1ms integration steps, the predictor sees every tenth
+        const auto decel = G + coast.k * vel * vel;
+        vel -= decel / 1000;
+        ms++;
+        if (ms % STEP_MS == 0 && vel > 0) {
+            const auto prediction = predictor.update(ms, vel + coast.velNoise * noise(),
+                -(G + coast.k * vel * vel) + coast.accNoise * noise());
+            if (!result.committed && prediction.valid && prediction.confidence >= MIN_CONFIDENCE) {
+                result.committed = true;
+                result.committedAt = ms;
+                result.predicted = prediction.apogeeTime;
+            }
+        }
+    }
+    result.apogee = ms;
+    return result;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_predicts_apogee() {
+    for (const auto &coast : coasts) {
+        const auto result = fly(coast);
+        const auto error = static_cast<int32_t>(result.predicted - result.apogee);
+        const auto saved = static_cast<int32_t>(result.apogee + APOGEE_DWELL_MS - result.predicted);
+        printf("%-20s apogee %5u ms, committed %5u ms before, error %4d ms, %4d ms before the dwell\n",
+            coast.name, result.apogee, result.apogee - result.committedAt, error, saved);
+
+        TEST_ASSERT_TRUE_MESSAGE(result.committed, coast.name);
+        TEST_ASSERT_TRUE_MESSAGE(result.committedAt < result.apogee, coast.name);
+        TEST_ASSERT_TRUE_MESSAGE(abs(error) <= coast.maxErrorMS, coast.name);
+        TEST_ASSERT_TRUE_MESSAGE(saved >= MIN_SAVED_MS, coast.name);
+    }
+}
+
+void test_drag_matters() {
+    // projecting at constant deceleration would be seconds early on a fast draggy coast
+    const auto &coast = coasts[3];
+    const auto result = fly(coast);
+    const auto constantDecelS = coast.burnoutVel / (G + coast.k * coast.burnoutVel * coast.burnoutVel);
+    TEST_ASSERT_TRUE(result.apogee - BURNOUT_MS > 1000 * constantDecelS + 2000);
+    TEST_ASSERT_TRUE(abs(static_cast<int32_t>(result.predicted - result.apogee)) <= coast.maxErrorMS);
+}
+
+void test_not_coasting_up() {
+    ApogeePredictor predictor;
+    for (uint32_t ms = 0; ms < 200; ms += STEP_MS) {
+        predictor.update(ms, 100, -G);
+    }
+    TEST_ASSERT_TRUE(predictor.prediction().valid);
+
+    // thrusting again, or going down, forgets the history
+    TEST_ASSERT_FALSE(predictor.update(200, 100, 20).valid);
+    TEST_ASSERT_FALSE(predictor.update(210, 100, -G).valid);
+    predictor.reset();
+    TEST_ASSERT_FALSE(predictor.update(220, -1, -G).valid);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_predicts_apogee);
+    RUN_TEST(test_drag_matters);
+    RUN_TEST(test_not_coasting_up);
+    return UNITY_END();
+}
@@ -0,0 +1,157 @@
+#include <unity.h>
+#include <math.h>
+#include "deadreckoning.h"
+
+/**
+ * @brief a synthetic flight through mach, to check dead reckoning holds up while the baro is locked out
+ *
+ * The rocket leaves a rail tilted off vertical and flies straight along its axis, spinning slowly about it. Whatever
+ * keeps it straight pushes sideways against gravity, which the IMU sees. Thrust is constant, drag is quadratic. The
+ * IMU has a bias and noise, the baro has noise and reads hundreds of meters off while transonic, which is what the
+ * lockout is for.
+ *
+ */
+static constexpr float G = 9.8f;
+static constexpr float DT = 1.0f / 1000; // IMU rate
+static constexpr int BARO_DECIMATION = 20; // 50Hz baro
+static constexpr float RAIL_ANGLE = 5 * M_PI / 180;
+static constexpr float THRUST = 20 * G; // m/s^2 along the axis
+static constexpr float BURN_S = 2.5f;
+static constexpr float DRAG_K = 0.0002f; // per m, drag acceleration is DRAG_K*v^2
+static constexpr float SPIN = 2.0f; // rad/s about the long axis
+static constexpr float ACC_BIAS = 0.05f; // m/s^2 along the axis
+static constexpr float ACC_NOISE = 0.3f; // m/s^2, peak
+static constexpr float BARO_NOISE = 0.5f; // m, peak
+static constexpr float BARO_TAU = 2.0f; // s, same pull as StateManager's baroCorrectionTau
+
+// mach lockout thresholds, the same as StateManager's, in m/s
+static constexpr float LOCKOUT_TRIGGER = 800 * 0.3048f;
+static constexpr float LOCKOUT_RELEASE = 100 * 0.3048f;
+
+static uint32_t seed;
+
+// deterministic noise in -1..1
+static float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int32_t>(seed) / 2147483648.0f;
+}
+
+struct Truth {
+    float speed; // along the axis
+    float altitude;
+    float velocity; // vertical
+    float axial; // specific force along the axis
+};
+
+static void step(Truth &truth, float t) {
+    const auto thrust = t < BURN_S ? THRUST : 0;
+    const auto drag = DRAG_K * truth.speed * fabsf(truth.speed);
+    truth.axial = thrust - drag;
+    const auto acc = truth.axial - G * cosf(RAIL_ANGLE); // along the axis
+    truth.altitude += truth.speed * cosf(RAIL_ANGLE) * DT + 0.5f * acc * cosf(RAIL_ANGLE) * DT * DT;
+    truth.speed += acc * DT;
+    truth.velocity = truth.speed * cosf(RAIL_ANGLE);
+}
+
+// what the IMU reads, body z along the axis, spinning about it from liftoff at t = 0
+static void imu(const Truth &truth, float t, float acc[3], float gyro[3], bool onPad) {
+    const auto axial = onPad ? G * cosf(RAIL_ANGLE) : truth.axial;
+    const auto roll = onPad ? 0 : SPIN * t;
+    const auto lateral = -G * sinf(RAIL_ANGLE);
+    acc[0] = lateral * cosf(roll) + ACC_NOISE * noise();
+    acc[1] = -lateral * sinf(roll) + ACC_NOISE * noise();
+    acc[2] = axial + ACC_BIAS + ACC_NOISE * noise();
+    gyro[0] = 0;
+    gyro[1] = 0;
+    gyro[2] = onPad ? 0 : SPIN;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_up_axis_learnt_on_pad() {
+    DeadReckoning dr;
+    Truth truth = {};
+    float acc[3], gyro[3];
+    for (auto i = 0; i < 5000; i++) {
+        imu(truth, 0, acc, gyro, true);
+        dr.calibrate(DT, acc);
+    }
+    dr.start(0, 0);
+    // the pad reads 1G along the tilted up axis
+    imu(truth, 0, acc, gyro, true);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, G * cosf(RAIL_ANGLE), dr.axialAcceleration(acc));
+    dr.update(DT, acc, gyro);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 0, dr.verticalAcceleration());
+}
+
+void test_transonic_flight_through_lockout() {
+    DeadReckoning dr;
+    Truth truth = {};
+    float acc[3], gyro[3];
+    for (auto i = 0; i < 5000; i++) {
+        imu(truth, 0, acc, gyro, true);
+        dr.calibrate(DT, acc);
+    }
+    dr.start(0, 0);
+
+    bool lockout = false;
+    bool wasLocked = false;
+    float worstVelocity = 0;
+    float worstAltitude = 0;
+    float worstBaro = 0;
+    float releasedAt = 0;
+    auto t = 0.0f;
+    for (auto i = 0; truth.velocity >= 0 || i * DT < BURN_S; i++, t += DT) {
+        step(truth, t);
+        imu(truth, t, acc, gyro, false);
+        dr.update(DT, acc, gyro);
+
+        if (!lockout && dr.velocity() > LOCKOUT_TRIGGER) {
+            lockout = wasLocked = true;
+        }
+        if (lockout && dr.velocity() < LOCKOUT_RELEASE) {
+            lockout = false;
+            releasedAt = t;
+        }
+
+        if (i % BARO_DECIMATION == 0) {
+            // the pressure field around the nose reads far low through transonic
+            const auto speed = truth.speed / 340;
+            const auto shock = speed > 0.8f && speed < 1.2f ? -300.0f : 0.0f;
+            const auto baro = truth.altitude + shock + BARO_NOISE * noise();
+            const auto dt = BARO_DECIMATION * DT;
+            dr.correct(baro, truth.velocity, lockout ? 0 : dt / (BARO_TAU + dt));
+            worstBaro = fmaxf(worstBaro, fabsf(baro - truth.altitude));
+        }
+
+        if (lockout) {
+            worstVelocity = fmaxf(worstVelocity, fabsf(dr.velocity() - truth.velocity));
+            worstAltitude = fmaxf(worstAltitude, fabsf(dr.altitude() - truth.altitude));
+        }
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(wasLocked, "never went fast enough to lock out");
+    TEST_ASSERT_TRUE_MESSAGE(releasedAt > 0, "lockout never released");
+    TEST_ASSERT_TRUE_MESSAGE(worstBaro > 250, "the baro was never wrong, nothing was tested");
+
+    // bias alone is worth ACC_BIAS*t of velocity and ACC_BIAS*t^2/2 of altitude over the ~22s locked out
+    TEST_ASSERT_LESS_THAN_FLOAT(2.0f, worstVelocity);
+    TEST_ASSERT_LESS_THAN_FLOAT(20.0f, worstAltitude);
+
+    // apogee is ~3s after the release, the baro has pulled most of the drift back out by then
+    TEST_ASSERT_GREATER_THAN_FLOAT(releasedAt, t);
+    TEST_ASSERT_FLOAT_WITHIN(6.0f, truth.altitude, dr.altitude());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, truth.velocity, dr.velocity());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_up_axis_learnt_on_pad);
+    RUN_TEST(test_transonic_flight_through_lockout);
+    return UNITY_END();
+}
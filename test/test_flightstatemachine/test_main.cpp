@@ -0,0 +1,282 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "flightstatemachine.h"
+
+/**
+ * @brief synthetic flights replayed through the state machine, to check the transitions, the trace and the step cost
+ *
+ * Snapshots come every 10ms, as StateManager steps the machine. The rocket boosts at 6G for 3s and coasts without
+ * drag. With a chute it comes down at 6m/s from apogee, without one it falls until it hits. The caller side is
+ * simulated too: maxAGL is tracked, the chute opens on the apogee signal. The accelerometer is noisy and reads 1G on
+ * the ground, with a little bias.
+ *
+ */
+static constexpr float G = 9.8f;
+static constexpr uint32_t STEP_MS = 10;
+static constexpr uint32_t ARM_MS = 1000;
+static constexpr uint32_t IGNITION_MS = 2000;
+static constexpr uint32_t BURN_MS = 3000;
+static constexpr float THRUST = 6 * G; // m/s^2, net of gravity
+static constexpr float CHUTE_VEL = -6; // m/s
+static constexpr float CHUTE_TAU = 0.5f; // s, the chute slows the rocket with this time constant
+static constexpr float ACC_NOISE = 0.3f; // m/s^2, peak
+static constexpr float ACC_BIAS = 0.1f; // m/s^2
+static constexpr uint32_t LOST_MS = 2 * 3600 * 1000UL; // TOUCHDOWN to LOST
+static constexpr uint32_t REPLAYS = 200; // of the recorded snapshots, for timing
+
+// a host figure, a step is a handful of float compares so this is very conservative
+static constexpr double MIN_STEPS_PER_S = 1e6;
+
+static uint32_t seed;
+
+// deterministic noise in -1..1
+static float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int32_t>(seed) / 2147483648.0f;
+}
+
+/**
+ * @brief a point mass flight, driven by the machine's own transitions like StateManager drives the rocket
+ *
+ */
+class Flight {
+    public:
+        explicit Flight(bool chute) : chute(chute), deployed(false), alt(0), vel(0), acc(0), snapshot{} {
+            snapshot.batteryVolts = 8.0f;
+        }
+
+        // fly until the machine reaches state or timeout, recording every snapshot stepped
+        void flyUntil(FlightStateMachine &machine, FlightStateMachine::State state, uint32_t timeoutMS) {
+            while (machine.state() != state && snapshot.time < timeoutMS) {
+                advance();
+                const auto transition = machine.step(snapshot);
+                recorded.push_back(snapshot);
+                if (transition != nullptr) {
+                    onTransition(*transition);
+                }
+            }
+        }
+
+        // on the ground for a long time, in 1s steps so the LOST timeout doesn't take forever
+        void restUntil(FlightStateMachine &machine, uint32_t timeMS) {
+            while (snapshot.time < timeMS) {
+                snapshot.time += 1000;
+                machine.step(snapshot);
+            }
+        }
+
+        std::vector<FlightSnapshot> recorded;
+        const FlightSnapshot &current() const {
+            return snapshot;
+        }
+
+    private:
+        bool chute;
+        bool deployed;
+        float alt;
+        float vel;
+        float acc;
+        FlightSnapshot snapshot;
+
+        void advance() {
+            const auto dt = STEP_MS / 1000.0f;
+            const auto t = snapshot.time + STEP_MS;
+            if (t < IGNITION_MS) {
+                acc = 0;
+            } else if (t < IGNITION_MS + BURN_MS) {
+                acc = THRUST;
+            } else if (deployed) {
+                acc = (CHUTE_VEL - vel) / CHUTE_TAU;
+            } else {
+                acc = -G;
+            }
+            vel += acc * dt;
+            alt += vel * dt;
+            if (alt <= 0 && t > IGNITION_MS + BURN_MS) {
+                // hit the ground
+                alt = 0;
+                vel = 0;
+                acc = 0;
+            }
+
+            snapshot.time = t;
+            snapshot.agl = alt;
+            snapshot.gpsAGL = alt;
+            snapshot.vertVel = vel;
+            snapshot.vertAcc = acc;
+            // specific force: gravity isn't felt in free fall
+            snapshot.accMag = fabsf(acc + G) + ACC_BIAS + ACC_NOISE * noise();
+            snapshot.thrusting = acc > 0 && t < IGNITION_MS + BURN_MS;
+            if (vel > 0 && acc > 0) {
+                if (snapshot.goingUpSince == 0) {
+                    snapshot.goingUpSince = t;
+                }
+            } else {
+                snapshot.goingUpSince = 0;
+            }
+            if (alt > snapshot.maxAGL) {
+                snapshot.maxAGL = alt;
+                snapshot.maxAGLTime = t;
+            }
+        }
+
+        void onTransition(const FlightStateMachine::Transition &transition) {
+            if (transition.signal == FlightStateMachine::APOGEE_SIGNAL) {
+                deployed = chute;
+            }
+        }
+};
+
+// the trace from the first entry on, against the expected states
+static void checkTrace(const FlightStateMachine &machine, const FlightStateMachine::State *states, size_t count) {
+    TEST_ASSERT_EQUAL(count - 1, machine.traceLength());
+    for (size_t i = 0; i + 1 < count; i++) {
+        TEST_ASSERT_EQUAL(states[i], machine.trace(i).from);
+        TEST_ASSERT_EQUAL(states[i + 1], machine.trace(i).to);
+        if (i > 0) {
+            TEST_ASSERT_TRUE(machine.trace(i).time >= machine.trace(i - 1).time);
+        }
+    }
+}
+
+static float apogeeS() {
+    const auto burnoutVel = THRUST * BURN_MS / 1000.0f;
+    return (IGNITION_MS + BURN_MS) / 1000.0f + burnoutVel / G;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_chute_flight() {
+    FlightStateMachine machine;
+    Flight flight(true);
+    machine.reset(FlightStateMachine::DISARMED, 0);
+    machine.reset(FlightStateMachine::ARMED, ARM_MS);
+
+    flight.flyUntil(machine, FlightStateMachine::BOOST, 60000);
+    TEST_ASSERT_EQUAL(FlightStateMachine::BOOST, machine.state());
+    // 100' at 6G takes about 1020ms, the 100ms going up is well inside that
+    TEST_ASSERT_UINT32_WITHIN(2 * STEP_MS, IGNITION_MS + 1020, machine.trace(machine.traceLength() - 1).time);
+
+    flight.flyUntil(machine, FlightStateMachine::COAST, 60000);
+    TEST_ASSERT_UINT32_WITHIN(STEP_MS, IGNITION_MS + BURN_MS, machine.trace(machine.traceLength() - 1).time);
+
+    // the apogee dwell
+    flight.flyUntil(machine, FlightStateMachine::APOGEE, 60000);
+    TEST_ASSERT_UINT32_WITHIN(2 * STEP_MS, apogeeS() * 1000 + 1000, machine.trace(machine.traceLength() - 1).time);
+
+    flight.flyUntil(machine, FlightStateMachine::TOUCHDOWN, 600000);
+    TEST_ASSERT_EQUAL(FlightStateMachine::TOUCHDOWN, machine.state());
+    TEST_ASSERT_EQUAL_FLOAT(0, flight.current().agl);
+    const auto landed = machine.trace(machine.traceLength() - 1).time;
+
+    flight.restUntil(machine, landed + LOST_MS + 1000);
+    TEST_ASSERT_EQUAL(FlightStateMachine::LOST, machine.state());
+
+    const FlightStateMachine::State states[] = {
+        FlightStateMachine::INIT, FlightStateMachine::DISARMED, FlightStateMachine::ARMED, FlightStateMachine::BOOST,
+        FlightStateMachine::COAST, FlightStateMachine::APOGEE, FlightStateMachine::UNDER_CHUTE,
+        FlightStateMachine::TOUCHDOWN, FlightStateMachine::LOST,
+    };
+    checkTrace(machine, states, sizeof(states) / sizeof(states[0]));
+    TEST_ASSERT_UINT32_WITHIN(1000, landed + LOST_MS, machine.trace(machine.traceLength() - 1).time);
+}
+
+void test_lawn_dart() {
+    FlightStateMachine machine;
+    Flight flight(false);
+    machine.reset(FlightStateMachine::DISARMED, 0);
+    machine.reset(FlightStateMachine::ARMED, ARM_MS);
+
+    flight.flyUntil(machine, FlightStateMachine::TOUCHDOWN, 600000);
+    TEST_ASSERT_EQUAL(FlightStateMachine::TOUCHDOWN, machine.state());
+
+    // stopped dead in the ground, that reads as slow and steady for a step before it reads as landed
+    const FlightStateMachine::State states[] = {
+        FlightStateMachine::INIT, FlightStateMachine::DISARMED, FlightStateMachine::ARMED, FlightStateMachine::BOOST,
+        FlightStateMachine::COAST, FlightStateMachine::APOGEE, FlightStateMachine::LAWN_DART,
+        FlightStateMachine::UNDER_CHUTE, FlightStateMachine::TOUCHDOWN,
+    };
+    checkTrace(machine, states, sizeof(states) / sizeof(states[0]));
+    // lawn dart once falling faster than 200'/s, about 6.2s after the apogee
+    const auto dart = machine.trace(5).time;
+    TEST_ASSERT_UINT32_WITHIN(2 * STEP_MS, apogeeS() * 1000 + 6220, dart);
+}
+
+void test_touchdown_needs_rest() {
+    FlightStateMachine machine;
+    FlightSnapshot s = {};
+    machine.reset(FlightStateMachine::UNDER_CHUTE, 0);
+
+    // still swinging on the chute
+    s.time = 10;
+    s.accMag = G + 2.5f;
+    TEST_ASSERT_NULL(machine.step(s));
+
+    // at rest, reading a bit over 1G
+    s.time = 20;
+    s.accMag = G + ACC_BIAS + ACC_NOISE;
+    const auto transition = machine.step(s);
+    TEST_ASSERT_NOT_NULL(transition);
+    TEST_ASSERT_EQUAL(FlightStateMachine::LANDING_SIGNAL, transition->signal);
+}
+
+void test_power_fail_after_touchdown() {
+    FlightStateMachine machine;
+    FlightSnapshot s = {};
+    machine.reset(FlightStateMachine::TOUCHDOWN, 0);
+
+    // not measured yet
+    s.time = 1000;
+    TEST_ASSERT_NULL(machine.step(s));
+    s.time = 2000;
+    s.batteryVolts = 6.0f;
+    TEST_ASSERT_NOT_NULL(machine.step(s));
+    TEST_ASSERT_EQUAL(FlightStateMachine::POWER_FAIL, machine.state());
+}
+
+void test_step_rate() {
+    FlightStateMachine machine;
+    Flight flight(true);
+    machine.reset(FlightStateMachine::ARMED, ARM_MS);
+    flight.flyUntil(machine, FlightStateMachine::TOUCHDOWN, 600000);
+    const auto &snapshots = flight.recorded;
+
+    // the recorded snapshots drive a fresh machine the same way
+    size_t steps = 0;
+    size_t transitions = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < REPLAYS; r++) {
+        FlightStateMachine replay;
+        replay.reset(FlightStateMachine::ARMED, ARM_MS);
+        for (const auto &s : snapshots) {
+            transitions += replay.step(s) != nullptr;
+        }
+        steps += snapshots.size();
+        TEST_ASSERT_EQUAL(FlightStateMachine::TOUCHDOWN, replay.state());
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TEST_ASSERT_EQUAL(REPLAYS * 5, transitions);
+    const auto rate = steps / elapsed;
+    printf("%zu steps in %.1f ms, %.1f ns each, %.2fM steps/s\n", steps, elapsed * 1e3, elapsed * 1e9 / steps,
+        rate / 1e6);
+    TEST_ASSERT_TRUE(rate > MIN_STEPS_PER_S);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_chute_flight);
+    RUN_TEST(test_lawn_dart);
+    RUN_TEST(test_touchdown_needs_rest);
+    RUN_TEST(test_power_fail_after_touchdown);
+    RUN_TEST(test_step_rate);
+    return UNITY_END();
+}
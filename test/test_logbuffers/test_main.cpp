@@ -0,0 +1,255 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "logbuffers.h"
+
+/**
+ * @brief a minute of flight logged through the double buffer to a slow storage, as the logger task writes it
+ *
+ * Time is simulated in ms. Every 10ms the IMU hands over 16 frames at 1600Hz, the baro a sample at 200Hz, and a
+ * status packet goes in every 100ms. The writer takes the oldest full buffer, seals and writes it, and only releases
+ * it once storage has taken its time: WRITE_MS per buffer, with a long STALL_MS every few writes, as LittleFS does
+ * when it garbage collects.
+ *
+ */
+static constexpr uint32_t FLIGHT_MS = 60 * 1000;
+static constexpr uint32_t BATCH_MS = 10;
+static constexpr uint32_t FRAMES = 16;
+static constexpr uint32_t PERIOD_US = 625;
+static constexpr uint32_t BARO_MS = 5;
+static constexpr uint32_t STATUS_MS = 100;
+static constexpr uint32_t WRITE_MS = 300;
+static constexpr uint32_t STALL_MS = 1500;
+static constexpr uint32_t STALL_EVERY = 5;
+static constexpr uint32_t LOG_ID = 0x5EED1E55;
+static constexpr uint32_t SESSION = 1;
+
+static uint32_t seed;
+
+// deterministic noise in -1..1
+static float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int32_t>(seed) / 2147483648.0f;
+}
+
+/**
+ * @brief keeps what is written, how long each write takes is up to the test
+ *
+ */
+class SlowStorage : public LogStorage {
+    public:
+        std::vector<uint8_t> bytes;
+        std::vector<const uint8_t*> writes; // the buffer each write came from
+
+        bool begin() { return true; }
+        bool open(uint32_t) { return true; }
+        size_t write(const uint8_t *data, size_t length, bool) {
+            bytes.insert(bytes.end(), data, data + length);
+            writes.push_back(data);
+            return length;
+        }
+        void close() {}
+        bool maintain(bool, bool) { return false; }
+        size_t flights(LogFlight *, size_t) { return 0; }
+        size_t read(uint32_t, size_t, uint8_t *, size_t) { return 0; }
+        void logStats() {}
+};
+
+struct Run {
+    uint32_t appended;
+    uint32_t dropped;
+    uint32_t imuAppended;
+    uint32_t fullSignals;
+    std::vector<uint64_t> imuTimes; // of the frames that made it
+};
+
+static uint8_t first[LogBuffers::BUFFER_SIZE];
+static uint8_t second[LogBuffers::BUFFER_SIZE];
+static SlowStorage storage;
+
+static void countFull(void *arg) {
+    static_cast<Run*>(arg)->fullSignals++;
+}
+
+static void add(LogBuffers &buffers, Run &run, uint32_t ms, LogRecordType type, const void *payload, size_t length) {
+    run.appended++;
+    if (!buffers.append(SESSION, LOG_ID, ms, type, payload, length)) {
+        run.dropped++;
+    } else if (type == IMU_RECORD) {
+        run.imuTimes.push_back(static_cast<const LogIMUSample*>(payload)->time);
+    }
+}
+
+// fly, with each buffer write taking writeMS and every stallEvery-th one stallMS
+static Run fly(uint32_t writeMS, uint32_t stallMS, uint32_t stallEvery) {
+    LogBuffers buffers;
+    Run run = {};
+    uint32_t blockSequence = 0;
+    LogBuffers::Buffer *writing = nullptr;
+    uint32_t doneAt = 0;
+    uint64_t us = 1000000;
+
+    storage = SlowStorage();
+    buffers.begin(first, second, countFull, &run);
+    add(buffers, run, 0, HEADER_RECORD, &LOG_ID, sizeof(LOG_ID));
+
+    for (uint32_t ms = 0; ms < FLIGHT_MS; ms++) {
+        if (ms % BATCH_MS == 0) {
+            for (uint32_t i = 0; i < FRAMES; i++) {
+                LogIMUSample sample = {};
+                sample.time = us;
+                for (auto k = 0; k < 3; k++) {
+                    sample.acc[k] = (k == 2 ? 30.0f : 0) + 0.5f * noise();
+                    sample.gyro[k] = 0.01f * noise();
+                }
+                run.imuAppended++;
+                add(buffers, run, ms, IMU_RECORD, &sample, sizeof(sample));
+                us += PERIOD_US;
+            }
+        }
+        if (ms % BARO_MS == 0) {
+            const LogBaroSample baro = {us, 100 + ms * 0.1f + 0.2f * noise(), 20, 0};
+            add(buffers, run, ms, BARO_RECORD, &baro, sizeof(baro));
+        }
+        if (ms % STATUS_MS == 0) {
+            const uint8_t status[LogFormat::STATUS_SIZE] = {};
+            add(buffers, run, ms, STATUS_RECORD, status, sizeof(status));
+        }
+
+        // the logger task
+        if (writing != nullptr && ms >= doneAt) {
+            buffers.release(*writing);
+            writing = nullptr;
+        }
+        if (writing == nullptr && (writing = buffers.next()) != nullptr) {
+            TEST_ASSERT_EQUAL(writing->length, LogBuffers::write(*writing, storage, blockSequence, true));
+            doneAt = ms + (storage.writes.size() % stallEvery == 0 ? stallMS : writeMS);
+        }
+    }
+
+    // landed, what is left is flushed
+    if (writing != nullptr) {
+        buffers.release(*writing);
+    }
+    TEST_ASSERT_TRUE(buffers.swap());
+    while ((writing = buffers.next()) != nullptr) {
+        LogBuffers::write(*writing, storage, blockSequence, false);
+        buffers.release(*writing);
+    }
+    TEST_ASSERT_TRUE(buffers.empty());
+    return run;
+}
+
+// every block sealed in order, keyframes first, nothing straddling; returns the IMU times decoded
+static std::vector<uint64_t> checkBlocks() {
+    std::vector<uint64_t> times;
+    TEST_ASSERT_EQUAL(0, storage.bytes.size() % LogBuffers::BLOCK_SIZE);
+    for (size_t offset = 0; offset < storage.bytes.size(); offset += LogBuffers::BLOCK_SIZE) {
+        const auto block = &storage.bytes[offset];
+        TEST_ASSERT_TRUE(logSealed(block, LOG_ID, offset / LogBuffers::BLOCK_SIZE));
+
+        // each block decodes on its own
+        LogDecoder decoder;
+        LogDecoder::Record record;
+        bool imuSeen = false;
+        bool baroSeen = false;
+        size_t at = 0;
+        while (at < LogBuffers::BLOCK_DATA) {
+            const auto n = decoder.next(block + at, LogBuffers::BLOCK_DATA - at, record);
+            TEST_ASSERT_NOT_EQUAL(0, n);
+            at += n;
+            if (record.type == PAD_RECORD) {
+                continue;
+            }
+            TEST_ASSERT_TRUE(record.valid);
+            if (record.type == IMU_KEY_RECORD || record.type == IMU_RECORD) {
+                TEST_ASSERT_EQUAL(imuSeen ? IMU_RECORD : IMU_KEY_RECORD, record.type);
+                imuSeen = true;
+                times.push_back(record.imu.time);
+            }
+            if (record.type == BARO_KEY_RECORD || record.type == BARO_RECORD) {
+                TEST_ASSERT_EQUAL(baroSeen ? BARO_RECORD : BARO_KEY_RECORD, record.type);
+                baroSeen = true;
+            }
+        }
+        TEST_ASSERT_EQUAL(LogBuffers::BLOCK_DATA, at);
+    }
+    return times;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_slow_storage_keeps_up() {
+    const auto run = fly(WRITE_MS, STALL_MS, STALL_EVERY);
+    const auto buffersWritten = storage.writes.size();
+    printf("%u records, %u dropped, %zu buffer writes, %.2fs of flight per buffer, %.1f bytes per IMU frame\n",
+        run.appended, run.dropped, buffersWritten, FLIGHT_MS / 1000.0f / (buffersWritten - 1),
+        static_cast<float>(storage.bytes.size()) / run.imuAppended);
+
+    TEST_ASSERT_EQUAL(0, run.dropped);
+    TEST_ASSERT_EQUAL(buffersWritten, run.fullSignals);
+    // the buffers take turns, each full one written whole
+    for (size_t i = 0; i < buffersWritten; i++) {
+        TEST_ASSERT_EQUAL_PTR(i % 2 == 0 ? first : second, storage.writes[i]);
+    }
+    TEST_ASSERT_EQUAL((buffersWritten - 1) * LogBuffers::BUFFER_SIZE,
+        storage.bytes.size() - storage.bytes.size() % LogBuffers::BUFFER_SIZE);
+
+    // every frame is there, in order
+    const auto times = checkBlocks();
+    TEST_ASSERT_EQUAL(run.imuAppended, times.size());
+    TEST_ASSERT_TRUE(times == run.imuTimes);
+    for (size_t i = 1; i < times.size(); i++) {
+        TEST_ASSERT_EQUAL(PERIOD_US, times[i] - times[i - 1]);
+    }
+}
+
+void test_too_slow_storage_drops_whole_records() {
+    // every write as slow as the stall, more than a buffer takes to fill
+    const auto run = fly(STALL_MS * 2, STALL_MS * 2, 1);
+    TEST_ASSERT_TRUE(run.dropped > 0);
+
+    // what made it is intact, the gaps are whole frames
+    const auto times = checkBlocks();
+    const auto imuDropped = run.imuAppended - times.size();
+    printf("%u records, %u dropped, %zu IMU frames of them\n", run.appended, run.dropped, imuDropped);
+    TEST_ASSERT_TRUE(imuDropped > 0 && imuDropped <= run.dropped);
+    TEST_ASSERT_TRUE(times == run.imuTimes);
+    for (size_t i = 1; i < times.size(); i++) {
+        TEST_ASSERT_EQUAL(0, (times[i] - times[i - 1]) % PERIOD_US);
+    }
+}
+
+void test_session_change_starts_a_buffer() {
+    LogBuffers buffers;
+    Run run = {};
+    buffers.begin(first, second, countFull, &run);
+    const uint8_t event[LogFormat::EVENT_SIZE] = {};
+    TEST_ASSERT_TRUE(buffers.append(1, LOG_ID, 0, EVENT_RECORD, event, sizeof(event)));
+    // the next arming's header goes in the other buffer, the first is handed over
+    TEST_ASSERT_TRUE(buffers.append(2, LOG_ID + 1, 10, HEADER_RECORD, &LOG_ID, sizeof(LOG_ID)));
+    TEST_ASSERT_EQUAL(1, run.fullSignals);
+    auto b = buffers.next();
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL(1, b->session);
+    TEST_ASSERT_EQUAL(LogBuffers::BLOCK_SIZE, b->length);
+    TEST_ASSERT_EQUAL(10, buffers.activeSince());
+    // and a third session can't start until the first buffer is written
+    TEST_ASSERT_FALSE(buffers.append(3, LOG_ID + 2, 20, EVENT_RECORD, event, sizeof(event)));
+    buffers.release(*b);
+    TEST_ASSERT_TRUE(buffers.append(3, LOG_ID + 2, 30, EVENT_RECORD, event, sizeof(event)));
+    TEST_ASSERT_EQUAL(2, buffers.next()->session);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_slow_storage_keeps_up);
+    RUN_TEST(test_too_slow_storage_drops_whole_records);
+    RUN_TEST(test_session_change_starts_a_buffer);
+    return UNITY_END();
+}
@@ -0,0 +1,312 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string>
+#define LOGDECODE_NO_MAIN
+#include "../../tools/logdecode.cpp"
+
+/**
+ * @brief logdecode against a checked in log and the CSVs it should decode to
+ *
+ * flight.log is a short flight as DataLogger writes it: three blocks, each padded and sealed, the last one torn off
+ * part way through as if the power went during the write. The blocks hold events, a status packet, GPS fixes, and IMU
+ * and baro samples with faults and period changes. golden/ holds the CSVs for the two whole blocks.
+ *
+ * Both are checked in, so a change to the format or the decoder that would misread logs already on a board shows up
+ * here. If the format changes on purpose, write new ones with the current encoder and decoder and check them over:
+ *
+ *     LOGDECODE_REGENERATE=1 pio test -e native -f test_logdecode
+ *
+ */
+static constexpr uint32_t LOG_ID = 0x1DC0FFEE;
+static constexpr size_t TORN_AT = 1500; // bytes of the last block written before the power went
+static const char *const CSVS[] = {"imu.csv", "baro.csv", "gps.csv", "status.csv", "events.csv"};
+
+// bits of Event::EventType
+static constexpr uint32_t ARM = 1 << 0;
+static constexpr uint32_t LIFTOFF = 1 << 2;
+static constexpr uint32_t BURNOUT = 1 << 3;
+static constexpr uint32_t APOGEE = 1 << 7;
+
+static std::string fixtureDir;
+static char outDir[] = "/tmp/logdecode-XXXXXX";
+
+static std::string fixturePath(const char *name) {
+    return fixtureDir + "/" + name;
+}
+
+static std::string outPath(const char *name) {
+    return std::string(outDir) + "/" + name;
+}
+
+static std::string readFile(const std::string &path) {
+    std::string contents;
+    auto f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        return contents;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(f);
+    return contents;
+}
+
+static void writeFile(const std::string &path, const std::string &contents) {
+    auto f = fopen(path.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+}
+
+/**
+ * @brief appends records the way DataLogger does: keyframes at the start of every block, never straddling one
+ *
+ */
+class FixtureWriter {
+    public:
+        void header() {
+            uint8_t record[LogFormat::MAX_RECORD_SIZE];
+            add(record, encoder.header(LOG_ID, record));
+        }
+
+        void event(uint32_t ms, uint32_t type, int32_t arg) {
+            const LoggedEvent event = {ms, type, {arg, 0, 0}};
+            raw(EVENT_RECORD, &event, sizeof(event));
+        }
+
+        void status(uint32_t ms, uint8_t state) {
+            LoggedStatus status = {};
+            status.timestamp = ms;
+            status.state = state;
+            status.batteryVoltage = 84;
+            status.baroAltitude = 123;
+            status.temperature = 21;
+            status.continuity = 0x05;
+            status.imu[2] = 9.75f;
+            status.kbFree = 180;
+            raw(STATUS_RECORD, &status, sizeof(status));
+        }
+
+        void gps(uint64_t us, int32_t altitudeMM) {
+            LoggedGPS fix = {};
+            fix.latitude = -337654321;
+            fix.longitude = 1512345678;
+            fix.altitude = altitudeMM;
+            fix.epoch = 1790000000;
+            fix.fixType = 3;
+            fix.sats = 11;
+            fix.hAcc = 2500;
+            fix.vAcc = 4000;
+            fix.velD = -150000;
+            fix.sAcc = 300;
+            fix.time = us;
+            raw(GPS_RECORD, &fix, sizeof(fix));
+        }
+
+        void imu(const LogIMUSample &sample) {
+            uint8_t record[LogFormat::MAX_RECORD_SIZE];
+            if (bytes.size() % LogFormat::BLOCK_SIZE == 0) {
+                encoder.keyframe();
+            }
+            auto n = encoder.imu(sample, record);
+            if (!fits(n)) {
+                pad();
+                encoder.keyframe();
+                n = encoder.imu(sample, record);
+            }
+            add(record, n);
+        }
+
+        void baro(const LogBaroSample &sample) {
+            uint8_t record[LogFormat::MAX_RECORD_SIZE];
+            if (bytes.size() % LogFormat::BLOCK_SIZE == 0) {
+                encoder.keyframe();
+            }
+            auto n = encoder.baro(sample, record);
+            if (!fits(n)) {
+                pad();
+                encoder.keyframe();
+                n = encoder.baro(sample, record);
+            }
+            add(record, n);
+        }
+
+        // a flush, the rest of the block is padding
+        void pad() {
+            const auto blocks = (bytes.size() + LogFormat::BLOCK_SIZE - 1) / LogFormat::BLOCK_SIZE;
+            bytes.resize(blocks * LogFormat::BLOCK_SIZE, PAD_RECORD);
+        }
+
+        std::string sealed() {
+            pad();
+            for (size_t offset = 0; offset < bytes.size(); offset += LogFormat::BLOCK_SIZE) {
+                logSeal(&bytes[offset], LOG_ID, offset / LogFormat::BLOCK_SIZE);
+            }
+            return std::string(bytes.begin(), bytes.end());
+        }
+
+    private:
+        LogEncoder encoder;
+        std::vector<uint8_t> bytes;
+
+        bool fits(size_t n) const {
+            return n <= LogFormat::BLOCK_DATA - bytes.size() % LogFormat::BLOCK_SIZE;
+        }
+
+        void raw(LogRecordType type, const void *payload, size_t length) {
+            uint8_t record[LogFormat::MAX_RECORD_SIZE];
+            const auto n = LogEncoder::raw(type, payload, length, record);
+            if (!fits(n)) {
+                pad();
+            }
+            add(record, n);
+        }
+
+        void add(const uint8_t *record, size_t n) {
+            bytes.insert(bytes.end(), record, record + n);
+        }
+};
+
+// about a quarter second either side of liftoff and apogee, in three flushes
+static std::string makeFixture() {
+    FixtureWriter w;
+    uint64_t us = 10000000;
+    auto frame = [&](int i, float acc, uint8_t faults) {
+        LogIMUSample s;
+        s.time = us;
+        s.acc[0] = 0.01f * (i % 7) - 0.03f;
+        s.acc[1] = -0.12f + 0.01f * (i % 3);
+        s.acc[2] = acc + 0.01f * (i % 5);
+        s.gyro[0] = 0.001f * i;
+        s.gyro[1] = -0.002f * (i % 4);
+        s.gyro[2] = 0.5f;
+        s.faults = faults;
+        w.imu(s);
+    };
+    auto baro = [&](float altitude, uint8_t faults) {
+        w.baro({us, altitude, 21, faults});
+    };
+
+    // armed on the pad, the ring goes out ahead of the liftoff
+    w.header();
+    w.event(9000, ARM, 1);
+    w.status(9500, 2);
+    for (auto i = 0; i < 200; i++) {
+        frame(i, 9.81f, 0);
+        if (i % 8 == 0) {
+            baro(123.45f + 0.01f * (i % 3), 0);
+        }
+        // the FIFO batches don't line up exactly
+        us += i % 16 == 15 ? 627 : 625;
+    }
+    w.event(10125, LIFTOFF, 0);
+    w.pad();
+
+    // boost, the baro glitches
+    for (auto i = 0; i < 300; i++) {
+        frame(i, 95.3f - 0.01f * i, i >= 100 && i < 104 ? 0x04 : 0);
+        if (i % 8 == 0) {
+            baro(123.5f + 0.02f * i, i == 160 ? 0x01 : 0);
+        }
+        if (i == 150) {
+            w.gps(us, 130500);
+        }
+        us += 625;
+    }
+    w.event(10313, BURNOUT, 1);
+    w.pad();
+
+    // apogee, torn off before the block was written whole
+    for (auto i = 0; i < 300; i++) {
+        frame(i, -0.5f, 0);
+        if (i % 8 == 0) {
+            baro(1234.56f - 0.01f * (i % 4), 0);
+        }
+        us += 625;
+    }
+    w.gps(us, 1240000);
+    w.event(20000, APOGEE, 0);
+
+    auto log = w.sealed();
+    log.resize(2 * LogFormat::BLOCK_SIZE + TORN_AT);
+    return log;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_decodes_to_golden_csvs() {
+    TEST_ASSERT_EQUAL(2, decodeLog(fixturePath("flight.log").c_str(), outDir));
+    for (auto name : CSVS) {
+        const auto golden = readFile(fixturePath("golden/") + name);
+        TEST_ASSERT_TRUE_MESSAGE(golden.size() > 0, name);
+        TEST_ASSERT_TRUE_MESSAGE(readFile(outPath(name)) == golden, name);
+    }
+}
+
+void test_torn_block_is_left_out() {
+    TEST_ASSERT_EQUAL(2 * LogFormat::BLOCK_SIZE + TORN_AT, readFile(fixturePath("flight.log")).size());
+    // decoded, but not clean
+    TEST_ASSERT_EQUAL(2, decodeLog(fixturePath("flight.log").c_str(), outDir));
+    // the liftoff and burnout made it, the apogee was in the torn block
+    const auto events = readFile(outPath("events.csv"));
+    TEST_ASSERT_TRUE(events.find("\"liftoff\"") != std::string::npos);
+    TEST_ASSERT_TRUE(events.find("\"burnout\"") != std::string::npos);
+    TEST_ASSERT_TRUE(events.find("\"apogee\"") == std::string::npos);
+}
+
+void test_whole_blocks_are_clean() {
+    auto log = readFile(fixturePath("flight.log"));
+    log.resize(2 * LogFormat::BLOCK_SIZE);
+    writeFile(outPath("whole.log"), log);
+    TEST_ASSERT_EQUAL(0, decodeLog(outPath("whole.log").c_str(), nullptr));
+}
+
+void test_corrupt_block_is_skipped() {
+    auto log = readFile(fixturePath("flight.log"));
+    log.resize(2 * LogFormat::BLOCK_SIZE);
+    log[100] ^= 0x10;
+    writeFile(outPath("corrupt.log"), log);
+    TEST_ASSERT_EQUAL(2, decodeLog(outPath("corrupt.log").c_str(), outDir));
+
+    const auto events = readFile(outPath("events.csv"));
+    TEST_ASSERT_TRUE(events.find("\"arm\"") == std::string::npos);
+    TEST_ASSERT_TRUE(events.find("\"burnout\"") != std::string::npos);
+    // the second block starts with keyframes, so its samples come out the same without the first
+    const auto imu = readFile(outPath("imu.csv"));
+    const auto golden = readFile(fixturePath("golden/imu.csv"));
+    const auto rows = imu.substr(imu.find('\n') + 1);
+    TEST_ASSERT_TRUE(rows.size() > 0);
+    TEST_ASSERT_TRUE(rows.size() < golden.size());
+    TEST_ASSERT_TRUE(golden.compare(golden.size() - rows.size(), rows.size(), rows) == 0);
+}
+
+static void regenerate() {
+    writeFile(fixturePath("flight.log"), makeFixture());
+    TEST_ASSERT_EQUAL(2, decodeLog(fixturePath("flight.log").c_str(), fixturePath("golden").c_str()));
+}
+
+int main() {
+    // the fixtures are next to this file
+    fixtureDir = __FILE__;
+    fixtureDir.resize(fixtureDir.rfind('/'));
+    if (mkdtemp(outDir) == nullptr) {
+        perror(outDir);
+        return 1;
+    }
+
+    UNITY_BEGIN();
+    if (getenv("LOGDECODE_REGENERATE") != nullptr) {
+        RUN_TEST(regenerate);
+    }
+    RUN_TEST(test_decodes_to_golden_csvs);
+    RUN_TEST(test_torn_block_is_left_out);
+    RUN_TEST(test_whole_blocks_are_clean);
+    RUN_TEST(test_corrupt_block_is_skipped);
+    return UNITY_END();
+}
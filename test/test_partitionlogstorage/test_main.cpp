@@ -0,0 +1,269 @@
+#include <unity.h>
+#include <vector>
+#include "../../src/partitionlogstorage.cpp"
+
+Logging Log;
+
+/**
+ * @brief a stand in for the flightlog partition
+ *
+ * Behaves like NOR flash: erasing sets a sector to ones, and programming can only clear bits, so writing over
+ * something that wasn't erased leaves the AND of the two, which the tests see when they read it back. The data ring
+ * is 16 sectors, so a few flights go round it.
+ *
+ */
+static constexpr size_t DATA_SECTORS = 16;
+static constexpr size_t BLOCK = LogFormat::BLOCK_SIZE;
+static_assert(BLOCK == LogPartition::SECTOR_SIZE, "a block is a sector");
+
+static esp_partition_t partition = {ESP_PARTITION_TYPE_DATA, LogPartition::SUBTYPE, 0x400000,
+    LogPartition::HEADER_SIZE + DATA_SECTORS * BLOCK, "flightlog"};
+static std::vector<uint8_t> flash;
+static uint32_t erases;
+static int64_t nowUS;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char *label) {
+    return type == partition.type && subtype == partition.subtype && strcmp(label, partition.label) == 0 ?
+        &partition : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t offset, void *dst, size_t size) {
+    if (offset + size > p->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, &flash[offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t offset, const void *src, size_t size) {
+    if (offset + size > p->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < size; i++) {
+        flash[offset + i] &= static_cast<const uint8_t*>(src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t offset, size_t size) {
+    if (offset % LogPartition::SECTOR_SIZE != 0 || size % LogPartition::SECTOR_SIZE != 0 || offset + size > p->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&flash[offset], 0xFF, size);
+    erases += size / LogPartition::SECTOR_SIZE;
+    nowUS += 40000; // they are slow
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    return nowUS++;
+}
+
+// a block of a flight the way DataLogger seals them, the header in the first one, the rest a pattern of the two
+static std::vector<uint8_t> block(uint32_t id, uint32_t sequence) {
+    std::vector<uint8_t> b(BLOCK, PAD_RECORD);
+    size_t start = 0;
+    if (sequence == 0) {
+        LogEncoder encoder;
+        start = encoder.header(id, b.data());
+    }
+    for (auto i = start; i < LogFormat::BLOCK_DATA; i++) {
+        b[i] = static_cast<uint8_t>(id * 31 + sequence * 7 + i);
+    }
+    logSeal(b.data(), id, sequence);
+    return b;
+}
+
+static void writeFlight(PartitionLogStorage &storage, uint32_t id, uint32_t blocks, bool flying = false) {
+    for (uint32_t sequence = 0; sequence < blocks; sequence++) {
+        const auto b = block(id, sequence);
+        TEST_ASSERT_EQUAL(BLOCK, storage.write(b.data(), b.size(), flying));
+    }
+}
+
+// every block of the flight reads back sealed, in as many reads as it takes to go round the ring
+static void checkFlight(PartitionLogStorage &storage, uint32_t ordinal, uint32_t id, uint32_t blocks) {
+    std::vector<uint8_t> b(BLOCK);
+    for (uint32_t sequence = 0; sequence < blocks; sequence++) {
+        size_t got = 0;
+        while (got < BLOCK) {
+            const auto n = storage.read(ordinal, sequence * BLOCK + got, &b[got], BLOCK - got);
+            TEST_ASSERT_NOT_EQUAL(0, n);
+            got += n;
+        }
+        TEST_ASSERT_TRUE(logSealed(b.data(), id, sequence));
+        TEST_ASSERT_TRUE(b == block(id, sequence));
+    }
+    TEST_ASSERT_EQUAL(0, storage.read(ordinal, blocks * BLOCK, b.data(), BLOCK));
+}
+
+static size_t listFlights(PartitionLogStorage &storage, LogFlight *out) {
+    return storage.flights(out, LogPartition::MAX_ENTRIES);
+}
+
+// erase ahead until there's nothing more to do, as the logger task does on the ground
+static void maintainAll(PartitionLogStorage &storage) {
+    while (storage.maintain(false, false)) {
+    }
+}
+
+void setUp() {
+    // a new partition reads as erased
+    flash.assign(partition.size, 0xFF);
+    erases = 0;
+    nowUS = 0;
+}
+
+void tearDown() {
+}
+
+void test_flights_round_trip() {
+    PartitionLogStorage storage;
+    TEST_ASSERT_TRUE(storage.begin());
+    maintainAll(storage);
+
+    TEST_ASSERT_TRUE(storage.open(1790000000));
+    writeFlight(storage, 0xA1, 3, true);
+    storage.close();
+    TEST_ASSERT_TRUE(storage.open(0));
+    writeFlight(storage, 0xB2, 2, true);
+
+    LogFlight flights[LogPartition::MAX_ENTRIES];
+    TEST_ASSERT_EQUAL(2, listFlights(storage, flights));
+    TEST_ASSERT_EQUAL(1, flights[0].ordinal);
+    TEST_ASSERT_EQUAL(1790000000, flights[0].epoch);
+    TEST_ASSERT_EQUAL(3 * BLOCK, flights[0].bytes);
+    TEST_ASSERT_FALSE(flights[0].open);
+    TEST_ASSERT_EQUAL(2, flights[1].ordinal);
+    TEST_ASSERT_EQUAL(2 * BLOCK, flights[1].bytes);
+    TEST_ASSERT_TRUE(flights[1].open);
+
+    checkFlight(storage, 1, 0xA1, 3);
+    checkFlight(storage, 2, 0xB2, 2);
+}
+
+void test_no_erase_in_flight() {
+    // the data ring is dirty, as flights a lap ago would have left it
+    memset(&flash[LogPartition::HEADER_SIZE], 0x00, DATA_SECTORS * BLOCK);
+    PartitionLogStorage storage;
+    TEST_ASSERT_TRUE(storage.begin());
+    // the flight entry's sector is blank, nothing to erase for it
+    TEST_ASSERT_TRUE(storage.open(0));
+    TEST_ASSERT_EQUAL(0, erases);
+
+    auto b = block(0xC3, 0);
+    // nothing erased ahead yet, in flight that write is dropped rather than waiting
+    TEST_ASSERT_EQUAL(0, storage.write(b.data(), b.size(), true));
+    TEST_ASSERT_EQUAL(0, erases);
+    // on the ground it erases what it needs and goes ahead
+    TEST_ASSERT_EQUAL(BLOCK, storage.write(b.data(), b.size(), false));
+    TEST_ASSERT_EQUAL(1, erases);
+    checkFlight(storage, 1, 0xC3, 1);
+
+    // erased ahead on the pad, the flight writes without erasing
+    maintainAll(storage);
+    const auto padErases = erases;
+    TEST_ASSERT_EQUAL(DATA_SECTORS, padErases);
+    for (uint32_t sequence = 1; sequence < DATA_SECTORS; sequence++) {
+        b = block(0xC3, sequence);
+        TEST_ASSERT_EQUAL(BLOCK, storage.write(b.data(), b.size(), true));
+    }
+    TEST_ASSERT_EQUAL(padErases, erases);
+    TEST_ASSERT_FALSE(storage.maintain(true, true));
+    TEST_ASSERT_EQUAL(padErases, erases);
+    checkFlight(storage, 1, 0xC3, DATA_SECTORS);
+}
+
+void test_old_flights_are_evicted() {
+    PartitionLogStorage storage;
+    TEST_ASSERT_TRUE(storage.begin());
+    LogFlight flights[LogPartition::MAX_ENTRIES];
+
+    // 5 + 6 + 4 blocks fill 15 of the 16 sectors, all erased when the partition was new
+    const uint32_t blocks[] = {5, 6, 4, 7};
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(storage.open(0));
+        writeFlight(storage, 0x100 + i, blocks[i], true);
+        storage.close();
+    }
+    TEST_ASSERT_EQUAL(3, listFlights(storage, flights));
+    TEST_ASSERT_EQUAL(0, erases);
+
+    // erasing ahead for the next flight goes round the ring up to the third, the first two are gone. The sector after
+    // the third is still blank and isn't erased again.
+    maintainAll(storage);
+    TEST_ASSERT_EQUAL(blocks[0] + blocks[1], erases);
+    TEST_ASSERT_EQUAL(1, listFlights(storage, flights));
+    TEST_ASSERT_EQUAL(3, flights[0].ordinal);
+
+    // the fourth goes round the ring, over the first flight and the start of the second
+    TEST_ASSERT_TRUE(storage.open(0));
+    writeFlight(storage, 0x103, blocks[3]);
+    storage.close();
+
+    TEST_ASSERT_EQUAL(2, listFlights(storage, flights));
+    TEST_ASSERT_EQUAL(3, flights[0].ordinal);
+    TEST_ASSERT_EQUAL(4, flights[1].ordinal);
+    std::vector<uint8_t> b(BLOCK);
+    TEST_ASSERT_EQUAL(0, storage.read(1, 0, b.data(), BLOCK));
+    TEST_ASSERT_EQUAL(0, storage.read(2, 0, b.data(), BLOCK));
+    checkFlight(storage, 3, 0x102, blocks[2]);
+    // the fourth flight's blocks straddle the end of the ring
+    checkFlight(storage, 4, 0x103, blocks[3]);
+
+    // and a fresh boot finds the same
+    PartitionLogStorage rebooted;
+    TEST_ASSERT_TRUE(rebooted.begin());
+    TEST_ASSERT_EQUAL(2, listFlights(rebooted, flights));
+    TEST_ASSERT_EQUAL(3, flights[0].ordinal);
+    checkFlight(rebooted, 4, 0x103, blocks[3]);
+}
+
+void test_open_flight_is_recovered() {
+    LogFlight flights[LogPartition::MAX_ENTRIES];
+    {
+        PartitionLogStorage storage;
+        TEST_ASSERT_TRUE(storage.begin());
+        maintainAll(storage);
+        // a flight a lap ago left sealed blocks all round the ring
+        TEST_ASSERT_TRUE(storage.open(0));
+        writeFlight(storage, 0x200, DATA_SECTORS - 1, true);
+        storage.close();
+        maintainAll(storage);
+
+        // the power goes part way through the fourth block of the next one
+        TEST_ASSERT_TRUE(storage.open(0));
+        writeFlight(storage, 0x201, 3);
+        const auto torn = block(0x201, 3);
+        const auto offset = LogPartition::HEADER_SIZE + (DATA_SECTORS - 1 + 3) % DATA_SECTORS * BLOCK;
+        esp_partition_write(&partition, offset, torn.data(), BLOCK / 2);
+    }
+
+    PartitionLogStorage storage;
+    TEST_ASSERT_TRUE(storage.begin());
+    // closed after its last sealed block, not the torn one nor the older flight's stale blocks after it
+    TEST_ASSERT_EQUAL(1, listFlights(storage, flights));
+    TEST_ASSERT_EQUAL(2, flights[0].ordinal);
+    TEST_ASSERT_EQUAL(3 * BLOCK, flights[0].bytes);
+    TEST_ASSERT_FALSE(flights[0].open);
+    checkFlight(storage, 2, 0x201, 3);
+
+    // the next flight goes after it, over the torn sector once it has been erased
+    maintainAll(storage);
+    TEST_ASSERT_TRUE(storage.open(0));
+    writeFlight(storage, 0x202, 2, true);
+    storage.close();
+    TEST_ASSERT_EQUAL(2, listFlights(storage, flights));
+    checkFlight(storage, 2, 0x201, 3);
+    checkFlight(storage, 3, 0x202, 2);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_flights_round_trip);
+    RUN_TEST(test_no_erase_in_flight);
+    RUN_TEST(test_old_flights_are_evicted);
+    RUN_TEST(test_open_flight_is_recovered);
+    return UNITY_END();
+}
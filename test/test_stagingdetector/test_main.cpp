@@ -0,0 +1,123 @@
+#include <unity.h>
+#include <math.h>
+#include "stagingdetector.h"
+
+/**
+ * @brief a synthetic two stage flight, to check staging is detected once per change and timestamped closely
+ *
+ * The axial specific force is what DeadReckoning::axialAcceleration() hands the detector: 1G on the pad, thrust less
+ * drag in flight. Motors take a few ms to come up and tail off, separation kicks the sustainer hard for a few ms, and
+ * the IMU is noisy throughout.
+ *
+ */
+static constexpr float G = 9.8f;
+static constexpr uint32_t SAMPLE_US = 625; // 1600Hz, the BMI088 accelerometer rate
+static constexpr uint32_t RAMP_MS = 10; // motors come up and tail off over this
+static constexpr float NOISE = 1.0f; // m/s^2, peak
+
+// detected events must land inside the motor's ramp, give or take a few samples of smoothing
+static constexpr uint32_t TOLERANCE_MS = RAMP_MS + 2;
+
+struct Burn {
+    uint32_t ignitionMS;
+    uint32_t burnoutMS;
+    float thrust; // m/s^2
+};
+
+static constexpr Burn booster = {1000, 3000, 12 * G};
+static constexpr Burn sustainer = {5000, 7000, 6 * G};
+static constexpr uint32_t separationMS = 4000;
+static constexpr uint32_t separationLengthMS = 5;
+static constexpr float separationKick = 8 * G;
+static constexpr uint32_t endMS = 9000;
+
+static uint32_t seed;
+
+// deterministic noise in -1..1
+static float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<int32_t>(seed) / 2147483648.0f;
+}
+
+// 0 before the ramp starts, 1 after it ends
+static float ramp(float ms, uint32_t startMS) {
+    return fminf(1, fmaxf(0, (ms - startMS) / RAMP_MS));
+}
+
+static float thrust(const Burn &burn, float ms) {
+    return burn.thrust * (ramp(ms, burn.ignitionMS) - ramp(ms, burn.burnoutMS));
+}
+
+static float axial(float ms) {
+    if (ms < booster.ignitionMS) {
+        return G;
+    }
+    const auto drag = ms < separationMS ? 1.5f : 0.8f; // roughly, the sustainer is slimmer
+    auto force = thrust(booster, ms) + thrust(sustainer, ms) - drag;
+    if (ms >= separationMS && ms < separationMS + separationLengthMS) {
+        force += separationKick;
+    }
+    return force;
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_two_stage_flight() {
+    StagingDetector detector;
+    uint32_t ignitions[3] = {};
+    uint32_t burnouts[3] = {};
+    size_t numIgnitions = 0;
+    size_t numBurnouts = 0;
+    auto thrusting = false;
+
+    for (uint64_t us = 0; us < endMS * 1000ull; us += SAMPLE_US) {
+        const auto ms = us / 1000.0f;
+        detector.update(static_cast<uint32_t>(us / 1000), SAMPLE_US / 1e6f, axial(ms) + NOISE * noise());
+        if (detector.thrusting() == thrusting) {
+            continue;
+        }
+        thrusting = detector.thrusting();
+        if (thrusting) {
+            TEST_ASSERT_LESS_THAN(3, numIgnitions);
+            ignitions[numIgnitions++] = detector.ignitionTime();
+        } else {
+            TEST_ASSERT_LESS_THAN(3, numBurnouts);
+            burnouts[numBurnouts++] = detector.burnoutTime();
+        }
+    }
+
+    // separation is too short to be an ignition
+    TEST_ASSERT_EQUAL(2, numIgnitions);
+    TEST_ASSERT_EQUAL(2, numBurnouts);
+    TEST_ASSERT_EQUAL(2, detector.burnouts());
+
+    TEST_ASSERT_LESS_OR_EQUAL(TOLERANCE_MS, ignitions[0] - booster.ignitionMS);
+    TEST_ASSERT_LESS_OR_EQUAL(TOLERANCE_MS, burnouts[0] - booster.burnoutMS);
+    TEST_ASSERT_LESS_OR_EQUAL(TOLERANCE_MS, ignitions[1] - sustainer.ignitionMS);
+    TEST_ASSERT_LESS_OR_EQUAL(TOLERANCE_MS, burnouts[1] - sustainer.burnoutMS);
+}
+
+void test_reset_forgets_flight() {
+    StagingDetector detector;
+    for (uint64_t us = 0; us < 4000 * 1000ull; us += SAMPLE_US) {
+        detector.update(static_cast<uint32_t>(us / 1000), SAMPLE_US / 1e6f, axial(us / 1000.0f));
+    }
+    TEST_ASSERT_EQUAL(1, detector.burnouts());
+    detector.reset();
+    TEST_ASSERT_EQUAL(0, detector.burnouts());
+    TEST_ASSERT_FALSE(detector.thrusting());
+    TEST_ASSERT_EQUAL(0, detector.burnoutTime());
+    TEST_ASSERT_EQUAL(0, detector.ignitionTime());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_two_stage_flight);
+    RUN_TEST(test_reset_forgets_flight);
+    return UNITY_END();
+}
@@ -0,0 +1,529 @@
+/**
+ * @brief Decode a flight log into CSV and print a summary of the flight
+ *
+ *     g++ -std=gnu++17 -O2 -Isrc -o logdecode tools/logdecode.cpp src/logformat.cpp
+ *     ./logdecode flight-00012.log [outdir]
+ *
+ * Takes a log as downloaded from /flightlog or split out by partextract. With an outdir it writes imu.csv, baro.csv,
+ * gps.csv, status.csv and events.csv there, without one it only prints the summary.
+ *
+ * The log is mapped and walked a block at a time. A block whose commit doesn't check out, because it was damaged,
+ * is out of place or is from another log, is counted as corrupt and skipped, and so is a sealed block that doesn't
+ * decode. Decoding picks up at the next block, which starts with keyframes. A log that doesn't end on a block boundary
+ * was cut short.
+ *
+ * Exits 0 for a clean log, 2 if it was corrupt or truncated but decoded, 1 if it couldn't be read at all.
+ *
+ */
+#include "logformat.h"
+#include <charconv>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// the logged payloads, as in packet.h and eventmanager.h which need the Arduino headers
+
+struct __attribute__((packed)) LoggedGPS {
+    int32_t latitude;       // deg * 1e7
+    int32_t longitude;
+    int32_t altitude;       // mm
+    uint32_t epoch;
+    uint8_t fixType;
+    uint8_t sats;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    uint32_t sAcc;
+    uint64_t time;
+};
+
+struct __attribute__((packed)) LoggedStatus {
+    uint32_t timestamp;     // millis()
+    LoggedGPS gps;
+    uint16_t kbAlloc;
+    uint16_t kbFree;
+    uint16_t storageTot;
+    uint16_t storageUsed;
+    uint8_t batteryVoltage;
+    uint16_t baroAltitude;
+    uint8_t temperature;
+    float imu[6];
+    uint8_t continuity;
+    float position[6];
+    float velocity[6];
+    uint8_t state;
+    uint16_t status;
+};
+
+struct LoggedEvent {
+    uint32_t timestamp;     // millis()
+    uint32_t eventType;     // one bit of Event::EventType
+    int32_t args[3];
+};
+
+// the LogFormat scales as decimal places
+static constexpr int ACC_DECIMALS = 2;
+static constexpr int GYRO_DECIMALS = 3;
+static constexpr int ALTITUDE_DECIMALS = 2;
+static_assert(LogFormat::ACC_SCALE == 100 && LogFormat::GYRO_SCALE == 1000 && LogFormat::ALTITUDE_SCALE == 100,
+    "update the decimals");
+
+static_assert(sizeof(LoggedGPS) == LogFormat::GPS_SIZE, "GPSFix changed");
+static_assert(sizeof(LoggedStatus) == LogFormat::STATUS_SIZE, "StatusPacket changed");
+static_assert(sizeof(LoggedEvent) == LogFormat::EVENT_SIZE, "Event changed");
+
+static const char *const eventNames[] = {
+    "arm", "disarm", "liftoff", "burnout", "airstart", "pyro fire", "continuity loss", "apogee", "lawn dart",
+    "landing", "lost rocket", "low battery", "apogee predicted", "start",
+};
+
+static const char *const stateNames[] = {
+    "init", "disarmed", "armed", "boost", "coast", "apogee", "under chute", "lawn dart", "touchdown", "lost",
+    "power fail", "unknown",
+};
+
+static const char *eventName(uint32_t type) {
+    for (size_t bit = 0; bit < sizeof(eventNames) / sizeof(eventNames[0]); bit++) {
+        if (type == 1u << bit) {
+            return eventNames[bit];
+        }
+    }
+    return "unknown";
+}
+
+/**
+ * @brief buffered CSV output, formats with to_chars since stdio is what would limit the speed
+ *
+ */
+class CSVWriter {
+    public:
+        static size_t written;      // by all of them
+
+        CSVWriter() : f(nullptr), used(0), first(true) {
+        }
+
+        ~CSVWriter() {
+            close();
+        }
+
+        bool open(const char *dir, const char *name, const char *header) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+            f = fopen(path, "w");
+            if (f == nullptr) {
+                perror(path);
+                return false;
+            }
+            buffer.resize(BUFFER_SIZE);
+            fputs(header, f);
+            fputc('\n', f);
+            return true;
+        }
+
+        void close() {
+            if (f != nullptr) {
+                drain();
+                fclose(f);
+                f = nullptr;
+            }
+        }
+
+        bool isOpen() const {
+            return f != nullptr;
+        }
+
+        template <typename T> void field(T value) {
+            separate();
+            used = std::to_chars(&buffer[used], &buffer[used] + FIELD_SIZE, value).ptr - buffer.data();
+        }
+
+        /**
+         * @brief a quantized sample, exact and a lot faster than the shortest float
+         *
+         */
+        void fixed(float value, int decimals) {
+            static constexpr int64_t powers[] = {1, 10, 100, 1000, 10000};
+            separate();
+            int64_t q = lrintf(value * powers[decimals]);
+            if (q < 0) {
+                buffer[used++] = '-';
+                q = -q;
+            }
+            used = std::to_chars(&buffer[used], &buffer[used] + FIELD_SIZE, q / powers[decimals]).ptr - buffer.data();
+            if (decimals > 0) {
+                buffer[used++] = '.';
+                auto fraction = q % powers[decimals];
+                for (auto i = decimals - 1; i >= 0; i--) {
+                    buffer[used + i] = '0' + fraction % 10;
+                    fraction /= 10;
+                }
+                used += decimals;
+            }
+        }
+
+        void field(const char *value) {
+            separate();
+            const auto n = strnlen(value, FIELD_SIZE - 2);
+            buffer[used++] = '"';
+            memcpy(&buffer[used], value, n);
+            used += n;
+            buffer[used++] = '"';
+        }
+
+        void end() {
+            buffer[used++] = '\n';
+            first = true;
+            if (used > BUFFER_SIZE - ROW_SIZE) {
+                drain();
+            }
+        }
+
+    private:
+        static constexpr size_t BUFFER_SIZE = 1 << 20;
+        static constexpr size_t FIELD_SIZE = 32;
+        static constexpr size_t ROW_SIZE = 64 * FIELD_SIZE;
+
+        FILE *f;
+        std::vector<char> buffer;
+        size_t used;
+        bool first;
+
+        void separate() {
+            if (!first) {
+                buffer[used++] = ',';
+            }
+            first = false;
+        }
+
+        void drain() {
+            written += fwrite(buffer.data(), 1, used, f);
+            used = 0;
+        }
+};
+
+struct Summary {
+    size_t counts[256];
+    size_t sessions;
+    size_t blocks;
+    size_t corruptBlocks;
+    size_t truncatedBytes;
+    uint64_t firstTime;     // timestampUS() of the first and last IMU sample
+    uint64_t lastTime;
+    float maxAcc;
+    uint64_t maxAccTime;
+    float minAltitude;
+    float maxAltitude;
+    uint64_t maxAltitudeTime;
+    LoggedGPS lastFix;
+    bool haveFix;
+    size_t events;
+};
+
+size_t CSVWriter::written = 0;
+
+static CSVWriter imuCSV, baroCSV, gpsCSV, statusCSV, eventCSV;
+
+static void emitIMU(const LogIMUSample &s, Summary &summary) {
+    if (summary.counts[IMU_KEY_RECORD] + summary.counts[IMU_RECORD] == 1) {
+        summary.firstTime = s.time;
+    }
+    summary.lastTime = s.time;
+    const auto acc = sqrtf(s.acc[0] * s.acc[0] + s.acc[1] * s.acc[1] + s.acc[2] * s.acc[2]);
+    if (acc > summary.maxAcc) {
+        summary.maxAcc = acc;
+        summary.maxAccTime = s.time;
+    }
+    if (imuCSV.isOpen()) {
+        imuCSV.field(s.time);
+        for (auto v : s.acc) {
+            imuCSV.fixed(v, ACC_DECIMALS);
+        }
+        for (auto v : s.gyro) {
+            imuCSV.fixed(v, GYRO_DECIMALS);
+        }
+        imuCSV.field(s.faults);
+        imuCSV.end();
+    }
+}
+
+static void emitBaro(const LogBaroSample &s, Summary &summary) {
+    if (summary.counts[BARO_KEY_RECORD] + summary.counts[BARO_RECORD] == 1) {
+        summary.minAltitude = summary.maxAltitude = s.altitude;
+        summary.maxAltitudeTime = s.time;
+    }
+    if (s.altitude > summary.maxAltitude) {
+        summary.maxAltitude = s.altitude;
+        summary.maxAltitudeTime = s.time;
+    }
+    if (s.altitude < summary.minAltitude) {
+        summary.minAltitude = s.altitude;
+    }
+    if (baroCSV.isOpen()) {
+        baroCSV.field(s.time);
+        baroCSV.fixed(s.altitude, ALTITUDE_DECIMALS);
+        baroCSV.field(s.temperature);
+        baroCSV.field(s.faults);
+        baroCSV.end();
+    }
+}
+
+static void emitGPS(const uint8_t *payload, Summary &summary) {
+    LoggedGPS fix;
+    memcpy(&fix, payload, sizeof(fix));
+    if (fix.fixType > 1) {
+        summary.lastFix = fix;
+        summary.haveFix = true;
+    }
+    if (gpsCSV.isOpen()) {
+        gpsCSV.field(fix.time);
+        gpsCSV.field(fix.epoch);
+        gpsCSV.field(fix.fixType);
+        gpsCSV.field(fix.sats);
+        gpsCSV.field(fix.latitude / 1e7);
+        gpsCSV.field(fix.longitude / 1e7);
+        gpsCSV.field(fix.altitude / 1e3);
+        gpsCSV.field(fix.hAcc / 1e3);
+        gpsCSV.field(fix.vAcc / 1e3);
+        gpsCSV.field(fix.velN / 1e3);
+        gpsCSV.field(fix.velE / 1e3);
+        gpsCSV.field(fix.velD / 1e3);
+        gpsCSV.field(fix.sAcc / 1e3);
+        gpsCSV.end();
+    }
+}
+
+static void emitStatus(const uint8_t *payload) {
+    LoggedStatus status;
+    if (!statusCSV.isOpen()) {
+        return;
+    }
+    memcpy(&status, payload, sizeof(status));
+    statusCSV.field(status.timestamp);
+    statusCSV.field(status.state < sizeof(stateNames) / sizeof(stateNames[0]) ? stateNames[status.state] : "?");
+    statusCSV.field(status.status);
+    statusCSV.field(status.batteryVoltage);
+    statusCSV.field(status.baroAltitude);
+    statusCSV.field(status.temperature);
+    statusCSV.field(status.continuity);
+    for (size_t i = 0; i < 6; i++) {
+        statusCSV.field(status.imu[i]);
+    }
+    for (size_t i = 0; i < 6; i++) {
+        statusCSV.field(status.position[i]);
+    }
+    for (size_t i = 0; i < 6; i++) {
+        statusCSV.field(status.velocity[i]);
+    }
+    statusCSV.field(status.kbFree);
+    statusCSV.end();
+}
+
+static void emitEvent(const uint8_t *payload, Summary &summary) {
+    LoggedEvent event;
+    memcpy(&event, payload, sizeof(event));
+    if (summary.events++ < 64) {
+        printf("  %10.3fs  %s %d %d %d\n", event.timestamp / 1e3, eventName(event.eventType), event.args[0],
+            event.args[1], event.args[2]);
+    }
+    if (eventCSV.isOpen()) {
+        eventCSV.field(event.timestamp);
+        eventCSV.field(eventName(event.eventType));
+        for (auto v : event.args) {
+            eventCSV.field(v);
+        }
+        eventCSV.end();
+    }
+}
+
+/**
+ * @brief decode the records of one block
+ *
+ * @return bool false if it was corrupt
+ */
+static bool decodeBlock(LogDecoder &decoder, const uint8_t *block, size_t length, Summary &summary) {
+    LogDecoder::Record record;
+    size_t position = 0;
+    while (position < length) {
+        const auto n = decoder.next(block + position, length - position, record);
+        if (n == 0 || !record.valid) {
+            return false;
+        }
+        position += n;
+        summary.counts[record.type]++;
+
+        switch (record.type) {
+            case PAD_RECORD:
+                return true;
+            case HEADER_RECORD:
+                summary.sessions++;
+                break;
+            case IMU_KEY_RECORD:
+            case IMU_RECORD:
+                emitIMU(record.imu, summary);
+                break;
+            case BARO_KEY_RECORD:
+            case BARO_RECORD:
+                emitBaro(record.baro, summary);
+                break;
+            case GPS_RECORD:
+                emitGPS(record.payload, summary);
+                break;
+            case STATUS_RECORD:
+                emitStatus(record.payload);
+                break;
+            case EVENT_RECORD:
+                emitEvent(record.payload, summary);
+                break;
+        }
+    }
+    return true;
+}
+
+static bool openCSVs(const char *dir) {
+    return imuCSV.open(dir, "imu.csv", "time_us,acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z,faults") &&
+        baroCSV.open(dir, "baro.csv", "time_us,altitude_m,temperature,faults") &&
+        gpsCSV.open(dir, "gps.csv",
+            "time_us,epoch,fix_type,sats,latitude,longitude,altitude_m,h_acc_m,v_acc_m,vel_n,vel_e,vel_d,s_acc") &&
+        statusCSV.open(dir, "status.csv",
+            "time_ms,state,status,battery,baro_altitude,temperature,continuity,imu_x,imu_y,imu_z,imu_pitch,imu_roll,"
+            "imu_yaw,pos_x,pos_y,pos_z,pos_pitch,pos_roll,pos_yaw,vel_x,vel_y,vel_z,vel_pitch,vel_roll,vel_yaw,kb_free") &&
+        eventCSV.open(dir, "events.csv", "time_ms,event,arg1,arg2,arg3");
+}
+
+static void closeCSVs() {
+    imuCSV.close();
+    baroCSV.close();
+    gpsCSV.close();
+    statusCSV.close();
+    eventCSV.close();
+}
+
+/**
+ * @brief decode a log, print its summary and write the CSVs
+ *
+ * @param outDir where the CSVs go, nullptr for none
+ * @return int the exit code
+ */
+static int decodeLog(const char *path, const char *outDir) {
+    int ret = 1;
+    int fd = -1;
+    const uint8_t *data = static_cast<const uint8_t *>(MAP_FAILED);
+    size_t size = 0;
+    struct stat st;
+    LogDecoder decoder;
+    uint32_t id;
+    Summary summary = {};
+    timespec startTime, endTime;
+    double seconds;
+    size_t imuSamples, baroSamples;
+
+    CSVWriter::written = 0;
+    if (outDir != nullptr && !openCSVs(outDir)) {
+        goto out;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        goto out;
+    }
+    size = st.st_size;
+    if (size == 0) {
+        fprintf(stderr, "%s: empty\n", path);
+        goto out;
+    }
+    data = static_cast<const uint8_t *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    if (data == MAP_FAILED) {
+        perror(path);
+        goto out;
+    }
+    madvise(const_cast<uint8_t *>(data), size, MADV_SEQUENTIAL);
+
+    // older logs can't be checked, say so up front
+    if (size < LogFormat::BLOCK_SIZE || !logId(data, id)) {
+        fprintf(stderr, "%s: no version %u log header, not a log or an older format\n", path, LogFormat::VERSION);
+        goto out;
+    }
+
+    printf("%s: %zuKB\nevents:\n", path, size / 1024);
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (size_t offset = 0; offset + LogFormat::BLOCK_SIZE <= size; offset += LogFormat::BLOCK_SIZE) {
+        const auto sequence = offset / LogFormat::BLOCK_SIZE;
+        const auto block = data + offset;
+        summary.blocks++;
+        if (!logSealed(block, id, sequence)) {
+            fprintf(stderr, "%s: block %zu at 0x%zx isn't sealed\n", path, sequence, offset);
+        } else if (!decodeBlock(decoder, block, LogFormat::BLOCK_DATA, summary)) {
+            fprintf(stderr, "%s: block %zu at 0x%zx doesn't decode\n", path, sequence, offset);
+        } else {
+            continue;
+        }
+        summary.corruptBlocks++;
+        decoder.reset();
+    }
+    summary.truncatedBytes = size % LogFormat::BLOCK_SIZE;
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    closeCSVs();
+
+    seconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+    imuSamples = summary.counts[IMU_KEY_RECORD] + summary.counts[IMU_RECORD];
+    baroSamples = summary.counts[BARO_KEY_RECORD] + summary.counts[BARO_RECORD];
+    if (summary.events > 64) {
+        printf("  ... %zu more\n", summary.events - 64);
+    }
+    printf("sessions: %zu\n", summary.sessions);
+    printf("blocks: %zu, %zu corrupt\n", summary.blocks, summary.corruptBlocks);
+    if (summary.truncatedBytes != 0) {
+        printf("truncated: last block has %zu of %zu bytes\n", summary.truncatedBytes, LogFormat::BLOCK_SIZE);
+    }
+    printf("records: %zu imu, %zu baro, %zu gps, %zu status, %zu events\n", imuSamples, baroSamples,
+        summary.counts[GPS_RECORD], summary.counts[STATUS_RECORD], summary.counts[EVENT_RECORD]);
+    if (imuSamples > 1) {
+        const auto span = (summary.lastTime - summary.firstTime) / 1e6;
+        printf("imu: %.1fs at %.0fHz, max %.1fm/s^2 at %.3fs\n", span, (imuSamples - 1) / span, summary.maxAcc,
+            (summary.maxAccTime - summary.firstTime) / 1e6);
+    }
+    if (baroSamples > 0) {
+        printf("baro: %.1fm to %.1fm, %.1fm above the lowest at %.3fs\n", summary.minAltitude, summary.maxAltitude,
+            summary.maxAltitude - summary.minAltitude, static_cast<int64_t>(summary.maxAltitudeTime - summary.firstTime) / 1e6);
+    }
+    if (summary.haveFix) {
+        printf("last fix: %.7f %.7f %.1fm, %u sats\n", summary.lastFix.latitude / 1e7,
+            summary.lastFix.longitude / 1e7, summary.lastFix.altitude / 1e3, summary.lastFix.sats);
+    }
+    printf("decoded in %.3fs, %.0fMB/s", seconds, size / 1e6 / seconds);
+    if (CSVWriter::written != 0) {
+        printf(", %.0fMB/s of CSV", CSVWriter::written / 1e6 / seconds);
+    }
+    printf("\n");
+    ret = summary.corruptBlocks != 0 || summary.truncatedBytes != 0 ? 2 : 0;
+
+out:
+    closeCSVs();
+    if (data != MAP_FAILED) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+// test/test_logdecode includes this file and calls decodeLog() itself
+#ifndef LOGDECODE_NO_MAIN
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s flight.log [outdir]\n", argv[0]);
+        return 1;
+    }
+    return decodeLog(argv[1], argc > 2 ? argv[2] : nullptr);
+}
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @brief Pull the flight logs out of an image of the flightlog partition
+ *
+ * Read the partition off the board (offset and size as in partitions.csv) and split it into one log per flight:
+ *
+ *     esptool.py read_flash 0x340000 0x330000 flightlog.bin
+ *     g++ -std=gnu++17 -O2 -Isrc -o partextract tools/partextract.cpp src/logpartition.cpp src/logformat.cpp
+ *     ./partextract flightlog.bin [outdir]
+ *
+ * Writes flight-NNNNN.log for every flight that hasn't been overwritten. A flight still open in the image, i.e. the
+ * board lost power or was read while logging, ends after its last sealed block, same as the logger does at boot.
+ *
+ */
+#include "logpartition.h"
+#include "logformat.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static std::vector<uint8_t> image;
+
+static bool readImage(const char *path) {
+    auto f = fopen(path, "rb");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    image.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    const auto ok = fread(image.data(), 1, image.size(), f) == image.size();
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "%s: short read\n", path);
+    }
+    return ok;
+}
+
+static FlightEntry entryAt(uint32_t slot) {
+    FlightEntry entry;
+    memcpy(&entry, &image[slot * sizeof(entry)], sizeof(entry));
+    return entry;
+}
+
+static uint64_t findEnd(const LogPartition &layout, uint64_t start) {
+    uint32_t id = 0;
+    auto position = start;
+    for (uint32_t sequence = 0; position - start < layout.dataSize(); sequence++) {
+        const auto block = &image[layout.dataOffset(position)];
+        if ((sequence == 0 && !logId(block, id)) || !logSealed(block, id, sequence)) {
+            break;
+        }
+        position += LogPartition::SECTOR_SIZE;
+    }
+    return position;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s flightlog.bin [outdir]\n", argv[0]);
+        return 1;
+    }
+    const char *outDir = argc > 2 ? argv[2] : ".";
+    if (!readImage(argv[1])) {
+        return 1;
+    }
+    if (image.size() % LogPartition::SECTOR_SIZE != 0 || image.size() <= LogPartition::HEADER_SIZE) {
+        fprintf(stderr, "%s: %zu bytes isn't a flightlog partition\n", argv[1], image.size());
+        return 1;
+    }
+    const LogPartition layout(image.size());
+
+    // the newest flight's end is where the logger would write next
+    FlightEntry entries[LogPartition::MAX_ENTRIES];
+    size_t count = 0;
+    uint64_t head = 0;
+    uint32_t newest = 0;
+    for (uint32_t slot = 0; slot < LogPartition::MAX_ENTRIES; slot++) {
+        auto entry = entryAt(slot);
+        if (!LogPartition::valid(entry)) {
+            continue;
+        }
+        if (entry.end == LogPartition::ERASED) {
+            entry.end = findEnd(layout, entry.start);
+            printf("flight %u was left open\n", entry.ordinal);
+        }
+        if (entry.ordinal > newest) {
+            newest = entry.ordinal;
+            head = entry.end;
+        }
+        entries[count++] = entry;
+    }
+
+    int written = 0;
+    for (size_t i = 0; i < count; i++) {
+        const auto &entry = entries[i];
+        if (!layout.intact(entry, head)) {
+            printf("flight %u was overwritten\n", entry.ordinal);
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/flight-%05u.log", outDir, entry.ordinal);
+        auto f = fopen(path, "wb");
+        if (f == nullptr) {
+            perror(path);
+            return 1;
+        }
+        for (auto position = entry.start; position < entry.end;) {
+            auto n = entry.end - position;
+            if (n > layout.contiguous(position)) {
+                n = layout.contiguous(position);
+            }
+            fwrite(&image[layout.dataOffset(position)], 1, n, f);
+            position += n;
+        }
+        fclose(f);
+        printf("%s: epoch %u, %lluKB\n", path, entry.epoch, (unsigned long long)((entry.end - entry.start) / 1024));
+        written++;
+    }
+    printf("%d flights\n", written);
+    return 0;
+}